@@ -0,0 +1,324 @@
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/thread/thread.hpp>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <Networking/impairment_proxy.h>
+#include <Networking/io_backend.h>
+#include <Networking/latency_histogram.h>
+#include <Networking/tcp_client.h>
+#include <Networking/tcp_server.h>
+#include <Logging/logging.h>
+
+
+namespace Phyre {
+namespace Networking {
+
+// Spins up an echo TCPServer and a number of TCPClients over loopback,
+// and reports throughput, round trip latencies and CPU time per message as JSON.
+//
+// Usage: NetworkBench [--clients=N] [--messages=N] [--size=BYTES] [--rate=MESSAGES_PER_SECOND]
+//                     [--server-threads=N] [--port=PORT]
+//                     [--latency=MS] [--jitter=MS] [--bandwidth=BYTES_PER_SECOND] [--segment=BYTES] [--seed=N]
+//
+// With a rate of 0, every client runs closed loop: the next message is only sent once
+// the previous one came back. Otherwise each client sends on a fixed schedule and latencies
+// are measured from when a message was due, so a stalled server cannot hide its own backlog.
+// Any of the impairment options routes the clients through an ImpairmentProxy on the next port,
+// which applies them in both directions, to see how the stack copes with a WAN instead of loopback.
+// The report names the I/O backend the build runs on; Tools/compare_io_backends.sh runs the
+// bench against an epoll and an io_uring build side by side.
+struct BenchConfig {
+    BenchConfig() :
+        clients(8),
+        messages(10000),
+        size(64),
+        rate(0),
+        server_threads(1),
+        port(4321),
+        seed(1) { }
+
+    bool is_impaired() const {
+        return impairments.latency.count() > 0 || impairments.jitter.count() > 0 ||
+               impairments.bytes_per_second > 0 || impairments.max_segment_size > 0;
+    }
+
+    size_t clients;
+    size_t messages;
+    size_t size;
+    size_t rate;
+    size_t server_threads;
+    uint16_t port;
+    Impairments impairments;
+    size_t seed;
+};
+
+class BenchClient : public TCPClient {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    BenchClient(boost::asio::io_service& io_service,
+                const BenchConfig& config,
+                LatencyHistogram& latencies) :
+        TCPClient(io_service),
+        config_(config),
+        payload_(config.size, 'x'),
+        latencies_(latencies),
+        send_timer_(io_service),
+        interval_(config.rate ? std::chrono::nanoseconds(std::chrono::seconds(1)) / static_cast<std::chrono::nanoseconds::rep>(config.rate) : std::chrono::nanoseconds(0)),
+        sent_(0),
+        completed_(0),
+        received_bytes_(0),
+        is_done_(false) { }
+
+    size_t completed() const { return completed_; }
+
+protected:
+    void OnConnect() override {
+        next_send_at_ = Clock::now();
+        if (interval_.count() == 0) {
+            Send(next_send_at_);
+        } else {
+            ScheduleSend();
+        }
+    }
+
+    size_t OnReadView(boost::string_ref bytes) override {
+        received_bytes_ += bytes.size();
+        Clock::time_point now = Clock::now();
+        while (received_bytes_ >= config_.size && !due_times_.empty()) {
+            received_bytes_ -= config_.size;
+            latencies_.Record(std::chrono::duration_cast<std::chrono::microseconds>(now - due_times_.front()));
+            due_times_.pop_front();
+            ++completed_;
+            if (interval_.count() == 0 && sent_ < config_.messages) {
+                Send(now);
+            }
+        }
+        if (completed_ == config_.messages) {
+            Finish();
+        }
+        return bytes.size();
+    }
+
+    void OnError(const boost::system::error_code& ec) override {
+        PHYRE_LOG(error, kWho) << ec.message();
+        Finish();
+    }
+
+    void OnDisconnect() override { }
+
+private:
+    void Send(Clock::time_point due_at) {
+        due_times_.push_back(due_at);
+        ++sent_;
+        Write(payload_);
+    }
+
+    void ScheduleSend() {
+        send_timer_.expires_at(next_send_at_);
+        send_timer_.async_wait([this](const boost::system::error_code& ec) {
+            if (ec || is_done_) {
+                return;
+            }
+            Send(next_send_at_);
+            next_send_at_ += std::chrono::duration_cast<Clock::duration>(interval_);
+            if (sent_ < config_.messages) {
+                ScheduleSend();
+            }
+        });
+    }
+
+    void Finish() {
+        if (is_done_) {
+            return;
+        }
+        is_done_ = true;
+        send_timer_.cancel();
+        Disconnect();
+    }
+
+    const BenchConfig& config_;
+    std::string payload_;
+    LatencyHistogram& latencies_;
+    boost::asio::steady_timer send_timer_;
+    std::chrono::nanoseconds interval_;
+    Clock::time_point next_send_at_;
+    std::deque<Clock::time_point> due_times_;
+    size_t sent_;
+    size_t completed_;
+    size_t received_bytes_;
+    bool is_done_;
+
+    static const std::string kWho;
+};
+
+const std::string BenchClient::kWho = "[BenchClient]";
+
+bool ParseArguments(int argc, char* argv[], BenchConfig& config) {
+    size_t latency_ms = 0;
+    size_t jitter_ms = 0;
+    std::map<std::string, size_t*> options = {
+        { "--clients", &config.clients },
+        { "--messages", &config.messages },
+        { "--size", &config.size },
+        { "--rate", &config.rate },
+        { "--server-threads", &config.server_threads },
+        { "--latency", &latency_ms },
+        { "--jitter", &jitter_ms },
+        { "--bandwidth", &config.impairments.bytes_per_second },
+        { "--segment", &config.impairments.max_segment_size },
+        { "--seed", &config.seed },
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument(argv[i]);
+        size_t separator = argument.find('=');
+        std::string name = argument.substr(0, separator);
+        if (separator == std::string::npos) {
+            std::cerr << "Expected --name=value but got " << argument << std::endl;
+            return false;
+        }
+
+        try {
+            std::string value = argument.substr(separator + 1);
+            if (name == "--port") {
+                config.port = boost::lexical_cast<uint16_t>(value);
+            } else if (options.count(name)) {
+                *options[name] = boost::lexical_cast<size_t>(value);
+            } else {
+                std::cerr << "Unknown option " << name << std::endl;
+                return false;
+            }
+        } catch (const boost::bad_lexical_cast&) {
+            std::cerr << "Invalid value for " << name << std::endl;
+            return false;
+        }
+    }
+
+    config.impairments.latency = std::chrono::milliseconds(latency_ms);
+    config.impairments.jitter = std::chrono::milliseconds(jitter_ms);
+    if (config.clients == 0 || config.messages == 0 || config.size == 0) {
+        std::cerr << "--clients, --messages and --size must be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int RunBench(const BenchConfig& config) {
+    boost::asio::io_service server_io_service;
+    TCPServer server(server_io_service, config.port);
+    server.set_on_read_callback([](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+        connection->Write(bytes.to_string());
+        return bytes.size();
+    });
+    boost::thread server_thread([&server, &config]() { server.Run(config.server_threads); });
+
+    // The proxy runs on a thread of its own, so that the clients' thread does not skew its delays
+    boost::asio::io_service proxy_io_service;
+    std::unique_ptr<ImpairmentProxy> ptr_proxy;
+    std::unique_ptr<boost::asio::io_service::work> ptr_proxy_work;
+    boost::thread proxy_thread;
+    uint16_t client_port = config.port;
+    if (config.is_impaired()) {
+        client_port = static_cast<uint16_t>(config.port + 1);
+        ptr_proxy = std::make_unique<ImpairmentProxy>(proxy_io_service, client_port, "127.0.0.1",
+                                                      boost::lexical_cast<std::string>(config.port),
+                                                      static_cast<std::mt19937::result_type>(config.seed));
+        ptr_proxy->set_impairments(config.impairments);
+        ptr_proxy->StartAccept();
+        ptr_proxy_work = std::make_unique<boost::asio::io_service::work>(proxy_io_service);
+        proxy_thread = boost::thread([&proxy_io_service]() { proxy_io_service.run(); });
+    }
+
+    boost::asio::io_service client_io_service;
+    LatencyHistogram latencies;
+    std::vector<std::unique_ptr<BenchClient>> clients;
+    for (size_t i = 0; i < config.clients; ++i) {
+        clients.push_back(std::make_unique<BenchClient>(client_io_service, config, latencies));
+    }
+
+    std::clock_t cpu_started_at = std::clock();
+    BenchClient::Clock::time_point started_at = BenchClient::Clock::now();
+    for (std::unique_ptr<BenchClient>& client : clients) {
+        client->Connect("127.0.0.1", boost::lexical_cast<std::string>(client_port));
+    }
+    // Runs until every client has either received all of its echoes or failed
+    client_io_service.run();
+    double seconds = std::chrono::duration<double>(BenchClient::Clock::now() - started_at).count();
+    double cpu_seconds = static_cast<double>(std::clock() - cpu_started_at) / CLOCKS_PER_SEC;
+
+    // Stopping from within the io_service lets the workers run out of work on their own
+    if (ptr_proxy) {
+        proxy_io_service.post([&ptr_proxy, &ptr_proxy_work]() {
+            ptr_proxy->Stop();
+            ptr_proxy_work.reset();
+        });
+        proxy_thread.join();
+    }
+    server_io_service.post([&server]() { server.Stop(); });
+    server_thread.join();
+
+    size_t completed = 0;
+    size_t failed_clients = 0;
+    for (const std::unique_ptr<BenchClient>& client : clients) {
+        completed += client->completed();
+        if (client->completed() < config.messages) {
+            ++failed_clients;
+        }
+    }
+
+    boost::property_tree::ptree report;
+    report.put("backend", IOBackendName());
+    report.put("config.clients", config.clients);
+    report.put("config.messages_per_client", config.messages);
+    report.put("config.message_size", config.size);
+    report.put("config.rate_per_client", config.rate);
+    report.put("config.server_threads", config.server_threads);
+    if (config.is_impaired()) {
+        report.put("config.latency_ms", config.impairments.latency.count());
+        report.put("config.jitter_ms", config.impairments.jitter.count());
+        report.put("config.bandwidth_bytes_per_second", config.impairments.bytes_per_second);
+        report.put("config.segment_size", config.impairments.max_segment_size);
+        report.put("config.seed", config.seed);
+    }
+    report.put("messages", completed);
+    report.put("failed_clients", failed_clients);
+    report.put("seconds", seconds);
+    report.put("messages_per_second", seconds > 0 ? completed / seconds : 0);
+    report.put("megabytes_per_second", seconds > 0 ? completed * config.size / seconds / (1024 * 1024) : 0);
+    report.put("latency_us.p50", latencies.Percentile(50).count());
+    report.put("latency_us.p99", latencies.Percentile(99).count());
+    report.put("latency_us.p999", latencies.Percentile(99.9).count());
+    report.put("latency_us.max", latencies.max().count());
+    report.put("latency_us.mean", latencies.mean().count());
+    report.put("cpu_us_per_message", completed ? cpu_seconds * 1e6 / completed : 0);
+    report.put("server.bytes_received", server.metrics().bytes_received());
+    report.put("server.bytes_sent", server.metrics().bytes_sent());
+    report.put("server.reads", server.metrics().reads());
+    report.put("server.writes", server.metrics().writes());
+    boost::property_tree::write_json(std::cout, report);
+
+    return failed_clients == 0 ? 0 : 1;
+}
+}
+}
+
+int main(int argc, char* argv[]) {
+    Phyre::Logging::set_log_level(Phyre::Logging::kWarning);
+    Phyre::Networking::BenchConfig config;
+    if (!Phyre::Networking::ParseArguments(argc, argv, config)) {
+        return 2;
+    }
+
+    try {
+        return Phyre::Networking::RunBench(config);
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
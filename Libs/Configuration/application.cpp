@@ -7,12 +7,20 @@ Phyre::Configuration::Application::Application(const std::string& path, const Re
     resource_set_(resource_set) { }
 
 std::ifstream Phyre::Configuration::Application::OpenResource(const std::string& resource_name) const {
+    std::ifstream ifs(ResourcePath(resource_name), std::ifstream::binary);
+    return ifs;
+}
+
+std::string Phyre::Configuration::Application::ResourcePath(const std::string& resource_name) const {
     std::ostringstream full_path;
     full_path << path_ << '/' << resource_name;
     std::string full_path_string = full_path.str();
-    
+
     // The path needs to be readable, so we cannot have forward slashes in our path
     boost::algorithm::replace_all(full_path_string, "\\", "/");
-    std::ifstream ifs(full_path_string, std::ifstream::binary);
-    return ifs;
+    return full_path_string;
+}
+
+bool Phyre::Configuration::Application::HasResource(const std::string& resource_name) const {
+    return resource_set_.count(resource_name) > 0;
 }
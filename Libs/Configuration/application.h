@@ -27,6 +27,14 @@ public:
     // @return The stream of data from reading the resource
     std::ifstream OpenResource(const std::string& resource_name) const;
 
+    // @param resource_name The resource we wish to locate
+    // @return The path to the resource on disk, whether or not it exists
+    std::string ResourcePath(const std::string& resource_name) const;
+
+    // @param resource_name The resource we wish to access
+    // @return true if the application lists the resource in phyre.json
+    bool HasResource(const std::string& resource_name) const;
+
 private:
     // The path to where this application can be accessed
     std::string path_;
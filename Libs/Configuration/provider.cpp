@@ -45,6 +45,14 @@ std::string Phyre::Configuration::Provider::GetContents(const std::string& targe
     return std::string();
 }
 
+std::string Phyre::Configuration::Provider::GetResourcePath(const std::string& target_application, const std::string& resource) const {
+    ApplicationMap::const_iterator cit = application_map_.find(target_application);
+    if (cit == application_map_.cend() || !cit->second.HasResource(resource)) {
+        return std::string();
+    }
+    return cit->second.ResourcePath(resource);
+}
+
 std::vector<uint32_t> Phyre::Configuration::Provider::GetContentsUint32t(const std::string& target_application, const std::string& resource) const {
     std::string contents = GetContents(target_application, resource);
     std::vector<uint32_t> contentsUint32t(contents.size() / sizeof(uint32_t));
@@ -62,6 +62,14 @@ public:
     */
     std::vector<uint32_t> GetContentsSPIRV(const std::string& target_application, const std::string& resource) const;
 
+    /**
+    * \brief Locates a resource without reading it, e.g. to stream it with sendfile
+    * \param target_application the application the resource belongs to
+    * \param resource the file we wish to locate
+    * \return The path to the resource. Empty if there is no such application, or it does not list the resource.
+    */
+    std::string GetResourcePath(const std::string& target_application, const std::string& resource) const;
+
 private:
     //----------------- Type Definitions ---------------------
    
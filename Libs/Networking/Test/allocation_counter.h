@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts every heap allocation of the test binary by replacing the global operator new.
+// Replacements may only be defined once per program, so include this from a single translation unit.
+namespace Phyre {
+namespace Networking {
+    inline std::atomic<size_t>& allocation_count() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+}
+}
+
+void* operator new(size_t size) {
+    ++Phyre::Networking::allocation_count();
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
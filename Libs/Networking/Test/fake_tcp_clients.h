@@ -1,6 +1,7 @@
 #pragma once
 
 #include <queue>
+#include <boost/asio/steady_timer.hpp>
 #include <gtest/gtest.h>
 #include <Logging/logging.h>
 #include <Networking/tcp_client.h>
@@ -62,6 +63,27 @@ protected:
     }
 };
 
+class TCPClientReadView : public FakeTCPClient {
+public:
+    TCPClientReadView(boost::asio::io_service& io_service):
+        FakeTCPClient(io_service),
+        copied_reads_(0) { }
+
+    std::string received_;
+    size_t copied_reads_;
+
+protected:
+    size_t OnReadView(boost::string_ref bytes) override {
+        received_.assign(bytes.data(), bytes.size());
+        io_service_.stop();
+        return bytes.size();
+    }
+
+    void OnRead(const std::string& /*data*/) override {
+        ++copied_reads_;
+    }
+};
+
 class TCPClientReadQueuedMessages : public FakeTCPClient {
 public:
     TCPClientReadQueuedMessages(boost::asio::io_service& io_service, const std::queue<std::string>& message_queue):
@@ -115,6 +137,66 @@ private:
 
 
 
+// Stops the io_service once every client sharing the countdown has read its greeting
+class TCPClientCountdown : public FakeTCPClient {
+public:
+    TCPClientCountdown(boost::asio::io_service& io_service, size_t& remaining):
+        FakeTCPClient(io_service),
+        remaining_(remaining),
+        has_read_(false) { }
+
+protected:
+    void OnConnect() override {
+        std::ostringstream oss;
+        oss << "hello";
+        Write(oss);
+    }
+
+    void OnRead(const std::string& /*data*/) override {
+        if (has_read_) {
+            return;
+        }
+        has_read_ = true;
+        if (--remaining_ == 0) {
+            io_service_.stop();
+        }
+    }
+
+private:
+    size_t& remaining_;
+    bool has_read_;
+};
+
+// Holds off reading the server's greeting for a while to exercise flow control
+class TCPClientPausedRead : public FakeTCPClient {
+public:
+    TCPClientPausedRead(boost::asio::io_service& io_service):
+        FakeTCPClient(io_service),
+        reads_(0),
+        resume_timer_(io_service) { }
+
+    size_t reads_;
+
+protected:
+    void OnConnect() override {
+        PauseReading();
+        resume_timer_.expires_from_now(std::chrono::milliseconds(100));
+        resume_timer_.async_wait([this](const boost::system::error_code&) {
+            // The greeting has long arrived, but it must not have been read yet
+            EXPECT_EQ(reads_, 0u);
+            ResumeReading();
+        });
+    }
+
+    void OnRead(const std::string& /*data*/) override {
+        ++reads_;
+        io_service_.stop();
+    }
+
+private:
+    boost::asio::steady_timer resume_timer_;
+};
+
 class TCPClientDisconnect : public FakeTCPClient {
 public:
     TCPClientDisconnect(boost::asio::io_service& io_service):
@@ -147,5 +229,193 @@ protected:
     }
 };
 
+// Upgrades to TLS once the server agreed to, then waits for its payload to be echoed
+class TCPClientStartTLS : public FakeTCPClient {
+public:
+    TCPClientStartTLS(boost::asio::io_service& io_service, boost::asio::ssl::context& context):
+        FakeTCPClient(io_service),
+        context_(context) { }
+
+    std::string echoed_;
+
+protected:
+    void OnConnect() override {
+        Write(std::string("STARTTLS\r\n"));
+    }
+
+    size_t OnReadView(boost::string_ref bytes) override {
+        if (!is_tls()) {
+            EXPECT_EQ(bytes, "PROCEED\r\n");
+            StartTLS(context_, "localhost", [this]() { Write(std::string("ping")); });
+            return bytes.size();
+        }
+
+        echoed_.append(bytes.data(), bytes.size());
+        if (echoed_.size() >= 4) {
+            io_service_.stop();
+        }
+        return bytes.size();
+    }
+
+private:
+    boost::asio::ssl::context& context_;
+};
+
+// Sends every payload as a frame and collects the frames echoed back
+class TCPClientFrames : public FakeTCPClient {
+public:
+    TCPClientFrames(boost::asio::io_service& io_service, const std::vector<std::string>& payloads):
+        FakeTCPClient(io_service),
+        payloads_(payloads) { }
+
+    std::vector<std::string> payloads_;
+    std::vector<std::string> frames_;
+
+protected:
+    void OnConnect() override {
+        for (const std::string& payload : payloads_) {
+            WriteFrame(payload);
+        }
+    }
+
+    void OnFrame(boost::string_ref frame) override {
+        frames_.push_back(frame.to_string());
+        if (frames_.size() == payloads_.size()) {
+            io_service_.stop();
+        }
+    }
+};
+
+// Keeps a single message in flight and sends the next one as soon as the echo is back
+class TCPClientPingPong : public FakeTCPClient {
+public:
+    TCPClientPingPong(boost::asio::io_service& io_service, const std::string& message, size_t round_trips):
+        FakeTCPClient(io_service),
+        message_(message),
+        round_trips_(round_trips),
+        completed_(0),
+        received_(0) { }
+
+    // Invoked after every completed round trip
+    std::function<void(size_t)> on_round_trip_;
+
+protected:
+    void OnConnect() override {
+        Write(message_);
+    }
+
+    size_t OnReadView(boost::string_ref bytes) override {
+        received_ += bytes.size();
+        while (received_ >= message_.size()) {
+            received_ -= message_.size();
+            ++completed_;
+            if (on_round_trip_) {
+                on_round_trip_(completed_);
+            }
+            if (completed_ == round_trips_) {
+                io_service_.stop();
+            } else {
+                Write(message_);
+            }
+        }
+        return bytes.size();
+    }
+
+private:
+    std::string message_;
+    size_t round_trips_;
+    size_t completed_;
+    size_t received_;
+};
+
+// Sends a payload and then quietly takes whatever the server sends back
+class TCPClientSink : public FakeTCPClient {
+public:
+    TCPClientSink(boost::asio::io_service& io_service, const std::string& payload):
+        FakeTCPClient(io_service),
+        payload_(payload),
+        bytes_received_(0) { }
+
+    std::string payload_;
+    size_t bytes_received_;
+
+protected:
+    void OnConnect() override {
+        Write(payload_);
+    }
+
+    size_t OnReadView(boost::string_ref bytes) override {
+        bytes_received_ += bytes.size();
+        return bytes.size();
+    }
+
+    void OnError(const boost::system::error_code& /*ec*/) override { }
+
+    void OnDisconnect() override {
+        io_service_.stop();
+    }
+};
+
+// Remembers the error which ended the connection
+class TCPClientTimeout : public FakeTCPClient {
+public:
+    TCPClientTimeout(boost::asio::io_service& io_service):
+        FakeTCPClient(io_service) { }
+
+    boost::system::error_code error_;
+
+protected:
+    void OnRead(const std::string& /*data*/) override { }
+
+    void OnError(const boost::system::error_code& ec) override {
+        error_ = ec;
+    }
+
+    void OnDisconnect() override {
+        io_service_.stop();
+    }
+};
+
+// Replays a login whenever the connection comes back, and lets the test step in on reads and errors
+class TCPClientReconnect : public FakeTCPClient {
+public:
+    TCPClientReconnect(boost::asio::io_service& io_service, size_t expected):
+        FakeTCPClient(io_service),
+        expected_(expected) { }
+
+    size_t expected_;
+    std::string received_;
+    std::vector<boost::system::error_code> errors_;
+    std::function<void()> on_read_;
+    std::function<void()> on_error_;
+
+protected:
+    void OnConnect() override {
+        Write(std::string("first"));
+    }
+
+    void OnReconnect() override {
+        Write(std::string("login "));
+        ResumeSession();
+    }
+
+    void OnRead(const std::string& data) override {
+        received_ += data;
+        if (on_read_) {
+            on_read_();
+        }
+        if (received_.size() >= expected_) {
+            io_service_.stop();
+        }
+    }
+
+    void OnError(const boost::system::error_code& ec) override {
+        errors_.push_back(ec);
+        if (on_error_) {
+            on_error_();
+        }
+    }
+};
+
 }
 }
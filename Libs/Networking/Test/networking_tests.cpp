@@ -3,5 +3,7 @@
 int main(int argc, char* argv[]) {
     set_log_level(Phyre::Logging::kTrace);
     testing::InitGoogleTest(&argc, argv);
+
+    Phyre::Utils::TestLoader::Initialize(argc, argv);
     return RUN_ALL_TESTS();
 }
\ No newline at end of file
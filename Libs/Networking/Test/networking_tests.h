@@ -3,10 +3,39 @@
 #include <gtest/gtest.h>
 #include <boost/assign.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <set>
 #include <Logging/logging.h>
+#include <Networking/connection_metrics.h>
+#include <Networking/dns_cache.h>
+#include <Networking/frame_codec.h>
+#include <Networking/happy_eyeballs_connector.h>
+#include <Networking/impairment_proxy.h>
+#include <Networking/io_backend.h>
+#include <Networking/receive_buffer.h>
+#include <Networking/reconnect_policy.h>
+#include <Networking/resource_server.h>
+#include <Networking/sharded_tcp_server.h>
+#include <Networking/stream_socket.h>
+#include <Networking/tcp_connection_pool.h>
 #include <Networking/tcp_client.h>
 #include <Networking/tcp_server.h>
+#include <Networking/tcp_stream.h>
+#include <Networking/timing_wheel.h>
+#include <Networking/token_bucket.h>
+#include <Networking/udp_socket.h>
+#include <Networking/write_queue.h>
+#include <Utils/test_loader.h>
+#include "allocation_counter.h"
 #include "fake_tcp_clients.h"
+#include "tls_test_certificates.h"
+
+#if defined(PHYRE_HAS_FILE_DESCRIPTOR_PASSING)
+#include <unistd.h>
+#endif
 
 namespace Phyre {
 namespace Networking {
@@ -48,6 +77,32 @@ namespace Networking {
         io_service_.run();
     }
 
+    TEST_F(TCPClientTest, TracksTrafficOfTheConnection) {
+        std::string payload = "Hello!\r\n";
+        TCPClientRead client(io_service_, payload);
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+
+        const ConnectionMetrics& metrics = client.metrics();
+        EXPECT_EQ(metrics.connects(), 1u);
+        EXPECT_EQ(metrics.writes(), 1u);
+        EXPECT_EQ(metrics.bytes_sent(), payload.size());
+        EXPECT_EQ(metrics.write_latency().count(), 1u);
+        EXPECT_EQ(metrics.queue_depth(), 0);
+        EXPECT_GE(metrics.reads(), 1u);
+        EXPECT_GT(metrics.bytes_received(), 0u);
+    }
+
+    TEST_F(TCPClientTest, ReadsAreDeliveredAsViews) {
+        TCPClientReadView client(io_service_);
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_FALSE(client.received_.empty());
+        EXPECT_EQ(client.copied_reads_, 0u);
+    }
+
     TEST_F(TCPClientTest, CanDisconnectFromAService) {
         TCPClientDisconnect client(io_service_);
         tcp_server_.StartAccept();
@@ -58,8 +113,9 @@ namespace Networking {
     TEST_F(TCPClientTest, DisconnectsAfterError) {
         TCPClientError client(io_service_);
 
-        // There is no server to connect to, so an error is handled
-        client.Connect(host_, port_or_service_);
+        // There is no server to connect to, so an error is handled.
+        // The fixture's server listens on port_or_service_, hence another port.
+        client.Connect(host_, "1237");
         io_service_.run();
     }
 
@@ -76,5 +132,1564 @@ namespace Networking {
         io_service_.run();
     }
 
+    TEST_F(TCPClientTest, ServerHandsReadsToTheReadCallback) {
+        std::string payload = "Hello!\r\n";
+        std::string received;
+        tcp_server_.set_on_read_callback([&received](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            received.append(bytes.data(), bytes.size());
+            connection->Write("ack");
+            return bytes.size();
+        });
+        TCPClientRead client(io_service_, payload);
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_EQ(received, payload);
+    }
+
+    TEST_F(TCPClientTest, ServerDropsWritesBeyondTheHighWaterMark) {
+        const std::string chunk(256 * 1024, 'x');
+        size_t completed = 0;
+        size_t dropped = 0;
+        tcp_server_.set_write_limits(WriteLimits(chunk.size(), 0, WriteLimits::kDrop));
+        tcp_server_.set_on_read_callback([&](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            for (int i = 0; i < 4; ++i) {
+                connection->Write(chunk, [&](const boost::system::error_code& ec, size_t) {
+                    dropped += ec == boost::asio::error::no_buffer_space;
+                    if (++completed == 4) {
+                        io_service_.stop();
+                    }
+                });
+            }
+            EXPECT_TRUE(connection->is_write_blocked());
+            return bytes.size();
+        });
+        TCPClientSink client(io_service_, "Hello!\r\n");
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_EQ(dropped, 3u);
+        EXPECT_EQ(tcp_server_.connection_count(), 1u);
+    }
+
+    TEST_F(TCPClientTest, ServerDisconnectsClientsWhichFallBehind) {
+        const std::string chunk(256 * 1024, 'x');
+        tcp_server_.set_write_limits(WriteLimits(chunk.size(), 0, WriteLimits::kDisconnect));
+        tcp_server_.set_on_read_callback([&chunk](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            connection->Write(chunk);
+            connection->Write(chunk);
+            return bytes.size();
+        });
+        TCPClientSink client(io_service_, "Hello!\r\n");
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_FALSE(client.is_connected());
+        EXPECT_EQ(tcp_server_.connection_count(), 0u);
+    }
+
+    TEST_F(TCPClientTest, ServerPausesReadsUntilTheClientCatchesUp) {
+        const std::string chunk(256 * 1024, 'x');
+        size_t writable = 0;
+        bool is_retry_written = false;
+        tcp_server_.set_write_limits(WriteLimits(chunk.size(), chunk.size() / 4, WriteLimits::kBlock));
+        tcp_server_.set_on_writable_callback([&](const TCPServerConnection::pointer& connection) {
+            EXPECT_FALSE(connection->is_write_blocked());
+            if (++writable > 1) {
+                return;
+            }
+            connection->Write(chunk, [&](const boost::system::error_code& ec, size_t) {
+                EXPECT_FALSE(ec);
+                is_retry_written = true;
+                io_service_.stop();
+            });
+        });
+        tcp_server_.set_on_read_callback([&chunk](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            connection->Write(chunk);
+            // Nothing is queued beyond the high water mark, the producer has to wait for the writable callback
+            connection->Write(chunk, [](const boost::system::error_code& ec, size_t) {
+                EXPECT_EQ(ec, boost::asio::error::would_block);
+            });
+            EXPECT_TRUE(connection->is_write_blocked());
+            return bytes.size();
+        });
+        TCPClientSink client(io_service_, "Hello!\r\n");
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_GE(writable, 1u);
+        EXPECT_TRUE(is_retry_written);
+    }
+
+    TEST_F(TCPClientTest, ClientReassemblesFramesFromTheStream) {
+        tcp_server_.set_on_read_callback([](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            connection->Write(bytes.to_string());
+            return bytes.size();
+        });
+        std::vector<std::string> payloads = { "first", "", std::string(70000, 'x'), "last" };
+        TCPClientFrames client(io_service_, payloads);
+        client.set_frame_codec(std::make_unique<VarintFrameCodec>());
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_EQ(client.frames_, payloads);
+    }
+
+    TEST_F(TCPClientTest, SteadyStateEchoesDoNotAllocate) {
+        const size_t warm_up = 100;
+        const size_t measured = 1000;
+        tcp_server_.set_on_read_callback([](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            // Short enough for the small string optimization
+            connection->Write(bytes.to_string());
+            return bytes.size();
+        });
+        TCPClientPingPong client(io_service_, "ping", warm_up + measured);
+        size_t allocations_at_warm_up = 0;
+        client.on_round_trip_ = [&](size_t completed) {
+            if (completed == warm_up) {
+                allocations_at_warm_up = allocation_count();
+            }
+        };
+
+        // Formatting log records allocates, which is not what is being measured here
+        set_log_level(Phyre::Logging::kWarning);
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        size_t allocations = allocation_count() - allocations_at_warm_up;
+        set_log_level(Phyre::Logging::kTrace);
+
+        EXPECT_EQ(allocations, 0u) << double(allocations) / measured << " allocations per round trip";
+    }
+
+    TEST_F(TCPClientTest, ServerClosesIdleConnections) {
+        tcp_server_.set_timeouts(std::chrono::milliseconds(0), std::chrono::milliseconds(0), std::chrono::milliseconds(100));
+        TCPClientTimeout client(io_service_);
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_EQ(client.error_, boost::asio::error::eof);
+        EXPECT_EQ(tcp_server_.connection_count(), 0u);
+    }
+
+    TEST_F(TCPClientTest, ClientTimesOutWhenThePeerGoesQuiet) {
+        TCPClientTimeout client(io_service_);
+        client.set_timeouts(std::chrono::milliseconds(100), std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_EQ(client.error_, boost::asio::error::timed_out);
+    }
+
+    TEST_F(TCPClientTest, ServerHandlesManyConcurrentConnections) {
+        const size_t client_count = 32;
+        std::string port_or_service = "1236";
+        boost::asio::io_service server_io_service;
+        TCPServer server(server_io_service, boost::lexical_cast<uint16_t>(port_or_service));
+        boost::thread server_thread([&server]() { server.Run(4); });
+
+        size_t remaining = client_count;
+        std::vector<std::unique_ptr<TCPClientCountdown>> clients;
+        for (size_t i = 0; i < client_count; ++i) {
+            clients.push_back(std::make_unique<TCPClientCountdown>(io_service_, remaining));
+            clients.back()->Connect(host_, port_or_service);
+        }
+        io_service_.run();
+
+        server_io_service.stop();
+        server_thread.join();
+        EXPECT_EQ(remaining, 0u);
+        EXPECT_EQ(server.connection_count(), client_count);
+    }
+
+    TEST_F(TCPClientTest, ServerStopsFromAnotherThreadWhileItsWorkersAccept) {
+        const size_t client_count = 8;
+        std::string port_or_service = "1250";
+        boost::asio::io_service server_io_service;
+        TCPServer server(server_io_service, boost::lexical_cast<uint16_t>(port_or_service));
+        boost::thread server_thread([&server]() { server.Run(4); });
+
+        size_t remaining = client_count;
+        std::vector<std::unique_ptr<TCPClientCountdown>> clients;
+        for (size_t i = 0; i < client_count; ++i) {
+            clients.push_back(std::make_unique<TCPClientCountdown>(io_service_, remaining));
+            clients.back()->Connect(host_, port_or_service);
+        }
+        io_service_.run();
+        EXPECT_EQ(remaining, 0u);
+
+        // The workers run out of work once the acceptor and every connection are closed
+        server.Stop();
+        server_thread.join();
+        EXPECT_EQ(server.connection_count(), 0u);
+    }
+
+    TEST_F(TCPClientTest, ShardedServerSpreadsConnectionsOverItsShards) {
+        const size_t client_count = 32;
+        std::string port_or_service = "1241";
+        ShardedTCPServer server(boost::lexical_cast<uint16_t>(port_or_service), 4);
+        std::vector<size_t> reads_per_shard(server.shard_count());
+        for (size_t i = 0; i < server.shard_count(); ++i) {
+            // Each shard only ever runs on its own thread, so its counter needs no synchronization
+            size_t& reads = reads_per_shard[i];
+            server.shard(i).set_on_read_callback([&reads](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+                ++reads;
+                connection->Write("ack");
+                return bytes.size();
+            });
+        }
+        server.set_cpu_affinity(true);
+        boost::thread server_thread([&server]() { server.Run(); });
+
+        size_t remaining = client_count;
+        std::vector<std::unique_ptr<TCPClientCountdown>> clients;
+        for (size_t i = 0; i < client_count; ++i) {
+            clients.push_back(std::make_unique<TCPClientCountdown>(io_service_, remaining));
+            clients.back()->Connect(host_, port_or_service);
+        }
+        io_service_.run();
+        EXPECT_EQ(remaining, 0u);
+        EXPECT_EQ(server.connection_count(), client_count);
+
+        server.Stop();
+        server_thread.join();
+        EXPECT_EQ(server.connection_count(), 0u);
+        EXPECT_EQ(std::accumulate(reads_per_shard.begin(), reads_per_shard.end(), size_t(0)), client_count);
+    }
+
+    TEST(ShardedTCPServerTest, ShardsShareTheEphemeralPortOfTheFirstOne) {
+        ShardedTCPServer server(0, 4);
+        uint16_t port = ToTCPEndpoint(server.local_endpoint()).port();
+        EXPECT_NE(port, 0u);
+        for (size_t i = 0; i < server.shard_count(); ++i) {
+            EXPECT_EQ(ToTCPEndpoint(server.shard(i).local_endpoint()).port(), port);
+        }
+    }
+
+    TEST_F(TCPClientTest, CanPauseAndResumeReading) {
+        TCPClientPausedRead client(io_service_);
+        tcp_server_.StartAccept();
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_EQ(client.reads_, 1u);
+    }
+
+    TEST(WriteQueueTest, CoalescesBuffersWhileAWriteIsInFlight) {
+        WriteQueue write_queue;
+        std::vector<size_t> completed;
+        WriteQueue::OnWriteCallback record = [&completed](const boost::system::error_code& ec, size_t bytes) {
+            EXPECT_FALSE(ec);
+            completed.push_back(bytes);
+        };
+
+        EXPECT_TRUE(write_queue.Push("first", record));
+        EXPECT_EQ(write_queue.PrepareBatch().size(), 1u);
+        EXPECT_TRUE(write_queue.write_in_flight());
+
+        // Only one write may be in flight, so these must wait for the next batch
+        EXPECT_FALSE(write_queue.Push("second", record));
+        EXPECT_FALSE(write_queue.Push("third", record));
+        EXPECT_EQ(write_queue.depth(), 3u);
+        EXPECT_EQ(write_queue.pending_bytes(), 16u);
+
+        EXPECT_TRUE(write_queue.Complete(boost::system::error_code(), 5));
+        WriteQueue::BufferSequence batch = write_queue.PrepareBatch();
+        EXPECT_EQ(batch.size(), 2u);
+        EXPECT_EQ(boost::asio::buffer_size(batch), 11u);
+
+        EXPECT_FALSE(write_queue.Complete(boost::system::error_code(), 11));
+        EXPECT_TRUE(write_queue.empty());
+        EXPECT_EQ(completed, std::vector<size_t>({ 5u, 6u, 5u }));
+    }
+
+    TEST(WriteQueueTest, ClearFailsPendingWrites) {
+        WriteQueue write_queue;
+        boost::system::error_code reported;
+        write_queue.Push("pending", [&reported](const boost::system::error_code& ec, size_t) { reported = ec; });
+        write_queue.Clear(boost::asio::error::operation_aborted);
+        EXPECT_EQ(reported, boost::asio::error::operation_aborted);
+        EXPECT_EQ(write_queue.pending_bytes(), 0u);
+    }
+
+    TEST(WriteQueueTest, SendsFileDescriptorsInABatchOfTheirOwn) {
+        WriteQueue write_queue;
+        write_queue.Push("first");
+        write_queue.Push("second");
+        write_queue.Push("with descriptors", WriteQueue::OnWriteCallback(), { 7 });
+        write_queue.Push("last");
+
+        EXPECT_EQ(write_queue.PrepareBatch().size(), 2u);
+        EXPECT_TRUE(write_queue.batch_file_descriptors().empty());
+        EXPECT_TRUE(write_queue.Complete(boost::system::error_code(), 11));
+
+        WriteQueue::BufferSequence batch = write_queue.PrepareBatch();
+        EXPECT_EQ(batch.size(), 1u);
+        EXPECT_EQ(boost::asio::buffer_size(batch), 16u);
+        EXPECT_EQ(write_queue.batch_file_descriptors(), std::vector<int>({ 7 }));
+        EXPECT_TRUE(write_queue.Complete(boost::system::error_code(), 16));
+
+        EXPECT_EQ(write_queue.PrepareBatch().size(), 1u);
+        EXPECT_TRUE(write_queue.batch_file_descriptors().empty());
+        EXPECT_FALSE(write_queue.Complete(boost::system::error_code(), 4));
+    }
+
+    // Feeds the stream to the codec in chunks of chunk_size, the way reads would
+    std::vector<std::string> DecodeInChunks(FrameCodec& codec, const std::string& stream, size_t chunk_size, boost::system::error_code& ec) {
+        std::vector<std::string> frames;
+        ReceiveBuffer receive_buffer(16, 1024 * 1024);
+        for (size_t offset = 0; offset < stream.size() && !ec; offset += chunk_size) {
+            std::string chunk = stream.substr(offset, chunk_size);
+            for (size_t copied = 0; copied < chunk.size(); ) {
+                size_t bytes = boost::asio::buffer_copy(receive_buffer.Prepare(), boost::asio::buffer(chunk) + copied);
+                receive_buffer.Commit(bytes);
+                copied += bytes;
+            }
+            receive_buffer.Consume(codec.Decode(receive_buffer.data(), [&frames](boost::string_ref frame) {
+                frames.push_back(frame.to_string());
+            }, ec));
+        }
+        return frames;
+    }
+
+    TEST(FrameCodecTest, DecodesFramesSplitAcrossReads) {
+        std::vector<std::string> payloads = { "a", "", std::string(300, 'b'), "c\rd" };
+        VarintFrameCodec varint;
+        FixedHeaderFrameCodec fixed_header(2);
+        DelimiterFrameCodec delimiter("\r\n");
+        for (FrameCodec* codec : std::vector<FrameCodec*>{ &varint, &fixed_header, &delimiter }) {
+            std::string stream;
+            for (const std::string& payload : payloads) {
+                stream += codec->Encode(payload);
+            }
+            for (size_t chunk_size : { size_t(1), size_t(3), stream.size() }) {
+                boost::system::error_code ec;
+                EXPECT_EQ(DecodeInChunks(*codec, stream, chunk_size, ec), payloads);
+                EXPECT_FALSE(ec);
+            }
+        }
+    }
+
+    TEST(FrameCodecTest, RejectsFramesLargerThanTheMaximum) {
+        // Encoding is not limited by the maximum, which stands in for a misbehaving peer
+        std::string oversized(64, 'x');
+        VarintFrameCodec varint(16);
+        FixedHeaderFrameCodec fixed_header(4, 16);
+        DelimiterFrameCodec delimiter("\r\n", 16);
+        std::vector<std::pair<FrameCodec*, std::string>> streams = {
+            { &varint, varint.Encode("fits") + VarintFrameCodec().Encode(oversized) },
+            { &fixed_header, fixed_header.Encode("fits") + FixedHeaderFrameCodec(4).Encode(oversized) },
+            { &delimiter, delimiter.Encode("fits") + delimiter.Encode(oversized) },
+        };
+        for (auto& stream : streams) {
+            boost::system::error_code ec;
+            EXPECT_EQ(DecodeInChunks(*stream.first, stream.second, 8, ec), std::vector<std::string>{ "fits" });
+            EXPECT_EQ(ec, boost::asio::error::message_size);
+        }
+    }
+
+    TEST(FrameCodecTest, RejectsVarintLengthsWhichOverflow) {
+        // Without the check, the 0x02 would shift out of 64 bits and leave an empty frame behind
+        std::string header(9, '\x80');
+        header.push_back('\x02');
+        VarintFrameCodec varint(std::numeric_limits<size_t>::max());
+        boost::system::error_code ec;
+        EXPECT_TRUE(DecodeInChunks(varint, header + "payload", 4, ec).empty());
+        EXPECT_EQ(ec, boost::asio::error::invalid_argument);
+    }
+
+    TEST(ReceiveBufferTest, GrowsWhenReadsFillTheWindow) {
+        ReceiveBuffer receive_buffer(8, 32);
+        EXPECT_EQ(boost::asio::buffer_size(receive_buffer.Prepare()), 8u);
+        receive_buffer.Commit(8);
+
+        // The last read filled everything, so the kernel likely has more
+        EXPECT_EQ(boost::asio::buffer_size(receive_buffer.Prepare()), 8u);
+        EXPECT_EQ(receive_buffer.capacity(), 16u);
+        receive_buffer.Commit(8);
+        receive_buffer.Prepare();
+        receive_buffer.Commit(16);
+
+        // Nothing was consumed and the window cannot grow anymore
+        EXPECT_EQ(receive_buffer.capacity(), 32u);
+        EXPECT_EQ(boost::asio::buffer_size(receive_buffer.Prepare()), 0u);
+    }
+
+    TEST(ReceiveBufferTest, KeepsUnconsumedBytesAcrossReads) {
+        ReceiveBuffer receive_buffer(8, 8);
+        boost::asio::mutable_buffers_1 free_space = receive_buffer.Prepare();
+        boost::asio::buffer_copy(free_space, boost::asio::buffer(std::string("abcdefgh")));
+        receive_buffer.Commit(8);
+        receive_buffer.Consume(6);
+        EXPECT_EQ(receive_buffer.data(), "gh");
+
+        // Consumed bytes are reclaimed by moving the partial message to the front
+        free_space = receive_buffer.Prepare();
+        EXPECT_EQ(boost::asio::buffer_size(free_space), 6u);
+        boost::asio::buffer_copy(free_space, boost::asio::buffer(std::string("ij")));
+        receive_buffer.Commit(2);
+        EXPECT_EQ(receive_buffer.data(), "ghij");
+    }
+
+    TEST_F(TCPClientTest, ConnectFallsBackToTheNextEndpoint) {
+        using boost::asio::ip::tcp;
+        boost::asio::ip::address loopback = boost::asio::ip::address::from_string(host_);
+        std::vector<tcp::endpoint> endpoints = {
+            tcp::endpoint(loopback, 1237), // Nobody listens here
+            tcp::endpoint(loopback, boost::lexical_cast<uint16_t>(port_or_service_))
+        };
+
+        boost::system::error_code connect_error(boost::asio::error::not_connected);
+        TCPSocket socket(io_service_,
+                         [&](const boost::system::error_code& ec) { connect_error = ec; io_service_.stop(); },
+                         [](const boost::system::error_code&, size_t) { });
+        tcp_server_.StartAccept();
+        socket.Connect(endpoints);
+        io_service_.run();
+
+        EXPECT_FALSE(connect_error);
+        EXPECT_EQ(socket.socket().remote_endpoint(), endpoints.back());
+        socket.Close();
+    }
+
+    TEST_F(TCPClientTest, ConnectReportsFailureOnceEveryEndpointFailed) {
+        using boost::asio::ip::tcp;
+        boost::asio::ip::address loopback = boost::asio::ip::address::from_string(host_);
+        std::vector<tcp::endpoint> endpoints = { tcp::endpoint(loopback, 1237), tcp::endpoint(loopback, 1238) };
+
+        size_t callbacks = 0;
+        HappyEyeballsConnector::pointer connector = HappyEyeballsConnector::Create(io_service_);
+        connector->Connect(endpoints, [&callbacks](const boost::system::error_code& ec, tcp::socket* winner) {
+            ++callbacks;
+            EXPECT_TRUE(ec);
+            EXPECT_EQ(winner, nullptr);
+        });
+        io_service_.run();
+        EXPECT_EQ(callbacks, 1u);
+    }
+
+    TEST_F(TCPClientTest, ConnectDoesNotCallBackOnceCancelled) {
+        size_t callbacks = 0;
+        {
+            // Also holds for the failure an empty list of endpoints posts
+            TCPSocket socket(io_service_,
+                             [&callbacks](const boost::system::error_code&) { ++callbacks; },
+                             [](const boost::system::error_code&, size_t) { });
+            socket.Connect(std::vector<boost::asio::ip::tcp::endpoint>());
+        }
+        HappyEyeballsConnector::pointer connector = HappyEyeballsConnector::Create(io_service_);
+        connector->Connect({}, [&callbacks](const boost::system::error_code&, boost::asio::ip::tcp::socket*) { ++callbacks; });
+        connector->Cancel();
+        io_service_.run();
+        EXPECT_EQ(callbacks, 0u);
+    }
+
+#if defined(BOOST_ASIO_HAS_IO_URING)
+    // Built with PHYRE_IO_URING, every other test runs on io_uring too
+    TEST(IOBackendTest, RunsOnIOUring) {
+        EXPECT_STREQ(IOBackendName(), "io_uring");
+    }
+#endif
+
+    TEST(LatencyHistogramTest, ReportsPercentilesWithinTheBucketError) {
+        LatencyHistogram histogram;
+        for (int i = 1; i <= 1000; ++i) {
+            histogram.Record(std::chrono::microseconds(i));
+        }
+        EXPECT_EQ(histogram.count(), 1000u);
+        EXPECT_EQ(histogram.max(), std::chrono::microseconds(1000));
+        EXPECT_EQ(histogram.Percentile(100), std::chrono::microseconds(1000));
+
+        // Values past kSubBuckets are only accurate to within 1 / kSubBuckets
+        double median = static_cast<double>(histogram.Percentile(50).count());
+        EXPECT_GE(median, 500);
+        EXPECT_LE(median, 500 * (1 + 1.0 / LatencyHistogram::kSubBuckets));
+        EXPECT_EQ(histogram.Percentile(1), std::chrono::microseconds(10));
+    }
+
+    TEST(LatencyHistogramTest, EveryValueFallsWithinItsBucket) {
+        for (uint64_t value : { 0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, 1ull << 40 }) {
+            uint32_t index = LatencyHistogram::BucketIndex(value);
+            EXPECT_LT(index, LatencyHistogram::kBucketCount);
+            EXPECT_GE(LatencyHistogram::BucketUpperBound(index), value);
+            if (index > 0) {
+                EXPECT_LT(LatencyHistogram::BucketUpperBound(index - 1), value);
+            }
+        }
+    }
+
+    TEST(ConnectionMetricsTest, AggregatesEveryConnection) {
+        ConnectionMetrics::pointer server = std::make_shared<ConnectionMetrics>();
+        ConnectionMetrics first(server);
+        ConnectionMetrics second(server);
+
+        first.RecordRead(10);
+        second.RecordRead(5);
+        first.RecordWrite(3, std::chrono::milliseconds(2));
+        first.RecordQueueDepth(4);
+        second.RecordQueueDepth(2);
+        first.RecordQueueDepth(1);
+
+        EXPECT_EQ(server->bytes_received(), 15u);
+        EXPECT_EQ(server->reads(), 2u);
+        EXPECT_EQ(server->bytes_sent(), 3u);
+        EXPECT_EQ(server->write_latency().count(), 1u);
+        EXPECT_EQ(&first.write_latency(), &server->write_latency());
+        EXPECT_EQ(server->queue_depth(), 3);
+        EXPECT_EQ(server->max_queue_depth(), 6);
+        EXPECT_EQ(first.max_queue_depth(), 4);
+    }
+
+    TEST(TimingWheelTest, FiresCallbacksInOrderAcrossRounds) {
+        boost::asio::io_service io_service;
+        // A short wheel so that the longer delays have to wait out whole rounds
+        TimingWheel::pointer wheel = TimingWheel::Create(io_service, std::chrono::milliseconds(5), 4);
+        std::vector<std::string> fired;
+        wheel->Schedule(std::chrono::milliseconds(60), [&fired]() { fired.push_back("late"); });
+        wheel->Schedule(std::chrono::milliseconds(10), [&fired]() { fired.push_back("early"); });
+        TimingWheel::TimerId cancelled = wheel->Schedule(std::chrono::milliseconds(30), [&fired]() { fired.push_back("cancelled"); });
+        EXPECT_EQ(wheel->size(), 3u);
+        EXPECT_TRUE(wheel->Cancel(cancelled));
+        EXPECT_FALSE(wheel->Cancel(cancelled));
+
+        TimingWheel::Clock::time_point started_at = TimingWheel::Clock::now();
+        // Returns on its own since the wheel stops ticking once it is empty
+        io_service.run();
+        EXPECT_EQ(fired, std::vector<std::string>({ "early", "late" }));
+        EXPECT_GE(TimingWheel::Clock::now() - started_at, std::chrono::milliseconds(60));
+        EXPECT_EQ(wheel->size(), 0u);
+    }
+
+    TEST(TimingWheelTest, NeverFiresBeforeTheDelayHasPassed) {
+        boost::asio::io_service io_service;
+        TimingWheel::pointer wheel = TimingWheel::Create(io_service, std::chrono::milliseconds(20));
+        wheel->Schedule(std::chrono::milliseconds(100), []() { });
+
+        // Most of the current tick is gone by the time the second callback is scheduled
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(15));
+        TimingWheel::Clock::time_point scheduled_at = TimingWheel::Clock::now();
+        TimingWheel::Clock::time_point fired_at;
+        wheel->Schedule(std::chrono::milliseconds(20), [&fired_at]() { fired_at = TimingWheel::Clock::now(); });
+        io_service.run();
+        EXPECT_GE(fired_at - scheduled_at, std::chrono::milliseconds(20));
+    }
+
+    TEST(TCPStreamTest, PipelinesRequestsFromACoroutine) {
+        boost::asio::io_service io_service;
+        boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 1242));
+
+        // Echoes every byte until the client hangs up
+        boost::asio::spawn(io_service, [&io_service, &acceptor](boost::asio::yield_context yield) {
+            boost::asio::ip::tcp::socket socket(io_service);
+            acceptor.async_accept(socket, yield);
+            TCPStream stream(io_service, std::move(socket));
+            while (true) {
+                boost::system::error_code ec;
+                boost::string_ref bytes = stream.Read(yield[ec]);
+                if (ec) {
+                    EXPECT_EQ(ec, boost::asio::error::eof);
+                    return;
+                }
+                stream.WriteAll(boost::asio::buffer(bytes.data(), bytes.size()), yield);
+                stream.receive_buffer().Consume(bytes.size());
+            }
+        });
+
+        std::string responses;
+        boost::asio::spawn(io_service, [&io_service, &responses](boost::asio::yield_context yield) {
+            TCPStream stream(io_service);
+            stream.Connect("127.0.0.1", "1242", yield);
+
+            // Every request goes out before the first response is read
+            std::vector<std::string> requests = { "first\n", "second\n", "third\n" };
+            std::vector<boost::asio::const_buffer> buffers;
+            for (const std::string& request : requests) {
+                buffers.push_back(boost::asio::buffer(request));
+            }
+            size_t expected = stream.WriteAll(buffers, yield);
+            while (responses.size() < expected) {
+                boost::string_ref bytes = stream.Read(yield);
+                responses.append(bytes.data(), bytes.size());
+                stream.receive_buffer().Consume(bytes.size());
+            }
+            stream.Close();
+        });
+
+        io_service.run();
+        EXPECT_EQ(responses, "first\nsecond\nthird\n");
+    }
+
+    TEST(TCPStreamTest, ReportsErrorsThroughTheYieldContext) {
+        boost::asio::io_service io_service;
+        boost::system::error_code connect_ec;
+        bool has_thrown = false;
+        boost::asio::spawn(io_service, [&](boost::asio::yield_context yield) {
+            TCPStream stream(io_service);
+            // Nothing listens on this port
+            stream.Connect("127.0.0.1", "1238", yield[connect_ec]);
+            try {
+                stream.Connect("127.0.0.1", "1238", yield);
+            } catch (const boost::system::system_error&) {
+                has_thrown = true;
+            }
+        });
+        io_service.run();
+        EXPECT_EQ(connect_ec, boost::asio::error::connection_refused);
+        EXPECT_TRUE(has_thrown);
+    }
+
+    TEST(UDPSocketTest, EchoesABurstOfDatagrams) {
+        using boost::asio::ip::udp;
+        boost::asio::io_service io_service;
+
+        // Replies to every datagram, the sender being its own endpoint
+        UDPSocket* p_server = nullptr;
+        UDPSocket server(io_service, [&p_server](const boost::system::error_code& ec, boost::string_ref datagram, const udp::endpoint& sender) {
+            ASSERT_FALSE(ec);
+            UDPEndpoint(*p_server, sender).Send(datagram.to_string());
+        });
+        p_server = &server;
+        server.set_receive_buffer_size(256 * 1024);
+        server.Open(udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 1243));
+        server.StartReceive();
+        EXPECT_GE(server.receive_buffer_size(), 64 * 1024u);
+
+        const size_t kDatagrams = 100;
+        std::vector<std::string> echoes;
+        UDPSocket client(io_service, [&](const boost::system::error_code& ec, boost::string_ref datagram, const udp::endpoint&) {
+            ASSERT_FALSE(ec);
+            echoes.push_back(datagram.to_string());
+            if (echoes.size() == kDatagrams) {
+                client.Close();
+                server.Close();
+            }
+        });
+        client.set_receive_buffer_size(256 * 1024);
+        client.Open(udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+        client.StartReceive();
+
+        // Queued in the same turn, so they go out in batches
+        size_t sent = 0;
+        UDPEndpoint peer(client, server.local_endpoint());
+        for (size_t i = 0; i < kDatagrams; ++i) {
+            peer.Send("position " + std::to_string(i), [&sent](const boost::system::error_code& ec, size_t) {
+                EXPECT_FALSE(ec);
+                ++sent;
+            });
+        }
+        EXPECT_EQ(client.send_queue_size(), kDatagrams);
+
+        io_service.run();
+        EXPECT_EQ(sent, kDatagrams);
+        ASSERT_EQ(echoes.size(), kDatagrams);
+        EXPECT_EQ(echoes.front(), "position 0");
+        EXPECT_EQ(echoes.back(), "position 99");
+        EXPECT_EQ(client.metrics().writes(), kDatagrams);
+        EXPECT_EQ(server.metrics().reads(), kDatagrams);
+        EXPECT_EQ(server.metrics().writes(), kDatagrams);
+    }
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    class LocalSocketTest : public ::testing::Test {
+    protected:
+        LocalSocketTest() :
+            endpoint_(LocalEndpoint("phyre_networking_tests.sock")),
+            server_(io_service_, endpoint_),
+            p_socket_(nullptr) { }
+
+        virtual ~LocalSocketTest() {
+            std::remove(LocalPath(endpoint_).c_str());
+        }
+
+        // Connects a socket which collects whatever the server sends back
+        void Connect(TCPSocket& socket) {
+            p_socket_ = &socket;
+            socket.Connect(endpoint_);
+        }
+
+        void OnRead(const boost::system::error_code& ec, size_t expected) {
+            ASSERT_FALSE(ec);
+            ReceiveBuffer& receive_buffer = p_socket_->receive_buffer();
+            received_.append(receive_buffer.data().data(), receive_buffer.size());
+            receive_buffer.Consume(receive_buffer.size());
+            if (received_.size() >= expected) {
+                p_socket_->Close();
+                io_service_.stop();
+            }
+        }
+
+        boost::asio::io_service io_service_;
+        StreamEndpoint endpoint_;
+        TCPServer server_;
+        TCPSocket* p_socket_;
+        std::string received_;
+    };
+
+    TEST_F(LocalSocketTest, ServesClientsOverUnixDomainSockets) {
+        EXPECT_TRUE(IsLocal(server_.local_endpoint()));
+        server_.set_on_read_callback([](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            connection->Write(bytes.to_string());
+            return bytes.size();
+        });
+        server_.StartAccept();
+
+        const std::string message = "over AF_UNIX";
+        TCPSocket socket(io_service_,
+                         [this, &message](const boost::system::error_code& ec) {
+                             ASSERT_FALSE(ec);
+                             p_socket_->Write(message);
+                         },
+                         [this, &message](const boost::system::error_code& ec, size_t) { OnRead(ec, message.size()); });
+        Connect(socket);
+        io_service_.run();
+        EXPECT_EQ(received_, message);
+    }
+
+    TEST_F(LocalSocketTest, OnlyReplacesSocketFilesNobodyListensOn) {
+        // The path of a live server is not taken over
+        EXPECT_THROW(TCPServer(io_service_, endpoint_), boost::system::system_error);
+        EXPECT_TRUE(IsLocal(server_.local_endpoint()));
+
+        // One left behind by a server that is gone is
+        StreamEndpoint stale_endpoint = LocalEndpoint("phyre_networking_tests_stale.sock");
+        { TCPServer stale_server(io_service_, stale_endpoint); }
+        EXPECT_NO_THROW(TCPServer(io_service_, stale_endpoint));
+        std::remove(LocalPath(stale_endpoint).c_str());
+
+        // Anything else at the path is left alone
+        const std::string file_path = "phyre_networking_tests.txt";
+        std::ofstream(file_path) << "not a socket";
+        EXPECT_THROW(TCPServer(io_service_, LocalEndpoint(file_path)), boost::system::system_error);
+        std::ifstream file(file_path);
+        std::string contents;
+        std::getline(file, contents);
+        EXPECT_EQ(contents, "not a socket");
+        std::remove(file_path.c_str());
+    }
+
+#if defined(PHYRE_HAS_FILE_DESCRIPTOR_PASSING)
+    TEST_F(LocalSocketTest, PassesFileDescriptorsAlongWithTheData) {
+        // The server reads what the client left in the pipe it was handed
+        std::string through_pipe;
+        server_.set_file_descriptor_passing(true);
+        server_.set_on_read_callback([&through_pipe](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            for (int file_descriptor : connection->TakeFileDescriptors()) {
+                char buffer[64];
+                ssize_t bytes_read = ::read(file_descriptor, buffer, sizeof(buffer));
+                if (bytes_read > 0) {
+                    through_pipe.append(buffer, static_cast<size_t>(bytes_read));
+                }
+                ::close(file_descriptor);
+            }
+            connection->Write(bytes.to_string());
+            return bytes.size();
+        });
+        server_.StartAccept();
+
+        int pipe_ends[2];
+        ASSERT_EQ(::pipe(pipe_ends), 0);
+        ASSERT_EQ(::write(pipe_ends[1], "through the pipe", 16), 16);
+
+        TCPSocket socket(io_service_,
+                         [this, &pipe_ends](const boost::system::error_code& ec) {
+                             ASSERT_FALSE(ec);
+                             p_socket_->Write("plain ");
+                             p_socket_->WriteFileDescriptors("pipe", { pipe_ends[0] });
+                         },
+                         [this](const boost::system::error_code& ec, size_t) { OnRead(ec, 10); });
+        Connect(socket);
+        io_service_.run();
+        ::close(pipe_ends[0]);
+        ::close(pipe_ends[1]);
+
+        EXPECT_EQ(received_, "plain pipe");
+        EXPECT_EQ(through_pipe, "through the pipe");
+    }
+#endif
+#endif
+
+    TEST(ReconnectBackoffTest, DelaysGrowUpToTheCapWithJitter) {
+        using std::chrono::milliseconds;
+        ReconnectPolicy policy(milliseconds(100), milliseconds(1000), 2.0, 6);
+        ReconnectBackoff backoff(policy, 42);
+        std::vector<milliseconds> ceilings = { milliseconds(100), milliseconds(200), milliseconds(400),
+                                               milliseconds(800), milliseconds(1000), milliseconds(1000) };
+        for (milliseconds ceiling : ceilings) {
+            EXPECT_FALSE(backoff.is_exhausted());
+            EXPECT_EQ(backoff.ceiling(), ceiling);
+            milliseconds delay = backoff.NextDelay();
+            EXPECT_GE(delay.count(), 0);
+            EXPECT_LE(delay, ceiling);
+        }
+        EXPECT_TRUE(backoff.is_exhausted());
+        backoff.Reset();
+        EXPECT_EQ(backoff.ceiling(), milliseconds(100));
+
+        // Clients dropped at the same time must not come back in lockstep
+        ReconnectBackoff first(policy, 1);
+        ReconnectBackoff second(policy, 2);
+        size_t same = 0;
+        for (size_t i = 0; i < ceilings.size(); ++i) {
+            same += first.NextDelay() == second.NextDelay() ? 1 : 0;
+        }
+        EXPECT_LT(same, ceilings.size());
+    }
+
+    TEST(TCPClientReconnectTest, ResumesTheSessionOnceTheServerIsBack) {
+        boost::asio::io_service io_service;
+        TCPServerConnection::OnReadCallback echo = [](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            connection->Write(bytes.to_string());
+            return bytes.size();
+        };
+        TCPServer first_server(io_service, 1244);
+        first_server.set_on_read_callback(echo);
+        first_server.StartAccept();
+        std::unique_ptr<TCPServer> ptr_second_server;
+
+        TCPClientReconnect client(io_service, std::string("firstlogin held back").size());
+        client.set_reconnect_policy(ReconnectPolicy(std::chrono::milliseconds(10), std::chrono::milliseconds(50), 2.0, 0, 16));
+        client.on_read_ = [&]() {
+            if (client.received_ == "first") {
+                first_server.Stop();
+            }
+        };
+
+        // Writes while the server is down are held back within the budget, then it restarts
+        boost::system::error_code overflow_error;
+        client.on_error_ = [&]() {
+            EXPECT_TRUE(client.is_reconnecting());
+            client.Write(std::string("held back"));
+            client.Write(std::string(10, 'x'), [&overflow_error](const boost::system::error_code& ec, size_t) { overflow_error = ec; });
+            EXPECT_EQ(client.unsent_bytes(), 9u);
+            if (!ptr_second_server) {
+                ptr_second_server = std::make_unique<TCPServer>(io_service, 1244);
+                ptr_second_server->set_on_read_callback(echo);
+                ptr_second_server->StartAccept();
+            }
+        };
+
+        client.Connect("127.0.0.1", "1244");
+        io_service.run();
+        EXPECT_EQ(client.received_, "firstlogin held back");
+        EXPECT_EQ(client.reconnects(), 1u);
+        EXPECT_EQ(client.errors_.size(), 1u);
+        EXPECT_EQ(overflow_error, boost::asio::error::no_buffer_space);
+        EXPECT_EQ(client.unsent_bytes(), 0u);
+    }
+
+    TEST(BroadcastTest, FansOutOneSharedBufferAndReportsEveryRecipient) {
+        using boost::asio::ip::tcp;
+        boost::asio::io_service io_service;
+        TCPServer server(io_service, 1245);
+
+        // A single write fills the queue, so the second broadcast is turned down while it is in flight
+        server.set_write_limits(WriteLimits(1, 0, WriteLimits::kDrop));
+
+        auto ptr_payload = std::make_shared<const std::string>("presence: online");
+        std::vector<boost::system::error_code> outcomes;
+        std::vector<std::unique_ptr<TCPSocket>> clients;
+        std::vector<std::string> received(3);
+        std::set<TCPServerConnection::pointer> muted;
+        size_t joined = 0;
+
+        auto stop_when_done = [&]() {
+            if (outcomes.size() == 4 && received[0].size() + received[1].size() == 2 * ptr_payload->size()) {
+                io_service.stop();
+            }
+        };
+        server.set_on_read_callback([&](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            if (bytes == "mute") {
+                muted.insert(connection);
+            }
+            if (++joined == clients.size()) {
+                auto on_delivered = [&](const TCPServerConnection::pointer& recipient, const boost::system::error_code& ec) {
+                    EXPECT_EQ(muted.count(recipient), 0u);
+                    outcomes.push_back(ec);
+                    stop_when_done();
+                };
+                auto filter = [&muted](const TCPServerConnection::pointer& candidate) { return muted.count(candidate) == 0; };
+                EXPECT_EQ(server.Broadcast(ptr_payload, on_delivered, filter), 2u);
+                EXPECT_EQ(server.Broadcast(std::make_shared<const std::string>("dropped"), on_delivered, filter), 2u);
+            }
+            return bytes.size();
+        });
+        server.StartAccept();
+
+        std::vector<tcp::endpoint> endpoints = { tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 1245) };
+        for (size_t i = 0; i < received.size(); ++i) {
+            std::string greeting = i == 2 ? "mute" : "join";
+            clients.push_back(std::make_unique<TCPSocket>(io_service,
+                [&clients, i, greeting](const boost::system::error_code& ec) {
+                    ASSERT_FALSE(ec);
+                    clients[i]->Write(greeting);
+                },
+                [&clients, &received, &stop_when_done, i](const boost::system::error_code& ec, size_t) {
+                    ASSERT_FALSE(ec);
+                    ReceiveBuffer& receive_buffer = clients[i]->receive_buffer();
+                    received[i].append(receive_buffer.data().data(), receive_buffer.size());
+                    receive_buffer.Consume(receive_buffer.size());
+                    stop_when_done();
+                }));
+            clients.back()->Connect(endpoints);
+        }
+
+        io_service.run();
+        EXPECT_EQ(received[0], *ptr_payload);
+        EXPECT_EQ(received[1], *ptr_payload);
+        EXPECT_TRUE(received[2].empty());
+        ASSERT_EQ(outcomes.size(), 4u);
+        EXPECT_EQ(std::count(outcomes.begin(), outcomes.end(), boost::system::error_code()), 2);
+        EXPECT_EQ(std::count(outcomes.begin(), outcomes.end(), boost::asio::error::no_buffer_space), 2);
+
+        // Every queue let go of the payload once it was written
+        EXPECT_EQ(ptr_payload.use_count(), 1);
+        for (std::unique_ptr<TCPSocket>& ptr_client : clients) {
+            ptr_client->Close();
+        }
+    }
+
+    TEST(TokenBucketTest, GoesIntoDebtAndRefillsSteadily) {
+        using std::chrono::milliseconds;
+        TokenBucket bucket(1000, 500);
+        TokenBucket::Clock::time_point now = TokenBucket::Clock::now();
+        EXPECT_EQ(bucket.Take(500, now), TokenBucket::Clock::duration::zero());
+
+        // Reads are charged after the fact, the debt says how long to back off for
+        EXPECT_EQ(std::chrono::duration_cast<milliseconds>(bucket.Take(250, now)), milliseconds(250));
+        EXPECT_EQ(bucket.Take(0, now + milliseconds(250)), TokenBucket::Clock::duration::zero());
+
+        // The refill stops at the burst size
+        EXPECT_DOUBLE_EQ(bucket.available(now + milliseconds(10000)), 500);
+
+        TokenBucket unlimited(0, 0);
+        EXPECT_FALSE(unlimited.is_limited());
+        EXPECT_EQ(unlimited.Take(1000000, now), TokenBucket::Clock::duration::zero());
+
+        // Every read counts as a message, whichever bucket is deeper in debt decides
+        ReadRateLimiter limiter(ReadRateLimits(0, 0, 10, 1));
+        EXPECT_EQ(limiter.Charge(1, now), TokenBucket::Clock::duration::zero());
+        EXPECT_EQ(std::chrono::duration_cast<milliseconds>(limiter.Charge(1, now)), milliseconds(100));
+    }
+
+    TEST(ReadRateLimitTest, PausesReadsOfEveryConnectionInsteadOfDroppingBytes) {
+        using boost::asio::ip::tcp;
+        boost::asio::io_service io_service;
+        TCPServer server(io_service, 1246);
+
+        // Small reads, so that the shared budget of 512 bytes and 4000 bytes per second is charged many times
+        server.set_receive_buffer_capacity(512, 512);
+        server.set_global_read_rate_limits(ReadRateLimits(4000, 512));
+
+        const std::string payload(1500, 'x');
+        std::string received;
+        server.set_on_read_callback([&](const TCPServerConnection::pointer&, boost::string_ref bytes) {
+            received.append(bytes.data(), bytes.size());
+            if (received.size() == 2 * payload.size()) {
+                io_service.stop();
+            }
+            return bytes.size();
+        });
+        server.StartAccept();
+
+        std::vector<tcp::endpoint> endpoints = { tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 1246) };
+        std::vector<std::unique_ptr<TCPSocket>> clients;
+        for (size_t i = 0; i < 2; ++i) {
+            clients.push_back(std::make_unique<TCPSocket>(io_service,
+                [&clients, &payload, i](const boost::system::error_code& ec) {
+                    ASSERT_FALSE(ec);
+                    clients[i]->Write(payload);
+                },
+                [](const boost::system::error_code&, size_t) { }));
+            clients.back()->Connect(endpoints);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        io_service.run();
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+
+        // Whatever was sent got through, just no faster than the budget refills. Beyond the burst,
+        // only the last read of each connection may have landed without waiting out a debt.
+        EXPECT_EQ(received, std::string(2 * payload.size(), 'x'));
+        EXPECT_GE(elapsed, std::chrono::milliseconds((2 * 1500 - 512 - 2 * 512) * 1000 / 4000));
+        EXPECT_EQ(server.metrics().bytes_received(), 2 * payload.size());
+        for (std::unique_ptr<TCPSocket>& ptr_client : clients) {
+            ptr_client->Close();
+        }
+    }
+
+
+    TEST(ResourceServerTest, ParsesRangesLikeHTTP) {
+        FileRange range;
+        ASSERT_TRUE(ResourceServer::ParseRange("4-11", 996, range));
+        EXPECT_EQ(range.offset, 4u);
+        EXPECT_EQ(range.length, 8u);
+        ASSERT_TRUE(ResourceServer::ParseRange("990-", 996, range));
+        EXPECT_EQ(range.offset, 990u);
+        EXPECT_EQ(range.length, 6u);
+        ASSERT_TRUE(ResourceServer::ParseRange("-10", 996, range));
+        EXPECT_EQ(range.offset, 986u);
+        EXPECT_EQ(range.length, 10u);
+
+        // The end and the suffix are cut down to the resource
+        ASSERT_TRUE(ResourceServer::ParseRange("990-5000", 996, range));
+        EXPECT_EQ(range.length, 6u);
+        ASSERT_TRUE(ResourceServer::ParseRange("-5000", 996, range));
+        EXPECT_EQ(range.offset, 0u);
+        EXPECT_EQ(range.length, 996u);
+
+        EXPECT_FALSE(ResourceServer::ParseRange("996-", 996, range));
+        EXPECT_FALSE(ResourceServer::ParseRange("11-4", 996, range));
+        EXPECT_FALSE(ResourceServer::ParseRange("-0", 996, range));
+        EXPECT_FALSE(ResourceServer::ParseRange("4+11", 996, range));
+        EXPECT_FALSE(ResourceServer::ParseRange("-x", 996, range));
+        EXPECT_FALSE(ResourceServer::ParseRange("0-", 0, range));
+    }
+
+    TEST(ResourceServerTest, StreamsResourcesAndRangesInTheOrderTheyWereRequested) {
+        using boost::asio::ip::tcp;
+        Phyre::Configuration::Provider::Pointer ptr_provider = Phyre::Utils::TestLoader::GetInstance()->Provide();
+        const std::string application("ConfigurationLoaderTest");
+        std::string vertices = ptr_provider->GetContents(application, "vertices.spv");
+        std::string example = ptr_provider->GetContents(application, "Example.txt");
+        ASSERT_EQ(vertices.size(), 996u);
+
+        boost::asio::io_service io_service;
+        ResourceServer server(io_service, 1249, ptr_provider);
+        server.StartAccept();
+
+        // Pipelined, including a file which exists but is not a listed resource
+        const std::string requests =
+            "GET ConfigurationLoaderTest vertices.spv\r\n"
+            "GET ConfigurationLoaderTest vertices.spv 4-11\r\n"
+            "GET ConfigurationLoaderTest Example.txt -5\r\n"
+            "GET ConfigurationLoaderTest Example.txt 100-\r\n"
+            "GET ConfigurationLoaderTest configuration_tests.h\r\n"
+            "FETCH everything\r\n";
+        const std::string expected =
+            "OK 0 996 996\r\n" + vertices +
+            "OK 4 8 996\r\n" + vertices.substr(4, 8) +
+            "OK 6 5 11\r\n" + example.substr(6) +
+            "ERROR range-not-satisfiable\r\n"
+            "ERROR not-found\r\n"
+            "ERROR bad-request\r\n";
+
+        std::string received;
+        std::unique_ptr<TCPSocket> ptr_client;
+        ptr_client = std::make_unique<TCPSocket>(io_service,
+            [&ptr_client, &requests](const boost::system::error_code& ec) {
+                ASSERT_FALSE(ec);
+                ptr_client->Write(requests);
+            },
+            [&](const boost::system::error_code& ec, size_t) {
+                ASSERT_FALSE(ec);
+                ReceiveBuffer& receive_buffer = ptr_client->receive_buffer();
+                received.append(receive_buffer.data().data(), receive_buffer.size());
+                receive_buffer.Consume(receive_buffer.size());
+                if (received.size() >= expected.size()) {
+                    io_service.stop();
+                }
+            });
+        std::vector<tcp::endpoint> endpoints = { tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 1249) };
+        ptr_client->Connect(endpoints);
+
+        io_service.run();
+        EXPECT_EQ(received, expected);
+
+        // The headers went out as buffers, the resource bytes straight from the files
+        EXPECT_EQ(server.server().metrics().bytes_sent(), expected.size());
+        ptr_client->Close();
+    }
+
+    TEST(ImpairedLinkTest, ReplaysTheSameScheduleForTheSameSeed) {
+        using std::chrono::milliseconds;
+        Impairments impairments;
+        impairments.latency = milliseconds(20);
+        impairments.jitter = milliseconds(10);
+        impairments.bytes_per_second = 1000;
+        impairments.max_segment_size = 100;
+
+        ImpairedLink::Clock::time_point now = ImpairedLink::Clock::now();
+        const std::string data(1000, 'x');
+        ImpairedLink first(impairments, 7);
+        ImpairedLink second(impairments, 7);
+        std::vector<ImpairedLink::Segment> schedule = first.Transmit(data, now);
+        std::vector<ImpairedLink::Segment> replay = second.Transmit(data, now);
+        ASSERT_EQ(schedule.size(), replay.size());
+
+        size_t total = 0;
+        for (size_t i = 0; i < schedule.size(); ++i) {
+            EXPECT_EQ(schedule[i].data, replay[i].data);
+            EXPECT_EQ(schedule[i].deliver_at, replay[i].deliver_at);
+            EXPECT_GE(schedule[i].data.size(), 1u);
+            EXPECT_LE(schedule[i].data.size(), 100u);
+            EXPECT_FALSE(schedule[i].is_reset);
+            if (i > 0) {
+                EXPECT_GE(schedule[i].deliver_at, schedule[i - 1].deliver_at);
+            }
+            total += schedule[i].data.size();
+        }
+        EXPECT_EQ(total, data.size());
+
+        // A kilobyte takes a second at a kilobyte per second, plus the latency of the last segment
+        EXPECT_GE(schedule.back().deliver_at - now, milliseconds(1020));
+        EXPECT_LE(schedule.back().deliver_at - now, milliseconds(1031));
+
+        // Nothing gets across a link which was reset
+        impairments.reset_probability = 1;
+        ImpairedLink broken(impairments, 7);
+        std::vector<ImpairedLink::Segment> reset = broken.Transmit(data, now);
+        ASSERT_EQ(reset.size(), 1u);
+        EXPECT_TRUE(reset[0].is_reset);
+        EXPECT_TRUE(broken.is_reset());
+        EXPECT_TRUE(broken.Transmit(data, now).empty());
+    }
+
+    class ImpairmentProxyTest : public ::testing::Test {
+    protected:
+        ImpairmentProxyTest() :
+            echo_server_(io_service_, 1248),
+            proxy_(io_service_, 1247, "127.0.0.1", "1248", 42) {
+            echo_server_.set_on_read_callback([](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+                connection->Write(bytes.to_string());
+                return bytes.size();
+            });
+            echo_server_.StartAccept();
+        }
+
+        void Connect(TCPSocket::OnConnectCallback on_connect, TCPSocket::OnReadCallback on_read) {
+            ptr_client_ = std::make_unique<TCPSocket>(io_service_, on_connect, on_read);
+            std::vector<boost::asio::ip::tcp::endpoint> endpoints = {
+                boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 1247)
+            };
+            ptr_client_->Connect(endpoints);
+        }
+
+        boost::asio::io_service io_service_;
+        TCPServer echo_server_;
+        ImpairmentProxy proxy_;
+        std::unique_ptr<TCPSocket> ptr_client_;
+    };
+
+    TEST_F(ImpairmentProxyTest, DelaysAndSplitsTrafficWithoutLosingAByte) {
+        Impairments impairments;
+        impairments.latency = std::chrono::milliseconds(25);
+        impairments.jitter = std::chrono::milliseconds(5);
+        impairments.max_segment_size = 512;
+        proxy_.set_impairments(impairments);
+        proxy_.StartAccept();
+
+        std::string payload;
+        for (size_t i = 0; i < 4000; ++i) {
+            payload.push_back(static_cast<char>('a' + i % 26));
+        }
+        std::string echoed;
+        Connect([this, &payload](const boost::system::error_code& ec) {
+                    ASSERT_FALSE(ec);
+                    ptr_client_->Write(payload);
+                },
+                [this, &payload, &echoed](const boost::system::error_code& ec, size_t) {
+                    ASSERT_FALSE(ec);
+                    ReceiveBuffer& receive_buffer = ptr_client_->receive_buffer();
+                    echoed.append(receive_buffer.data().data(), receive_buffer.size());
+                    receive_buffer.Consume(receive_buffer.size());
+                    if (echoed.size() == payload.size()) {
+                        io_service_.stop();
+                    }
+                });
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        io_service_.run();
+
+        // There and back again, each way at least the latency
+        EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+        EXPECT_EQ(echoed, payload);
+        EXPECT_EQ(proxy_.connections(), 1u);
+        EXPECT_EQ(proxy_.resets(), 0u);
+        ptr_client_->Close();
+    }
+
+    TEST_F(ImpairmentProxyTest, ResetsTheConnectionOfTheClient) {
+        Impairments impairments;
+        impairments.reset_probability = 1;
+        proxy_.set_client_to_server(impairments);
+        proxy_.StartAccept();
+
+        boost::system::error_code read_error;
+        Connect([this](const boost::system::error_code& ec) {
+                    ASSERT_FALSE(ec);
+                    ptr_client_->Write("doomed");
+                },
+                [this, &read_error](const boost::system::error_code& ec, size_t) {
+                    read_error = ec;
+                    io_service_.stop();
+                });
+
+        io_service_.run();
+        EXPECT_EQ(read_error, boost::asio::error::connection_reset);
+        EXPECT_EQ(proxy_.resets(), 1u);
+        EXPECT_EQ(echo_server_.metrics().bytes_received(), 0u);
+        ptr_client_->Close();
+    }
+
+    TEST(HappyEyeballsConnectorTest, InterleavesAddressFamiliesStartingWithIPv6) {
+        using boost::asio::ip::tcp;
+        using boost::asio::ip::address;
+        tcp::endpoint v4a(address::from_string("10.0.0.1"), 80);
+        tcp::endpoint v4b(address::from_string("10.0.0.2"), 80);
+        tcp::endpoint v6a(address::from_string("::1"), 80);
+        std::vector<tcp::endpoint> interleaved = HappyEyeballsConnector::InterleaveAddressFamilies({ v4a, v4b, v6a });
+        EXPECT_EQ(interleaved, std::vector<tcp::endpoint>({ v6a, v4a, v4b }));
+    }
+
+    class DnsCacheTest : public ::testing::Test {
+    protected:
+        DnsCacheTest():
+            ptr_dns_cache_(std::make_shared<DnsCache>()),
+            endpoint_(boost::asio::ip::address::from_string("10.0.0.1"), 5222),
+            queries_(0),
+            results_(0) { }
+
+        // A stub resolver which answers right away
+        DnsCache::ResolveFunction ImmediateResolver() {
+            return [this](const std::string&, const std::string&, DnsCache::OnResolvedCallback callback) {
+                ++queries_;
+                callback(boost::system::error_code(), DnsCache::Endpoints({ endpoint_ }));
+            };
+        }
+
+        void Resolve(const DnsCache::ResolveFunction& resolve_function) {
+            ptr_dns_cache_->Resolve(io_service_, "xmpp.example.com", "5222", resolve_function,
+                                    [this](const boost::system::error_code& ec, const DnsCache::Endpoints& endpoints) {
+                                        EXPECT_FALSE(ec);
+                                        EXPECT_EQ(endpoints, DnsCache::Endpoints({ endpoint_ }));
+                                        ++results_;
+                                    });
+        }
+
+        boost::asio::io_service io_service_;
+        DnsCache::Pointer ptr_dns_cache_;
+        boost::asio::ip::tcp::endpoint endpoint_;
+        size_t queries_;
+        size_t results_;
+    };
+
+    TEST_F(DnsCacheTest, CoalescesConcurrentLookups) {
+        DnsCache::OnResolvedCallback pending_query;
+        DnsCache::ResolveFunction deferred_resolver = [&](const std::string&, const std::string&, DnsCache::OnResolvedCallback callback) {
+            ++queries_;
+            pending_query = callback;
+        };
+
+        Resolve(deferred_resolver);
+        Resolve(deferred_resolver);
+        Resolve(deferred_resolver);
+        EXPECT_EQ(queries_, 1u);
+
+        pending_query(boost::system::error_code(), DnsCache::Endpoints({ endpoint_ }));
+        io_service_.run();
+        EXPECT_EQ(results_, 3u);
+    }
+
+    TEST_F(DnsCacheTest, ServesCachedEntriesUntilTheyExpire) {
+        Resolve(ImmediateResolver());
+        Resolve(ImmediateResolver());
+        EXPECT_EQ(queries_, 1u);
+
+        ptr_dns_cache_->set_ttl(std::chrono::milliseconds(0));
+        ptr_dns_cache_->Clear();
+        Resolve(ImmediateResolver());
+        Resolve(ImmediateResolver());
+        io_service_.run();
+        EXPECT_EQ(queries_, 3u);
+        EXPECT_EQ(results_, 4u);
+    }
+
+    TEST_F(DnsCacheTest, ServesStaleEntriesWhileRefreshing) {
+        ptr_dns_cache_->set_ttl(std::chrono::milliseconds(0));
+        ptr_dns_cache_->set_serve_stale(true);
+        Resolve(ImmediateResolver());
+
+        // The entry has expired, so this is answered from the stale entry and refreshed behind the scenes
+        DnsCache::OnResolvedCallback pending_refresh;
+        Resolve([&](const std::string&, const std::string&, DnsCache::OnResolvedCallback callback) {
+            ++queries_;
+            pending_refresh = callback;
+        });
+        io_service_.run();
+        EXPECT_EQ(results_, 2u);
+        EXPECT_EQ(queries_, 2u);
+        ASSERT_TRUE(static_cast<bool>(pending_refresh));
+        pending_refresh(boost::asio::error::host_not_found, DnsCache::Endpoints());
+    }
+
+    TEST_F(DnsCacheTest, QueriesAgainForTheOthersWhenTheFirstLookupIsCancelled) {
+        std::vector<DnsCache::OnResolvedCallback> pending_queries;
+        DnsCache::ResolveFunction deferred_resolver = [&](const std::string&, const std::string&, DnsCache::OnResolvedCallback callback) {
+            ++queries_;
+            pending_queries.push_back(callback);
+        };
+
+        bool is_first_cancelled = false;
+        ptr_dns_cache_->Resolve(io_service_, "xmpp.example.com", "5222", deferred_resolver,
+                                [&is_first_cancelled](const boost::system::error_code& ec, const DnsCache::Endpoints&) {
+                                    is_first_cancelled = ec == boost::asio::error::operation_aborted;
+                                });
+        Resolve(deferred_resolver);
+        Resolve(deferred_resolver);
+        ASSERT_EQ(pending_queries.size(), 1u);
+
+        pending_queries[0](boost::asio::error::operation_aborted, DnsCache::Endpoints());
+        ASSERT_EQ(pending_queries.size(), 2u);
+        pending_queries[1](boost::system::error_code(), DnsCache::Endpoints({ endpoint_ }));
+        io_service_.run();
+        EXPECT_TRUE(is_first_cancelled);
+        EXPECT_EQ(results_, 2u);
+    }
+
+    TEST_F(DnsCacheTest, EvictsTheLeastRecentlyUsedEntries) {
+        auto resolve = [this](const std::string& host) {
+            ptr_dns_cache_->Resolve(io_service_, host, "5222", ImmediateResolver(),
+                                    [](const boost::system::error_code&, const DnsCache::Endpoints&) { });
+        };
+        ptr_dns_cache_->set_max_entries(2);
+        resolve("a.example.com");
+        resolve("b.example.com");
+        // Using a again leaves b as the least recently used one, which c takes the place of
+        resolve("a.example.com");
+        resolve("c.example.com");
+        EXPECT_EQ(ptr_dns_cache_->size(), 2u);
+        EXPECT_EQ(queries_, 3u);
+
+        resolve("a.example.com");
+        resolve("b.example.com");
+        io_service_.run();
+        EXPECT_EQ(ptr_dns_cache_->size(), 2u);
+        EXPECT_EQ(queries_, 4u);
+    }
+
+    // A bare listener which accepts and holds on to connections without ever writing to them
+    class TCPConnectionPoolTest : public ::testing::Test {
+    protected:
+        TCPConnectionPoolTest() :
+            host_("localhost"),
+            port_or_service_("1239"),
+            acceptor_(io_service_, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 1239)) {
+            Accept();
+        }
+
+        void Accept() {
+            auto peer = std::make_shared<boost::asio::ip::tcp::socket>(io_service_);
+            acceptor_.async_accept(*peer, [this, peer](const boost::system::error_code& ec) {
+                if (!ec) {
+                    peers_.push_back(peer);
+                    Accept();
+                }
+            });
+        }
+
+        void Stop(const TCPConnectionPool::pointer& pool) {
+            pool->Shutdown();
+            acceptor_.close();
+        }
+
+        boost::asio::io_service io_service_;
+        std::string host_;
+        std::string port_or_service_;
+        boost::asio::ip::tcp::acceptor acceptor_;
+        std::vector<std::shared_ptr<boost::asio::ip::tcp::socket>> peers_;
+    };
+
+    TEST_F(TCPConnectionPoolTest, ReusesReleasedConnections) {
+        TCPConnectionPool::pointer pool = TCPConnectionPool::Create(io_service_);
+        TCPConnectionPool::SocketPointer first;
+        TCPConnectionPool::SocketPointer second;
+        pool->Acquire(host_, port_or_service_, [&](const boost::system::error_code& ec, TCPConnectionPool::SocketPointer socket) {
+            ASSERT_FALSE(ec);
+            first = socket;
+            pool->Release(socket);
+            EXPECT_EQ(pool->idle_count(), 1u);
+            pool->Acquire(host_, port_or_service_, [&](const boost::system::error_code& ec, TCPConnectionPool::SocketPointer socket) {
+                ASSERT_FALSE(ec);
+                second = socket;
+                pool->Release(socket);
+                Stop(pool);
+            });
+        });
+        io_service_.run();
+        EXPECT_EQ(first, second);
+        EXPECT_EQ(peers_.size(), 1u);
+        EXPECT_EQ(pool->total_count(), 0u);
+    }
+
+    TEST_F(TCPConnectionPoolTest, WaitsForAReleaseOnceEveryConnectionIsOut) {
+        TCPConnectionPool::pointer pool = TCPConnectionPool::Create(io_service_, 1, 1);
+        TCPConnectionPool::SocketPointer first;
+        pool->Acquire(host_, port_or_service_, [&](const boost::system::error_code& ec, TCPConnectionPool::SocketPointer socket) {
+            ASSERT_FALSE(ec);
+            first = socket;
+            pool->Acquire(host_, port_or_service_, [&](const boost::system::error_code& ec, TCPConnectionPool::SocketPointer socket) {
+                ASSERT_FALSE(ec);
+                EXPECT_EQ(socket, first);
+                pool->Release(socket);
+                Stop(pool);
+            });
+            EXPECT_EQ(pool->total_count(), 1u);
+            pool->Release(socket);
+        });
+        io_service_.run();
+        EXPECT_EQ(peers_.size(), 1u);
+    }
+
+    TEST_F(TCPConnectionPoolTest, DiscardsConnectionsDroppedWithoutARelease) {
+        TCPConnectionPool::pointer pool = TCPConnectionPool::Create(io_service_, 1, 1);
+        pool->Acquire(host_, port_or_service_, [&](const boost::system::error_code& ec, TCPConnectionPool::SocketPointer) {
+            ASSERT_FALSE(ec);
+            // The only slot is free again once the socket is gone, rather than waiting for a release forever
+            pool->Acquire(host_, port_or_service_, [&](const boost::system::error_code& ec, TCPConnectionPool::SocketPointer socket) {
+                ASSERT_FALSE(ec);
+                EXPECT_EQ(pool->total_count(), 1u);
+                pool->Release(socket);
+                Stop(pool);
+            });
+        });
+        io_service_.run();
+        EXPECT_EQ(peers_.size(), 2u);
+    }
+
+    TEST_F(TCPConnectionPoolTest, EvictsIdleConnectionsClosedByThePeer) {
+        TCPConnectionPool::pointer pool = TCPConnectionPool::Create(io_service_);
+        pool->Acquire(host_, port_or_service_, [&](const boost::system::error_code& ec, TCPConnectionPool::SocketPointer socket) {
+            ASSERT_FALSE(ec);
+            pool->Release(socket);
+            ASSERT_EQ(peers_.size(), 1u);
+            peers_.front()->close();
+        });
+
+        boost::asio::steady_timer timer(io_service_, std::chrono::milliseconds(50));
+        timer.async_wait([&](const boost::system::error_code&) {
+            EXPECT_EQ(pool->idle_count(), 0u);
+            EXPECT_EQ(pool->total_count(), 0u);
+            Stop(pool);
+        });
+        io_service_.run();
+    }
+
+    TEST_F(TCPConnectionPoolTest, ReapsConnectionsWhichSatIdleForTooLong) {
+        TCPConnectionPool::pointer pool = TCPConnectionPool::Create(io_service_, 8, 64, std::chrono::milliseconds(10));
+        pool->Acquire(host_, port_or_service_, [&](const boost::system::error_code& ec, TCPConnectionPool::SocketPointer socket) {
+            ASSERT_FALSE(ec);
+            pool->Release(socket);
+        });
+
+        boost::asio::steady_timer timer(io_service_, std::chrono::milliseconds(100));
+        timer.async_wait([&](const boost::system::error_code&) {
+            EXPECT_EQ(pool->idle_count(), 0u);
+            EXPECT_EQ(pool->total_count(), 0u);
+            Stop(pool);
+        });
+        io_service_.run();
+    }
+
+    class TLSTest : public ::testing::Test {
+    protected:
+        TLSTest() :
+            host_("localhost"),
+            port_or_service_("1240"),
+            server_context_(boost::asio::ssl::context::sslv23_server),
+            client_context_(boost::asio::ssl::context::sslv23_client),
+            tcp_server_(io_service_, boost::lexical_cast<uint16_t>(port_or_service_)),
+            ptr_session_cache_(std::make_shared<TLSSessionCache>()) {
+            UseTestCertificate(server_context_);
+            TrustTestCertificate(client_context_);
+        }
+
+        boost::asio::io_service io_service_;
+        std::string host_;
+        std::string port_or_service_;
+        boost::asio::ssl::context server_context_;
+        boost::asio::ssl::context client_context_;
+        TCPServer tcp_server_;
+        TLSSessionCache::Pointer ptr_session_cache_;
+    };
+
+    TEST_F(TLSTest, CanReadAndWriteOverTLS) {
+        tcp_server_.set_tls_context(&server_context_);
+        tcp_server_.StartAccept();
+
+        TCPClientRead client(io_service_, "Hello!\r\n");
+        client.EnableTLS(client_context_, host_);
+        client.set_tls_session_cache(ptr_session_cache_);
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_TRUE(client.is_tls());
+        EXPECT_FALSE(client.is_tls_session_reused());
+    }
+
+    TEST_F(TLSTest, ResumesSessionsOnReconnect) {
+        tcp_server_.set_tls_context(&server_context_);
+        tcp_server_.StartAccept();
+
+        TCPClientRead first(io_service_, "Hello!\r\n");
+        first.EnableTLS(client_context_, host_);
+        first.set_tls_session_cache(ptr_session_cache_);
+        first.Connect(host_, port_or_service_);
+        io_service_.run();
+        ASSERT_TRUE(first.is_tls());
+        EXPECT_EQ(ptr_session_cache_->size(), 1u);
+        first.Disconnect();
+
+        io_service_.reset();
+        TCPClientRead second(io_service_, "Hello again!\r\n");
+        second.EnableTLS(client_context_, host_);
+        second.set_tls_session_cache(ptr_session_cache_);
+        second.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_TRUE(second.is_tls());
+        EXPECT_TRUE(second.is_tls_session_reused());
+    }
+
+    TEST_F(TLSTest, StoresSessionsInTheCacheOfTheirOwnConnection) {
+        tcp_server_.set_tls_context(&server_context_);
+        tcp_server_.StartAccept();
+
+        // Both connections share a context and shake hands at the same time
+        TLSSessionCache::Pointer ptr_other_session_cache = std::make_shared<TLSSessionCache>();
+        size_t remaining = 2;
+        TCPClientCountdown first(io_service_, remaining);
+        first.EnableTLS(client_context_, host_);
+        first.set_tls_session_cache(ptr_session_cache_);
+        TCPClientCountdown second(io_service_, remaining);
+        second.EnableTLS(client_context_, host_);
+        second.set_tls_session_cache(ptr_other_session_cache);
+        first.Connect(host_, port_or_service_);
+        second.Connect(host_, port_or_service_);
+        io_service_.run();
+        ASSERT_TRUE(first.is_tls());
+        ASSERT_TRUE(second.is_tls());
+        EXPECT_EQ(ptr_session_cache_->size(), 1u);
+        EXPECT_EQ(ptr_other_session_cache->size(), 1u);
+    }
+
+    TEST_F(TLSTest, UpgradesAnEstablishedConnectionWithStartTLS) {
+        boost::asio::ssl::context& server_context = server_context_;
+        tcp_server_.set_on_read_callback([&server_context](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            if (!connection->is_tls()) {
+                EXPECT_EQ(bytes, "STARTTLS\r\n");
+                connection->Write("PROCEED\r\n");
+                connection->StartTLS(server_context);
+            } else {
+                connection->Write(bytes.to_string());
+            }
+            return bytes.size();
+        });
+        tcp_server_.StartAccept();
+
+        TCPClientStartTLS client(io_service_, client_context_);
+        client.set_tls_session_cache(ptr_session_cache_);
+        client.Connect(host_, port_or_service_);
+        io_service_.run();
+        EXPECT_TRUE(client.is_tls());
+        EXPECT_EQ(client.echoed_, "ping");
+    }
+
+}
 }
-}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "connection_deadlines.h"
+
+namespace Phyre {
+namespace Networking {
+
+    ConnectionDeadlines::ConnectionDeadlines() :
+        read_timeout_(0),
+        write_timeout_(0),
+        idle_timeout_(0),
+        is_write_in_flight_(false),
+        is_running_(false),
+        check_id_(0) { }
+
+    ConnectionDeadlines::~ConnectionDeadlines() {
+        Stop();
+    }
+
+    void ConnectionDeadlines::Configure(TimingWheel::pointer ptr_wheel,
+                                        std::chrono::milliseconds read_timeout,
+                                        std::chrono::milliseconds write_timeout,
+                                        std::chrono::milliseconds idle_timeout,
+                                        TimingWheel::Callback on_check) {
+        Stop();
+        ptr_wheel_ = ptr_wheel;
+        read_timeout_ = read_timeout;
+        write_timeout_ = write_timeout;
+        idle_timeout_ = idle_timeout;
+        on_check_ = on_check;
+    }
+
+    void ConnectionDeadlines::Start() {
+        if (!is_enabled()) {
+            return;
+        }
+        Stop();
+        Clock::time_point now = Clock::now();
+        last_read_at_ = now;
+        last_write_at_ = now;
+        is_write_in_flight_ = false;
+        is_running_ = true;
+        ScheduleCheck(now);
+    }
+
+    void ConnectionDeadlines::Stop() {
+        is_running_ = false;
+        if (check_id_ && ptr_wheel_) {
+            ptr_wheel_->Cancel(check_id_);
+        }
+        check_id_ = 0;
+    }
+
+    ConnectionDeadlines::Expiry ConnectionDeadlines::Check() {
+        check_id_ = 0;
+        if (!is_running_) {
+            return kNone;
+        }
+
+        Clock::time_point now = Clock::now();
+        if (read_timeout_.count() && now - last_read_at_ >= read_timeout_) {
+            return kRead;
+        }
+        if (write_timeout_.count() && is_write_in_flight_ && now - write_started_at_ >= write_timeout_) {
+            return kWrite;
+        }
+        if (idle_timeout_.count() && now - std::max(last_read_at_, last_write_at_) >= idle_timeout_) {
+            return kIdle;
+        }
+        ScheduleCheck(now);
+        return kNone;
+    }
+
+    void ConnectionDeadlines::ScheduleCheck(Clock::time_point now) {
+        Clock::time_point next = Clock::time_point::max();
+        if (read_timeout_.count()) {
+            next = std::min(next, last_read_at_ + read_timeout_);
+        }
+        if (write_timeout_.count()) {
+            // Without a write in flight, a write started now is the earliest one which could expire
+            next = std::min(next, (is_write_in_flight_ ? write_started_at_ : now) + write_timeout_);
+        }
+        if (idle_timeout_.count()) {
+            next = std::min(next, std::max(last_read_at_, last_write_at_) + idle_timeout_);
+        }
+        check_id_ = ptr_wheel_->Schedule(next - now, on_check_);
+    }
+
+    const char* ConnectionDeadlines::ToString(Expiry expiry) {
+        switch (expiry) {
+            case kRead:
+                return "read";
+            case kWrite:
+                return "write";
+            case kIdle:
+                return "idle";
+            default:
+                return "no";
+        }
+    }
+
+}
+}
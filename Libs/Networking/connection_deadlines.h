@@ -0,0 +1,77 @@
+#pragma once
+#include <boost/system/error_code.hpp>
+#include "timing_wheel.h"
+
+namespace Phyre {
+namespace Networking {
+
+// Read, write and idle deadlines of a single connection, checked on a shared TimingWheel.
+// Traffic merely stamps the time of the activity; nothing gets rescheduled per read or write.
+// Instead, a single wheel entry per connection fires at the earliest deadline, and the
+// owner calls Check, which either reports which deadline passed or arms the next check.
+// Not thread safe: the owner serializes every call (usually with its strand).
+//  - read:  the peer has not sent anything for this long
+//  - write: a write has been in flight for this long, i.e. the peer stopped draining
+//  - idle:  nothing was sent or received for this long
+// A timeout of zero disables the respective deadline.
+class ConnectionDeadlines {
+
+public:
+    typedef TimingWheel::Clock Clock;
+
+    enum Expiry {
+        kNone,
+        kRead,
+        kWrite,
+        kIdle
+    };
+
+    ConnectionDeadlines();
+    ~ConnectionDeadlines();
+
+    ConnectionDeadlines(const ConnectionDeadlines&) = delete;
+    ConnectionDeadlines& operator=(const ConnectionDeadlines&) = delete;
+
+    // on_check is invoked from the wheel whenever a deadline may have passed
+    void Configure(TimingWheel::pointer ptr_wheel,
+                   std::chrono::milliseconds read_timeout,
+                   std::chrono::milliseconds write_timeout,
+                   std::chrono::milliseconds idle_timeout,
+                   TimingWheel::Callback on_check);
+
+    // Starts the clocks, e.g. once connected
+    void Start();
+
+    // Stops checking, e.g. once closed
+    void Stop();
+
+    void OnRead() { if (is_enabled()) { last_read_at_ = Clock::now(); } }
+    void OnWriteStarted() { if (is_enabled()) { write_started_at_ = Clock::now(); is_write_in_flight_ = true; } }
+    void OnWriteCompleted() { if (is_enabled()) { last_write_at_ = Clock::now(); is_write_in_flight_ = false; } }
+
+    // @return The deadline which has passed, or kNone after scheduling the next check
+    Expiry Check();
+
+    bool is_enabled() const { return ptr_wheel_ && (read_timeout_.count() || write_timeout_.count() || idle_timeout_.count()); }
+
+    static const char* ToString(Expiry expiry);
+
+private:
+    void ScheduleCheck(Clock::time_point now);
+
+    TimingWheel::pointer ptr_wheel_;
+    std::chrono::milliseconds read_timeout_;
+    std::chrono::milliseconds write_timeout_;
+    std::chrono::milliseconds idle_timeout_;
+    TimingWheel::Callback on_check_;
+
+    Clock::time_point last_read_at_;
+    Clock::time_point last_write_at_;
+    Clock::time_point write_started_at_;
+    bool is_write_in_flight_;
+    bool is_running_;
+    TimingWheel::TimerId check_id_;
+};
+
+}
+}
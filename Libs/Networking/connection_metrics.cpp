@@ -0,0 +1,74 @@
+#include "connection_metrics.h"
+
+namespace Phyre {
+namespace Networking {
+
+    ConnectionMetrics::ConnectionMetrics(pointer ptr_aggregate, bool has_own_write_latency) :
+        ptr_aggregate_(ptr_aggregate),
+        bytes_received_(0),
+        bytes_sent_(0),
+        reads_(0),
+        writes_(0),
+        connects_(0),
+        total_connect_time_(0),
+        queue_depth_(0),
+        max_queue_depth_(0),
+        ptr_write_latency_(!ptr_aggregate || has_own_write_latency ? std::make_unique<LatencyHistogram>() : nullptr) { }
+
+    void ConnectionMetrics::RecordRead(size_t bytes) {
+        bytes_received_.fetch_add(bytes, std::memory_order_relaxed);
+        reads_.fetch_add(1, std::memory_order_relaxed);
+        if (ptr_aggregate_) {
+            ptr_aggregate_->RecordRead(bytes);
+        }
+    }
+
+    void ConnectionMetrics::RecordWrite(size_t bytes, Clock::duration latency) {
+        bytes_sent_.fetch_add(bytes, std::memory_order_relaxed);
+        writes_.fetch_add(1, std::memory_order_relaxed);
+        if (ptr_write_latency_) {
+            ptr_write_latency_->Record(std::chrono::duration_cast<std::chrono::microseconds>(latency));
+        }
+        if (ptr_aggregate_) {
+            ptr_aggregate_->RecordWrite(bytes, latency);
+        }
+    }
+
+    void ConnectionMetrics::RecordQueueDepth(size_t depth) {
+        int64_t previous = queue_depth_.load(std::memory_order_relaxed);
+        AdjustQueueDepth(static_cast<int64_t>(depth) - previous);
+    }
+
+    void ConnectionMetrics::AdjustQueueDepth(int64_t delta) {
+        if (delta == 0) {
+            return;
+        }
+        int64_t depth = queue_depth_.fetch_add(delta, std::memory_order_relaxed) + delta;
+        int64_t max = max_queue_depth_.load(std::memory_order_relaxed);
+        while (depth > max && !max_queue_depth_.compare_exchange_weak(max, depth, std::memory_order_relaxed)) { }
+
+        // Only the change is forwarded, which makes the aggregate the sum over every connection
+        if (ptr_aggregate_) {
+            ptr_aggregate_->AdjustQueueDepth(delta);
+        }
+    }
+
+    void ConnectionMetrics::RecordConnect(Clock::duration connect_time) {
+        connects_.fetch_add(1, std::memory_order_relaxed);
+        total_connect_time_.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(connect_time).count(),
+                                      std::memory_order_relaxed);
+        if (ptr_aggregate_) {
+            ptr_aggregate_->RecordConnect(connect_time);
+        }
+    }
+
+    std::chrono::microseconds ConnectionMetrics::connect_time() const {
+        uint64_t count = connects();
+        if (count == 0) {
+            return std::chrono::microseconds(0);
+        }
+        return std::chrono::microseconds(total_connect_time_.load(std::memory_order_relaxed) / count);
+    }
+
+}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "latency_histogram.h"
+
+namespace Phyre {
+namespace Networking {
+
+// Traffic counters and write latencies of a single connection.
+// Every counter is a relaxed atomic, so the owning connection records from its
+// own thread (or strand) while anyone else queries it without taking a lock.
+// A connection may also report into an aggregate, e.g. one shared by every
+// connection of a server; the aggregate is updated alongside the connection.
+// A write latency histogram takes a few KB, so a connection which reports into an aggregate
+// only records into the aggregate's histogram unless it asks for one of its own.
+class ConnectionMetrics {
+
+public:
+    typedef std::shared_ptr<ConnectionMetrics> pointer;
+    typedef std::chrono::steady_clock Clock;
+
+    explicit ConnectionMetrics(pointer ptr_aggregate = pointer(), bool has_own_write_latency = false);
+
+    void RecordRead(size_t bytes);
+
+    // A single queued write made it onto the wire, latency after it was queued
+    void RecordWrite(size_t bytes, Clock::duration latency);
+
+    // The number of buffers queued for writing, including the ones in flight
+    void RecordQueueDepth(size_t depth);
+
+    void RecordConnect(Clock::duration connect_time);
+
+    uint64_t bytes_received() const { return bytes_received_.load(std::memory_order_relaxed); }
+    uint64_t bytes_sent() const { return bytes_sent_.load(std::memory_order_relaxed); }
+    uint64_t reads() const { return reads_.load(std::memory_order_relaxed); }
+    uint64_t writes() const { return writes_.load(std::memory_order_relaxed); }
+    uint64_t connects() const { return connects_.load(std::memory_order_relaxed); }
+
+    // For an aggregate, these sum up the write queues of every connection reporting into it
+    int64_t queue_depth() const { return queue_depth_.load(std::memory_order_relaxed); }
+    int64_t max_queue_depth() const { return max_queue_depth_.load(std::memory_order_relaxed); }
+
+    // The mean time it took to establish a connection
+    std::chrono::microseconds connect_time() const;
+
+    // Time from queueing a write until the write completed. Without a histogram of its own,
+    // this is the aggregate's one, which covers every connection reporting into it.
+    const LatencyHistogram& write_latency() const {
+        return ptr_write_latency_ ? *ptr_write_latency_ : ptr_aggregate_->write_latency();
+    }
+
+private:
+    void AdjustQueueDepth(int64_t delta);
+
+    pointer ptr_aggregate_;
+    std::atomic<uint64_t> bytes_received_;
+    std::atomic<uint64_t> bytes_sent_;
+    std::atomic<uint64_t> reads_;
+    std::atomic<uint64_t> writes_;
+    std::atomic<uint64_t> connects_;
+    std::atomic<uint64_t> total_connect_time_;
+    std::atomic<int64_t> queue_depth_;
+    std::atomic<int64_t> max_queue_depth_;
+    std::unique_ptr<LatencyHistogram> ptr_write_latency_;
+};
+
+}
+}
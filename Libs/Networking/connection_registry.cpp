@@ -0,0 +1,62 @@
+#include "connection_registry.h"
+
+namespace Phyre {
+namespace Networking {
+
+    void ConnectionRegistry::Add(const TCPServerConnection::pointer& connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.insert(connection);
+    }
+
+    void ConnectionRegistry::Remove(const TCPServerConnection::pointer& connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.erase(connection);
+    }
+
+    void ConnectionRegistry::ForEach(const Visitor& visitor) const {
+        for (const TCPServerConnection::pointer& connection : Snapshot()) {
+            visitor(connection);
+        }
+    }
+
+    void ConnectionRegistry::CloseAll() {
+        ForEach([](const TCPServerConnection::pointer& connection) { connection->Close(); });
+    }
+
+    size_t ConnectionRegistry::Broadcast(const WriteQueue::SharedBuffer& ptr_payload,
+                                         const OnDeliveredCallback& on_delivered,
+                                         const Filter& filter) const {
+        size_t recipients = 0;
+        for (const TCPServerConnection::pointer& connection : Snapshot()) {
+            if (filter && !filter(connection)) {
+                continue;
+            }
+            ++recipients;
+            if (!on_delivered) {
+                connection->Write(ptr_payload);
+                continue;
+            }
+            // A weak reference, since the connection's own queue holds on to the callback
+            std::weak_ptr<TCPServerConnection> weak_connection = connection;
+            connection->Write(ptr_payload, [weak_connection, on_delivered](const boost::system::error_code& ec, size_t) {
+                TCPServerConnection::pointer recipient = weak_connection.lock();
+                if (recipient) {
+                    on_delivered(recipient, ec);
+                }
+            });
+        }
+        return recipients;
+    }
+
+    size_t ConnectionRegistry::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_.size();
+    }
+
+    std::vector<TCPServerConnection::pointer> ConnectionRegistry::Snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::vector<TCPServerConnection::pointer>(connections_.begin(), connections_.end());
+    }
+
+}
+}
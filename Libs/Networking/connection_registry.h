@@ -0,0 +1,57 @@
+#pragma once
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include "tcp_server_connection.h"
+
+namespace Phyre {
+namespace Networking {
+
+// Keeps track of every live connection accepted by a TCPServer.
+// All operations are thread safe since connections are added from the
+// acceptor's handler and removed from whichever worker thread closes them.
+class ConnectionRegistry {
+
+public:
+    typedef std::shared_ptr<ConnectionRegistry> pointer;
+    typedef std::function<void(const TCPServerConnection::pointer&)> Visitor;
+
+    // Picks the recipients of a broadcast
+    typedef std::function<bool(const TCPServerConnection::pointer&)> Filter;
+
+    // The outcome of a broadcast for a single recipient, invoked in the recipient's strand
+    // once its write completed, failed or was turned down, e.g. by its write limits
+    typedef std::function<void(const TCPServerConnection::pointer&, const boost::system::error_code&)> OnDeliveredCallback;
+
+    void Add(const TCPServerConnection::pointer& connection);
+    void Remove(const TCPServerConnection::pointer& connection);
+
+    // Visits a snapshot of the registered connections so that the visitor
+    // is free to close connections (and therefore call Remove) while iterating
+    void ForEach(const Visitor& visitor) const;
+
+    // Closes every registered connection
+    void CloseAll();
+
+    /**
+    * Queues the same payload to every registered connection the filter accepts, or to all of them.
+    * Every recipient's queue references the one buffer, so fanning out to n connections neither
+    * copies the payload n times nor allocates for it; the buffer goes away with the last write.
+    * @return The number of connections the payload was queued to
+    */
+    size_t Broadcast(const WriteQueue::SharedBuffer& ptr_payload,
+                     const OnDeliveredCallback& on_delivered = OnDeliveredCallback(),
+                     const Filter& filter = Filter()) const;
+
+    size_t size() const;
+
+private:
+    std::vector<TCPServerConnection::pointer> Snapshot() const;
+
+    mutable std::mutex mutex_;
+    std::unordered_set<TCPServerConnection::pointer> connections_;
+};
+
+}
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <Logging/logging.h>
+#include "dns_cache.h"
+
+namespace Phyre {
+namespace Networking {
+
+    const std::string DnsCache::kWho = "[DnsCache]";
+    const std::chrono::milliseconds DnsCache::kDefaultTTL(std::chrono::seconds(60));
+    const std::chrono::milliseconds DnsCache::kDefaultNegativeTTL(std::chrono::seconds(5));
+    const size_t DnsCache::kDefaultMaxEntries = 1024;
+
+    DnsCache::Pointer DnsCache::Instance() {
+        static Pointer instance = std::make_shared<DnsCache>();
+        return instance;
+    }
+
+    DnsCache::DnsCache() :
+        ttl_(kDefaultTTL),
+        negative_ttl_(kDefaultNegativeTTL),
+        serve_stale_(false),
+        max_entries_(kDefaultMaxEntries),
+        next_query_id_(0) { }
+
+    void DnsCache::Resolve(boost::asio::io_service& io_service,
+                           const std::string& host,
+                           const std::string& service,
+                           const ResolveFunction& resolve_function,
+                           OnResolvedCallback on_resolved_callback) {
+        Key key(host, service);
+        bool should_resolve = false;
+        uint64_t query_id = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            query_id = ++next_query_id_;
+            Waiter waiter{ &io_service, on_resolved_callback, resolve_function, query_id };
+            Entry& entry = Touch(key);
+            bool is_fresh = entry.has_result && Clock::now() < entry.expiry;
+            bool is_stale_but_usable = entry.has_result && !entry.error && serve_stale_;
+
+            if (is_fresh || is_stale_but_usable) {
+                PHYRE_LOG(trace, kWho) << (is_fresh ? "Hit " : "Stale hit ") << host << ':' << service;
+                Post(waiter, entry.error, entry.endpoints);
+            } else {
+                entry.waiters.push_back(waiter);
+            }
+
+            // Only one query per key may be in flight at any time
+            if (!is_fresh && !entry.is_resolving) {
+                entry.is_resolving = true;
+                entry.query_id = query_id;
+                should_resolve = true;
+            }
+            Evict();
+        }
+
+        if (should_resolve) {
+            PHYRE_LOG(debug, kWho) << "Miss " << host << ':' << service;
+            Query(key, query_id, resolve_function);
+        }
+    }
+
+    DnsCache::Entry& DnsCache::Touch(const Key& key) {
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            lru_.push_front(key);
+            it = entries_.emplace(key, Entry()).first;
+            it->second.lru_position = lru_.begin();
+        } else {
+            lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+        }
+        return it->second;
+    }
+
+    void DnsCache::Evict() {
+        for (auto it = lru_.end(); it != lru_.begin() && entries_.size() > max_entries_;) {
+            --it;
+            auto entry = entries_.find(*it);
+            // Entries with lookups in flight still have waiters to notify
+            if (entry->second.is_resolving) {
+                continue;
+            }
+            entries_.erase(entry);
+            it = lru_.erase(it);
+        }
+    }
+
+    void DnsCache::Query(const Key& key, uint64_t query_id, const ResolveFunction& resolve_function) {
+        Pointer self = shared_from_this();
+        resolve_function(key.first, key.second, [self, key, query_id](const boost::system::error_code& ec, const Endpoints& endpoints) {
+            self->Complete(key, query_id, ec, endpoints);
+        });
+    }
+
+    void DnsCache::Complete(const Key& key, uint64_t query_id, const boost::system::error_code& ec, const Endpoints& endpoints) {
+        std::vector<Waiter> waiters;
+        boost::system::error_code error = ec;
+        Endpoints resolved = endpoints;
+        ResolveFunction requery_function;
+        uint64_t requery_id = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(key);
+            if (it == entries_.end() || it->second.query_id != query_id) {
+                return;
+            }
+            Entry& entry = it->second;
+            entry.is_resolving = false;
+            waiters.swap(entry.waiters);
+
+            bool is_cancelled = ec == boost::asio::error::operation_aborted;
+            bool keep_stale = ec && serve_stale_ && entry.has_result && !entry.error;
+            if (is_cancelled) {
+                // Only the caller the query was issued for gave up on it, it is issued again for the others
+                auto issuer = std::find_if(waiters.begin(), waiters.end(), [query_id](const Waiter& waiter) {
+                    return waiter.query_id == query_id;
+                });
+                std::vector<Waiter> cancelled;
+                if (issuer != waiters.end()) {
+                    cancelled.push_back(*issuer);
+                    waiters.erase(issuer);
+                }
+                if (!waiters.empty()) {
+                    entry.waiters.swap(waiters);
+                    entry.is_resolving = true;
+                    entry.query_id = requery_id = entry.waiters.front().query_id;
+                    requery_function = entry.waiters.front().resolve_function;
+                }
+                waiters.swap(cancelled);
+            } else if (keep_stale) {
+                // A failed refresh must not throw away an address that used to work
+                error = entry.error;
+                resolved = entry.endpoints;
+            } else {
+                entry.error = ec;
+                entry.endpoints = endpoints;
+                entry.expiry = Clock::now() + (ec ? negative_ttl_ : ttl_);
+                entry.has_result = true;
+            }
+        }
+
+        for (const Waiter& waiter : waiters) {
+            Post(waiter, error, resolved);
+        }
+        if (requery_function) {
+            PHYRE_LOG(debug, kWho) << "Querying " << key.first << ':' << key.second << " again for the lookups which joined a cancelled one";
+            Query(key, requery_id, requery_function);
+        }
+    }
+
+    void DnsCache::Post(const Waiter& waiter, const boost::system::error_code& ec, const Endpoints& endpoints) {
+        OnResolvedCallback callback = waiter.callback;
+        waiter.p_io_service->post([callback, ec, endpoints]() { callback(ec, endpoints); });
+    }
+
+    void DnsCache::Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            // Entries with lookups in flight still have waiters to notify
+            if (it->second.is_resolving) {
+                it->second.has_result = false;
+                ++it;
+            } else {
+                lru_.erase(it->second.lru_position);
+                it = entries_.erase(it);
+            }
+        }
+    }
+
+    size_t DnsCache::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    void DnsCache::set_ttl(std::chrono::milliseconds ttl) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ttl_ = ttl;
+    }
+
+    void DnsCache::set_negative_ttl(std::chrono::milliseconds negative_ttl) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        negative_ttl_ = negative_ttl;
+    }
+
+    void DnsCache::set_serve_stale(bool serve_stale) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        serve_stale_ = serve_stale;
+    }
+
+    void DnsCache::set_max_entries(size_t max_entries) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_entries_ = max_entries;
+        Evict();
+    }
+
+}
+}
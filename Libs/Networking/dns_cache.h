@@ -0,0 +1,101 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <chrono>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace Phyre {
+namespace Networking {
+
+// A thread safe cache of resolved endpoints keyed on (host, service).
+// Concurrent lookups for the same key are coalesced into a single query, and
+// every callback is posted to the io_service of the caller which asked for it.
+// The system resolver does not expose record TTLs, so entries live for a configurable
+// TTL (and failures for a shorter negative TTL). Optionally, expired entries are served
+// while they get refreshed in the background.
+// A query that gets cancelled only fails the caller it was issued for; it is issued again
+// for the others which joined it. The least recently used entries are evicted beyond a limit.
+class DnsCache : public std::enable_shared_from_this<DnsCache> {
+
+public:
+    typedef std::shared_ptr<DnsCache> Pointer;
+    typedef std::vector<boost::asio::ip::tcp::endpoint> Endpoints;
+    typedef std::function<void(const boost::system::error_code&, const Endpoints&)> OnResolvedCallback;
+
+    // Performs the actual lookup on a cache miss; swap it for a stub in tests
+    typedef std::function<void(const std::string& host, const std::string& service, OnResolvedCallback)> ResolveFunction;
+
+    static const std::chrono::milliseconds kDefaultTTL;
+    static const std::chrono::milliseconds kDefaultNegativeTTL;
+    static const size_t kDefaultMaxEntries;
+
+    // The cache shared by the whole process
+    static Pointer Instance();
+
+    DnsCache();
+
+    void Resolve(boost::asio::io_service& io_service,
+                 const std::string& host,
+                 const std::string& service,
+                 const ResolveFunction& resolve_function,
+                 OnResolvedCallback on_resolved_callback);
+
+    // Forgets every entry; lookups in flight still complete
+    void Clear();
+
+    size_t size() const;
+
+    void set_ttl(std::chrono::milliseconds ttl);
+    void set_negative_ttl(std::chrono::milliseconds negative_ttl);
+    void set_serve_stale(bool serve_stale);
+    // Entries with lookups in flight are kept beyond the limit until they complete
+    void set_max_entries(size_t max_entries);
+
+private:
+    typedef std::pair<std::string, std::string> Key;
+    typedef std::chrono::steady_clock Clock;
+
+    struct Waiter {
+        boost::asio::io_service* p_io_service;
+        OnResolvedCallback callback;
+        ResolveFunction resolve_function;
+        uint64_t query_id;
+    };
+
+    struct Entry {
+        Entry() : has_result(false), is_resolving(false), query_id(0) { }
+
+        boost::system::error_code error;
+        Endpoints endpoints;
+        Clock::time_point expiry;
+        bool has_result;
+        bool is_resolving;
+        // Tells which waiter the query in flight was issued for
+        uint64_t query_id;
+        std::vector<Waiter> waiters;
+        std::list<Key>::iterator lru_position;
+    };
+
+    Entry& Touch(const Key& key);
+    void Evict();
+    void Query(const Key& key, uint64_t query_id, const ResolveFunction& resolve_function);
+    void Complete(const Key& key, uint64_t query_id, const boost::system::error_code& ec, const Endpoints& endpoints);
+    static void Post(const Waiter& waiter, const boost::system::error_code& ec, const Endpoints& endpoints);
+
+    mutable std::mutex mutex_;
+    std::map<Key, Entry> entries_;
+    // Most recently used first
+    std::list<Key> lru_;
+    std::chrono::milliseconds ttl_;
+    std::chrono::milliseconds negative_ttl_;
+    bool serve_stale_;
+    size_t max_entries_;
+    uint64_t next_query_id_;
+
+    static const std::string kWho;
+};
+
+}
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <boost/asio/error.hpp>
+#include <stdexcept>
+#include "frame_codec.h"
+
+namespace Phyre {
+namespace Networking {
+
+    const size_t FrameCodec::kDefaultMaxFrameSize;
+    const size_t VarintFrameCodec::kMaxHeaderSize;
+
+    size_t FrameCodec::Decode(boost::string_ref bytes, const OnFrameCallback& on_frame, boost::system::error_code& ec) {
+        ec.clear();
+        size_t consumed = 0;
+        while (consumed < bytes.size()) {
+            boost::string_ref frame;
+            size_t frame_size = Parse(bytes.substr(consumed), frame, ec);
+            if (ec || frame_size == 0) {
+                break;
+            }
+            consumed += frame_size;
+            on_frame(frame);
+        }
+        return consumed;
+    }
+
+    std::string VarintFrameCodec::Encode(boost::string_ref payload) const {
+        std::string framed;
+        framed.reserve(payload.size() + kMaxHeaderSize);
+        uint64_t length = payload.size();
+        while (length >= 0x80) {
+            framed.push_back(static_cast<char>((length & 0x7F) | 0x80));
+            length >>= 7;
+        }
+        framed.push_back(static_cast<char>(length));
+        framed.append(payload.data(), payload.size());
+        return framed;
+    }
+
+    size_t VarintFrameCodec::Parse(boost::string_ref bytes, boost::string_ref& frame, boost::system::error_code& ec) {
+        uint64_t length = 0;
+        size_t header_size = 0;
+        while (true) {
+            if (header_size == bytes.size()) {
+                return 0;
+            }
+            if (header_size == kMaxHeaderSize) {
+                ec = boost::asio::error::invalid_argument;
+                return 0;
+            }
+            uint8_t byte = static_cast<uint8_t>(bytes[header_size]);
+            // The last byte only has room for the 64th bit, anything beyond would wrap the length around
+            if (header_size == kMaxHeaderSize - 1 && byte > 0x01) {
+                ec = boost::asio::error::invalid_argument;
+                return 0;
+            }
+            length |= static_cast<uint64_t>(byte & 0x7F) << (7 * header_size);
+            ++header_size;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+
+        if (length > max_frame_size_) {
+            ec = boost::asio::error::message_size;
+            return 0;
+        }
+        if (bytes.size() - header_size < length) {
+            return 0;
+        }
+        frame = bytes.substr(header_size, static_cast<size_t>(length));
+        return header_size + frame.size();
+    }
+
+    FixedHeaderFrameCodec::FixedHeaderFrameCodec(size_t header_size, size_t max_frame_size) :
+        FrameCodec(max_frame_size),
+        header_size_(header_size)
+    {
+        if (header_size_ != 1 && header_size_ != 2 && header_size_ != 4) {
+            throw std::invalid_argument("The header of a frame must be 1, 2 or 4 bytes");
+        }
+        // Frames which do not fit the header could never be encoded anyway
+        if (header_size_ < 4) {
+            max_frame_size_ = std::min(max_frame_size_, (size_t(1) << (8 * header_size_)) - 1);
+        }
+    }
+
+    std::string FixedHeaderFrameCodec::Encode(boost::string_ref payload) const {
+        if (static_cast<uint64_t>(payload.size()) >> (8 * header_size_) != 0) {
+            throw std::length_error("The payload is too large for the frame header");
+        }
+        std::string framed;
+        framed.reserve(header_size_ + payload.size());
+        for (size_t i = header_size_; i > 0; --i) {
+            framed.push_back(static_cast<char>((payload.size() >> (8 * (i - 1))) & 0xFF));
+        }
+        framed.append(payload.data(), payload.size());
+        return framed;
+    }
+
+    size_t FixedHeaderFrameCodec::Parse(boost::string_ref bytes, boost::string_ref& frame, boost::system::error_code& ec) {
+        if (bytes.size() < header_size_) {
+            return 0;
+        }
+        uint64_t length = 0;
+        for (size_t i = 0; i < header_size_; ++i) {
+            length = (length << 8) | static_cast<uint8_t>(bytes[i]);
+        }
+
+        if (length > max_frame_size_) {
+            ec = boost::asio::error::message_size;
+            return 0;
+        }
+        if (bytes.size() - header_size_ < length) {
+            return 0;
+        }
+        frame = bytes.substr(header_size_, static_cast<size_t>(length));
+        return header_size_ + frame.size();
+    }
+
+    DelimiterFrameCodec::DelimiterFrameCodec(const std::string& delimiter, size_t max_frame_size) :
+        FrameCodec(max_frame_size),
+        delimiter_(delimiter),
+        searched_(0)
+    {
+        if (delimiter_.empty()) {
+            throw std::invalid_argument("The frame delimiter must not be empty");
+        }
+    }
+
+    std::string DelimiterFrameCodec::Encode(boost::string_ref payload) const {
+        std::string framed;
+        framed.reserve(payload.size() + delimiter_.size());
+        framed.append(payload.data(), payload.size());
+        framed.append(delimiter_);
+        return framed;
+    }
+
+    size_t DelimiterFrameCodec::Parse(boost::string_ref bytes, boost::string_ref& frame, boost::system::error_code& ec) {
+        // The delimiter may straddle the bytes searched last time
+        size_t search_from = std::min(searched_ + 1 > delimiter_.size() ? searched_ + 1 - delimiter_.size() : 0, bytes.size());
+        size_t found = bytes.substr(search_from).find(delimiter_);
+        if (found == boost::string_ref::npos) {
+            searched_ = bytes.size();
+            if (bytes.size() >= max_frame_size_ + delimiter_.size()) {
+                ec = boost::asio::error::message_size;
+            }
+            return 0;
+        }
+
+        found += search_from;
+        searched_ = 0;
+        if (found > max_frame_size_) {
+            ec = boost::asio::error::message_size;
+            return 0;
+        }
+        frame = bytes.substr(0, found);
+        return found + delimiter_.size();
+    }
+
+}
+}
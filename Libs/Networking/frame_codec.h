@@ -0,0 +1,101 @@
+#pragma once
+#include <boost/system/error_code.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace Phyre {
+namespace Networking {
+
+// Splits a byte stream into frames and back.
+// Decode parses straight out of the bytes it is handed, e.g. a ReceiveBuffer, and emits
+// views of complete frames; partial frames are left unconsumed for the next call.
+// A codec may keep parsing state between calls, so use one per connection.
+class FrameCodec {
+
+public:
+    typedef std::unique_ptr<FrameCodec> Pointer;
+
+    // The frame is only valid for the duration of the call
+    typedef std::function<void(boost::string_ref)> OnFrameCallback;
+
+    static const size_t kDefaultMaxFrameSize = 1024 * 1024;
+
+    explicit FrameCodec(size_t max_frame_size = kDefaultMaxFrameSize) : max_frame_size_(max_frame_size) { }
+    virtual ~FrameCodec() { }
+
+    // Emits every complete frame at the front of bytes, in order.
+    // The caller must consume exactly the returned number of bytes before decoding again.
+    // Frames larger than max_frame_size fail with message_size, malformed headers with invalid_argument;
+    // the stream cannot be resynchronized after either.
+    // @return The number of bytes taken up by the emitted frames
+    size_t Decode(boost::string_ref bytes, const OnFrameCallback& on_frame, boost::system::error_code& ec);
+
+    // @return The payload framed for the wire
+    virtual std::string Encode(boost::string_ref payload) const = 0;
+
+    size_t max_frame_size() const { return max_frame_size_; }
+
+protected:
+    // Looks for a single frame at the front of bytes
+    // @return The size of the frame on the wire, or 0 if it is not complete yet
+    virtual size_t Parse(boost::string_ref bytes, boost::string_ref& frame, boost::system::error_code& ec) = 0;
+
+    size_t max_frame_size_;
+};
+
+// Frames prefixed with their length as an unsigned LEB128 varint, as in protobuf streams
+class VarintFrameCodec : public FrameCodec {
+
+public:
+    explicit VarintFrameCodec(size_t max_frame_size = kDefaultMaxFrameSize) : FrameCodec(max_frame_size) { }
+
+    std::string Encode(boost::string_ref payload) const override;
+
+protected:
+    size_t Parse(boost::string_ref bytes, boost::string_ref& frame, boost::system::error_code& ec) override;
+
+private:
+    // A 64 bit varint takes at most 10 bytes
+    static const size_t kMaxHeaderSize = 10;
+};
+
+// Frames prefixed with their length as a big endian integer of 1, 2 or 4 bytes
+class FixedHeaderFrameCodec : public FrameCodec {
+
+public:
+    explicit FixedHeaderFrameCodec(size_t header_size = 4, size_t max_frame_size = kDefaultMaxFrameSize);
+
+    std::string Encode(boost::string_ref payload) const override;
+
+protected:
+    size_t Parse(boost::string_ref bytes, boost::string_ref& frame, boost::system::error_code& ec) override;
+
+private:
+    size_t header_size_;
+};
+
+// Frames terminated by a delimiter such as CRLF, which is not part of the emitted frame.
+// Payloads must not contain the delimiter themselves.
+class DelimiterFrameCodec : public FrameCodec {
+
+public:
+    explicit DelimiterFrameCodec(const std::string& delimiter = "\r\n", size_t max_frame_size = kDefaultMaxFrameSize);
+
+    std::string Encode(boost::string_ref payload) const override;
+
+protected:
+    size_t Parse(boost::string_ref bytes, boost::string_ref& frame, boost::system::error_code& ec) override;
+
+private:
+    std::string delimiter_;
+
+    // How far into a partial frame the delimiter has been searched for already,
+    // so that a frame trickling in byte by byte is not rescanned from its start each time
+    size_t searched_;
+};
+
+}
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Phyre {
+namespace Networking {
+
+// A block of memory recycled by the completion handlers of one kind of operation,
+// e.g. the reads of a connection. Since a connection never has two reads (or two writes)
+// outstanding, the operation and its handler fit into the same block every time
+// and the steady state read/write loop does not touch the heap.
+// Requests which do not fit, or arrive while the block is taken, fall back to the heap.
+// Handlers share ownership of the block, since an aborted operation may only be
+// destroyed along with its io_service, long after the connection is gone.
+class HandlerMemory {
+
+public:
+    typedef std::shared_ptr<HandlerMemory> pointer;
+
+    static const size_t kSize = 1024;
+
+    HandlerMemory() : is_in_use_(false) { }
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* Allocate(size_t size) {
+        if (!is_in_use_ && size <= sizeof(storage_)) {
+            is_in_use_ = true;
+            return &storage_;
+        }
+        return ::operator new(size);
+    }
+
+    void Deallocate(void* pointer) {
+        if (pointer == &storage_) {
+            is_in_use_ = false;
+            return;
+        }
+        ::operator delete(pointer);
+    }
+
+private:
+    typename std::aligned_storage<kSize>::type storage_;
+    bool is_in_use_;
+};
+
+// Hands out a HandlerMemory to Boost.Asio versions which look up a handler's associated allocator
+template <typename T>
+class HandlerAllocator {
+
+public:
+    typedef T value_type;
+
+    explicit HandlerAllocator(HandlerMemory* p_memory) : p_memory_(p_memory) { }
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : p_memory_(other.p_memory_) { }
+
+    T* allocate(size_t count) const {
+        return static_cast<T*>(p_memory_->Allocate(sizeof(T) * count));
+    }
+
+    void deallocate(T* pointer, size_t /*count*/) const {
+        p_memory_->Deallocate(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const HandlerAllocator<U>& other) const { return p_memory_ == other.p_memory_; }
+
+    template <typename U>
+    bool operator!=(const HandlerAllocator<U>& other) const { return p_memory_ != other.p_memory_; }
+
+private:
+    template <typename> friend class HandlerAllocator;
+
+    HandlerMemory* p_memory_;
+};
+
+// Wraps a completion handler so that Boost.Asio allocates its operation from a HandlerMemory.
+// Newer Boost.Asio versions go through allocator_type, older ones through the allocation hooks.
+// The handler type is kept as is rather than erased into a std::function, which would allocate on its own.
+template <typename Handler>
+class CustomAllocHandler {
+
+public:
+    typedef HandlerAllocator<Handler> allocator_type;
+
+    CustomAllocHandler(HandlerMemory::pointer ptr_memory, Handler handler) :
+        ptr_memory_(std::move(ptr_memory)),
+        handler_(std::move(handler)) { }
+
+    allocator_type get_allocator() const noexcept { return allocator_type(ptr_memory_.get()); }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+    friend void* asio_handler_allocate(size_t size, CustomAllocHandler* p_handler) {
+        return p_handler->ptr_memory_->Allocate(size);
+    }
+
+    friend void asio_handler_deallocate(void* pointer, size_t /*size*/, CustomAllocHandler* p_handler) {
+        p_handler->ptr_memory_->Deallocate(pointer);
+    }
+
+private:
+    HandlerMemory::pointer ptr_memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+inline CustomAllocHandler<Handler> MakeCustomAllocHandler(const HandlerMemory::pointer& ptr_memory, Handler handler) {
+    return CustomAllocHandler<Handler>(ptr_memory, std::move(handler));
+}
+
+}
+}
@@ -0,0 +1,143 @@
+#include <boost/bind/bind.hpp>
+#include <Logging/logging.h>
+#include "happy_eyeballs_connector.h"
+
+namespace Phyre {
+namespace Networking {
+
+    using boost::asio::ip::tcp;
+
+    const std::string HappyEyeballsConnector::kWho = "[HappyEyeballsConnector]";
+    const std::chrono::milliseconds HappyEyeballsConnector::kDefaultAttemptDelay(250);
+
+    HappyEyeballsConnector::HappyEyeballsConnector(boost::asio::io_service& io_service, std::chrono::milliseconds attempt_delay) :
+        io_service_(io_service),
+        attempt_timer_(io_service),
+        attempt_delay_(attempt_delay),
+        pending_attempts_(0),
+        is_done_(false) { }
+
+    HappyEyeballsConnector::pointer
+    HappyEyeballsConnector::Create(boost::asio::io_service& io_service, std::chrono::milliseconds attempt_delay) {
+        return pointer(new HappyEyeballsConnector(io_service, attempt_delay));
+    }
+
+    void HappyEyeballsConnector::Connect(const std::vector<tcp::endpoint>& endpoints, OnConnectCallback on_connect_callback) {
+        endpoints_ = InterleaveAddressFamilies(endpoints);
+        on_connect_callback_ = on_connect_callback;
+
+        if (endpoints_.empty()) {
+            // Never invoke the callback from within Connect
+            io_service_.post(boost::bind(&HappyEyeballsConnector::Finish,
+                                         shared_from_this(),
+                                         boost::system::error_code(boost::asio::error::host_not_found),
+                                         nullptr));
+            return;
+        }
+        StartNextAttempt();
+    }
+
+    void HappyEyeballsConnector::Cancel() {
+        is_done_ = true;
+        attempt_timer_.cancel();
+        for (std::unique_ptr<tcp::socket>& attempt : attempts_) {
+            boost::system::error_code ignored;
+            attempt->close(ignored);
+        }
+    }
+
+    std::vector<tcp::endpoint> HappyEyeballsConnector::InterleaveAddressFamilies(const std::vector<tcp::endpoint>& endpoints) {
+        std::vector<tcp::endpoint> v6;
+        std::vector<tcp::endpoint> v4;
+        for (const tcp::endpoint& endpoint : endpoints) {
+            (endpoint.address().is_v6() ? v6 : v4).push_back(endpoint);
+        }
+
+        std::vector<tcp::endpoint> interleaved;
+        interleaved.reserve(endpoints.size());
+        for (size_t i = 0; i < std::max(v6.size(), v4.size()); ++i) {
+            if (i < v6.size()) {
+                interleaved.push_back(v6[i]);
+            }
+            if (i < v4.size()) {
+                interleaved.push_back(v4[i]);
+            }
+        }
+        return interleaved;
+    }
+
+    void HappyEyeballsConnector::StartNextAttempt() {
+        size_t attempt = attempts_.size();
+        if (is_done_ || attempt >= endpoints_.size()) {
+            return;
+        }
+
+        PHYRE_LOG(trace, kWho) << "Attempting " << endpoints_[attempt];
+        attempts_.push_back(std::make_unique<tcp::socket>(io_service_));
+        ++pending_attempts_;
+        attempts_.back()->async_connect(endpoints_[attempt],
+                                        boost::bind(&HappyEyeballsConnector::HandleAttempt,
+                                                    shared_from_this(),
+                                                    attempt,
+                                                    boost::asio::placeholders::error));
+
+        // Give this attempt a head start before racing the next endpoint against it
+        if (attempts_.size() < endpoints_.size()) {
+            attempt_timer_.expires_from_now(attempt_delay_);
+            attempt_timer_.async_wait(boost::bind(&HappyEyeballsConnector::HandleAttemptDelay,
+                                                  shared_from_this(),
+                                                  boost::asio::placeholders::error));
+        }
+    }
+
+    void HappyEyeballsConnector::HandleAttemptDelay(const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted || is_done_) {
+            return;
+        }
+        StartNextAttempt();
+    }
+
+    void HappyEyeballsConnector::HandleAttempt(size_t attempt, const boost::system::error_code& ec) {
+        --pending_attempts_;
+        if (is_done_) {
+            return;
+        }
+
+        if (!ec) {
+            PHYRE_LOG(debug, kWho) << "Connected to " << endpoints_[attempt];
+            Finish(ec, attempts_[attempt].get());
+            return;
+        }
+
+        PHYRE_LOG(debug, kWho) << "Failed to connect to " << endpoints_[attempt] << ": " << ec.message();
+        last_error_ = ec;
+        boost::system::error_code ignored;
+        attempts_[attempt]->close(ignored);
+
+        // No point in waiting out the delay when an attempt has already failed
+        if (attempts_.size() < endpoints_.size()) {
+            attempt_timer_.cancel();
+            StartNextAttempt();
+        } else if (pending_attempts_ == 0) {
+            Finish(last_error_, nullptr);
+        }
+    }
+
+    void HappyEyeballsConnector::Finish(const boost::system::error_code& ec, tcp::socket* winner) {
+        // The owner may have cancelled, and gone away, while the failure for an empty list was posted
+        if (is_done_) {
+            return;
+        }
+        is_done_ = true;
+        attempt_timer_.cancel();
+        for (std::unique_ptr<tcp::socket>& attempt : attempts_) {
+            if (attempt.get() != winner) {
+                boost::system::error_code ignored;
+                attempt->close(ignored);
+            }
+        }
+        on_connect_callback_(ec, winner);
+    }
+
+}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <vector>
+
+namespace Phyre {
+namespace Networking {
+
+// Connects to the first responsive endpoint of a multi-homed host, in the spirit of
+// Happy Eyeballs (RFC 8305). Endpoints are tried in order with IPv6 and IPv4
+// interleaved. A new attempt starts each time the attempt delay elapses or the
+// latest attempt fails, so attempts race each other and the first one to connect wins.
+class HappyEyeballsConnector : public std::enable_shared_from_this<HappyEyeballsConnector> {
+
+public:
+    typedef std::shared_ptr<HappyEyeballsConnector> pointer;
+
+    // The winning socket is only valid for the duration of the call; move it somewhere.
+    // It is null if every endpoint failed, in which case the last failure is reported.
+    typedef std::function<void(const boost::system::error_code&, boost::asio::ip::tcp::socket*)> OnConnectCallback;
+
+    // The recommended connection attempt delay from RFC 8305
+    static const std::chrono::milliseconds kDefaultAttemptDelay;
+
+    static pointer Create(boost::asio::io_service& io_service,
+                          std::chrono::milliseconds attempt_delay = kDefaultAttemptDelay);
+
+    void Connect(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints, OnConnectCallback on_connect_callback);
+
+    // Abandons every attempt in progress without invoking the callback
+    void Cancel();
+
+    // Reorders endpoints so that address families alternate, starting with IPv6.
+    // The relative order of endpoints within a family is preserved.
+    static std::vector<boost::asio::ip::tcp::endpoint> InterleaveAddressFamilies(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints);
+
+private:
+    HappyEyeballsConnector(boost::asio::io_service& io_service, std::chrono::milliseconds attempt_delay);
+
+    void StartNextAttempt();
+    void HandleAttempt(size_t attempt, const boost::system::error_code& ec);
+    void HandleAttemptDelay(const boost::system::error_code& ec);
+    void Finish(const boost::system::error_code& ec, boost::asio::ip::tcp::socket* winner);
+
+    boost::asio::io_service& io_service_;
+    boost::asio::steady_timer attempt_timer_;
+    std::chrono::milliseconds attempt_delay_;
+    std::vector<boost::asio::ip::tcp::endpoint> endpoints_;
+
+    // One socket per attempt, indexed like endpoints_
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> attempts_;
+    size_t pending_attempts_;
+    boost::system::error_code last_error_;
+    OnConnectCallback on_connect_callback_;
+    bool is_done_;
+
+    static const std::string kWho;
+};
+
+}
+}
@@ -7,14 +7,39 @@ namespace Networking
 {
     using boost::asio::ip::tcp;
     const std::string HostResolver::kWho = "[HostResolver]";
-    HostResolver::HostResolver(std::unique_ptr<tcp::resolver> resolver): ptr_resolver_(std::move(resolver))
+    HostResolver::HostResolver(boost::asio::io_service& io_service, DnsCache::Pointer ptr_dns_cache):
+        io_service_(io_service),
+        ptr_resolver_(std::make_unique<tcp::resolver>(io_service)),
+        ptr_dns_cache_(ptr_dns_cache)
     {
     }
 
     void HostResolver::ResolveHost(const std::string& host, const std::string& service, OnHostResolvedCallback callback) const {
-        tcp::resolver::query host_query(host, service);
         PHYRE_LOG(debug, kWho) << "Resolving " << host << ':' << service << "...";
-        ptr_resolver_->async_resolve(host_query, callback);
+        if (!ptr_dns_cache_) {
+            Query(host, service, callback);
+            return;
+        }
+
+        // Other clients may join the lookup, so it runs on a resolver of its own rather than on
+        // this one, which goes away along with the client that happened to ask first
+        boost::asio::io_service* p_io_service = &io_service_;
+        ptr_dns_cache_->Resolve(io_service_, host, service,
+                                [p_io_service](const std::string& query_host, const std::string& query_service, OnHostResolvedCallback on_resolved) {
+                                    auto ptr_resolver = std::make_shared<tcp::resolver>(*p_io_service);
+                                    tcp::resolver::query host_query(query_host, query_service);
+                                    ptr_resolver->async_resolve(host_query, [ptr_resolver, on_resolved](const boost::system::error_code& ec, tcp::resolver::iterator it) {
+                                        on_resolved(ec, DnsCache::Endpoints(it, tcp::resolver::iterator()));
+                                    });
+                                },
+                                callback);
+    }
+
+    void HostResolver::Query(const std::string& host, const std::string& service, OnHostResolvedCallback callback) const {
+        tcp::resolver::query host_query(host, service);
+        ptr_resolver_->async_resolve(host_query, [callback](const boost::system::error_code& ec, tcp::resolver::iterator it) {
+            callback(ec, DnsCache::Endpoints(it, tcp::resolver::iterator()));
+        });
     }
 }
 }
@@ -2,19 +2,25 @@
 
 #include <boost/asio.hpp>
 #include <Logging/loggable_interface.h>
+#include "dns_cache.h"
 
 namespace Phyre {
 namespace Networking {
     class HostResolver
     {
     public:
-        typedef std::function<void(const boost::system::error_code&, boost::asio::ip::tcp::resolver::iterator)> OnHostResolvedCallback;
+        typedef DnsCache::OnResolvedCallback OnHostResolvedCallback;
 
-        HostResolver(std::unique_ptr<boost::asio::ip::tcp::resolver> resolver);
+        // Lookups go through the process wide DNS cache unless another cache (or none) is given
+        HostResolver(boost::asio::io_service& io_service, DnsCache::Pointer ptr_dns_cache = DnsCache::Instance());
         void ResolveHost(const std::string& host, const std::string& service, OnHostResolvedCallback callback) const;
 
     private:
+        void Query(const std::string& host, const std::string& service, OnHostResolvedCallback callback) const;
+
+        boost::asio::io_service& io_service_;
         std::unique_ptr<boost::asio::ip::tcp::resolver> ptr_resolver_;
+        DnsCache::Pointer ptr_dns_cache_;
         static const std::string kWho;
     };
 }
@@ -0,0 +1,335 @@
+#include <boost/asio/steady_timer.hpp>
+#include <deque>
+#include <Logging/logging.h>
+#include "impairment_proxy.h"
+#include "tcp_client.h"
+
+namespace Phyre {
+namespace Networking {
+
+    const std::string ImpairmentProxy::kWho = "[ImpairmentProxy]";
+
+    ImpairedLink::ImpairedLink(const Impairments& impairments, std::mt19937::result_type seed) :
+        impairments_(impairments),
+        generator_(seed),
+        is_reset_(false) { }
+
+    std::vector<ImpairedLink::Segment> ImpairedLink::Transmit(boost::string_ref data, Clock::time_point now) {
+        std::vector<Segment> segments;
+        size_t offset = 0;
+        while (!is_reset_ && offset < data.size()) {
+            size_t size = data.size() - offset;
+            if (impairments_.max_segment_size > 0) {
+                std::uniform_int_distribution<size_t> segment_size(1, impairments_.max_segment_size);
+                size = std::min(size, segment_size(generator_));
+            }
+
+            // The link carries one segment at a time, each one occupies it for as long as its size takes
+            Clock::time_point sent_at = std::max(now, link_free_at_);
+            if (impairments_.bytes_per_second > 0) {
+                sent_at += std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(static_cast<double>(size) / impairments_.bytes_per_second));
+            }
+            link_free_at_ = sent_at;
+
+            Clock::duration delay = impairments_.latency;
+            if (impairments_.jitter.count() > 0) {
+                std::uniform_int_distribution<std::chrono::milliseconds::rep> jitter(0, impairments_.jitter.count());
+                delay += std::chrono::milliseconds(jitter(generator_));
+            }
+            last_delivery_ = std::max(sent_at + delay, last_delivery_);
+
+            if (impairments_.reset_probability > 0 &&
+                std::bernoulli_distribution(std::min(impairments_.reset_probability, 1.0))(generator_)) {
+                is_reset_ = true;
+                segments.push_back(Segment{ last_delivery_, std::string(), true });
+                break;
+            }
+            segments.push_back(Segment{ last_delivery_, std::string(data.data() + offset, size), false });
+            offset += size;
+        }
+        return segments;
+    }
+
+    // One proxied connection: the accepted client downstream, and a TCPClient to the service upstream
+    class ImpairmentProxy::Session {
+
+    public:
+        Session(ImpairmentProxy& proxy,
+                const TCPServerConnection::pointer& ptr_downstream,
+                std::mt19937::result_type to_server_seed,
+                std::mt19937::result_type to_client_seed) :
+            proxy_(proxy),
+            ptr_downstream_(ptr_downstream),
+            upstream_(proxy.io_service_, *this),
+            to_server_(proxy.io_service_, proxy.client_to_server_, to_server_seed),
+            to_client_(proxy.io_service_, proxy.server_to_client_, to_client_seed),
+            is_upstream_connected_(false),
+            is_upstream_closed_(false),
+            is_downstream_closed_(false) { }
+
+        void Start() {
+            upstream_.Connect(proxy_.upstream_host_, proxy_.upstream_service_);
+        }
+
+        void OnDownstreamRead(boost::string_ref bytes) {
+            Forward(to_server_, bytes);
+        }
+
+        void OnDownstreamClosed() {
+            if (is_downstream_closed_) {
+                return;
+            }
+            is_downstream_closed_ = true;
+            to_server_.is_source_closed = true;
+            Drop(to_client_);
+            MaybeFinish(to_server_);
+        }
+
+        void Close() {
+            Drop(to_server_);
+            Drop(to_client_);
+            CloseSink(to_server_);
+            CloseSink(to_client_);
+        }
+
+    private:
+        class Upstream : public TCPClient {
+
+        public:
+            Upstream(boost::asio::io_service& io_service, Session& session) :
+                TCPClient(io_service),
+                session_(session) { }
+
+        protected:
+            void OnConnect() override { session_.OnUpstreamConnected(); }
+
+            size_t OnReadView(boost::string_ref bytes) override {
+                session_.Forward(session_.to_client_, bytes);
+                return bytes.size();
+            }
+
+            void OnError(const boost::system::error_code& ec) override {
+                PHYRE_LOG(debug, ImpairmentProxy::kWho) << "Upstream: " << ec.message();
+            }
+
+            void OnDisconnect() override { session_.OnUpstreamClosed(); }
+
+        private:
+            Session& session_;
+        };
+
+        struct Direction {
+            Direction(boost::asio::io_service& io_service, const Impairments& impairments, std::mt19937::result_type seed) :
+                link(impairments, seed),
+                timer(io_service),
+                in_flight_bytes(0),
+                is_timer_armed(false),
+                is_source_paused(false),
+                is_source_closed(false) { }
+
+            ImpairedLink link;
+            std::deque<ImpairedLink::Segment> segments;
+            boost::asio::steady_timer timer;
+            size_t in_flight_bytes;
+            bool is_timer_armed;
+            bool is_source_paused;
+            bool is_source_closed;
+        };
+
+        bool is_to_server(const Direction& direction) const { return &direction == &to_server_; }
+
+        bool is_sink_closed(const Direction& direction) const {
+            return is_to_server(direction) ? is_upstream_closed_ : is_downstream_closed_;
+        }
+
+        void Forward(Direction& direction, boost::string_ref bytes) {
+            if (is_sink_closed(direction)) {
+                return;
+            }
+            for (ImpairedLink::Segment& segment : direction.link.Transmit(bytes)) {
+                direction.in_flight_bytes += segment.data.size();
+                direction.segments.push_back(std::move(segment));
+            }
+            if (!direction.is_source_paused && direction.in_flight_bytes > direction.link.impairments().max_in_flight_bytes) {
+                direction.is_source_paused = true;
+                if (is_to_server(direction)) {
+                    ptr_downstream_->PauseReading();
+                } else {
+                    upstream_.PauseReading();
+                }
+            }
+            ScheduleDelivery(direction);
+        }
+
+        void ScheduleDelivery(Direction& direction) {
+            if (direction.is_timer_armed || direction.segments.empty()) {
+                return;
+            }
+            direction.is_timer_armed = true;
+            direction.timer.expires_at(direction.segments.front().deliver_at);
+            direction.timer.async_wait([this, &direction](const boost::system::error_code& ec) {
+                direction.is_timer_armed = false;
+                if (!ec) {
+                    Deliver(direction);
+                }
+            });
+        }
+
+        void Deliver(Direction& direction) {
+            // Bytes from the client wait for the upstream connection, which picks them up once established
+            if (is_to_server(direction) && !is_upstream_connected_) {
+                return;
+            }
+            ImpairedLink::Clock::time_point now = ImpairedLink::Clock::now();
+            while (!direction.segments.empty() && direction.segments.front().deliver_at <= now) {
+                ImpairedLink::Segment segment = std::move(direction.segments.front());
+                direction.segments.pop_front();
+                if (segment.is_reset) {
+                    Reset();
+                    return;
+                }
+
+                size_t size = segment.data.size();
+                auto on_written = [this, &direction, size](const boost::system::error_code&, size_t) {
+                    OnWritten(direction, size);
+                };
+                if (is_to_server(direction)) {
+                    upstream_.Write(segment.data, on_written);
+                } else {
+                    ptr_downstream_->Write(segment.data, on_written);
+                }
+            }
+            ScheduleDelivery(direction);
+        }
+
+        void OnWritten(Direction& direction, size_t size) {
+            direction.in_flight_bytes -= std::min(size, direction.in_flight_bytes);
+            if (direction.is_source_paused && direction.in_flight_bytes <= direction.link.impairments().max_in_flight_bytes / 2) {
+                direction.is_source_paused = false;
+                if (is_to_server(direction)) {
+                    ptr_downstream_->ResumeReading();
+                } else {
+                    upstream_.ResumeReading();
+                }
+            }
+            MaybeFinish(direction);
+        }
+
+        // Passes a close on once everything sent before it has made it across
+        void MaybeFinish(Direction& direction) {
+            if (direction.is_source_closed && direction.segments.empty() && direction.in_flight_bytes == 0) {
+                CloseSink(direction);
+            }
+        }
+
+        // Whatever is still on the link will never arrive
+        void Drop(Direction& direction) {
+            for (const ImpairedLink::Segment& segment : direction.segments) {
+                direction.in_flight_bytes -= std::min(segment.data.size(), direction.in_flight_bytes);
+            }
+            direction.segments.clear();
+            boost::system::error_code ignored;
+            direction.timer.cancel(ignored);
+        }
+
+        void CloseSink(Direction& direction) {
+            if (is_sink_closed(direction)) {
+                return;
+            }
+            if (is_to_server(direction)) {
+                upstream_.Disconnect();
+            } else {
+                ptr_downstream_->Close();
+            }
+        }
+
+        void Reset() {
+            ++proxy_.resets_;
+            PHYRE_LOG(info, kWho) << "Resetting a connection";
+            // Lingering for no time at all makes the close send an RST rather than a FIN
+            boost::system::error_code ignored;
+            ptr_downstream_->socket().set_option(boost::asio::socket_base::linger(true, 0), ignored);
+            Close();
+        }
+
+        void OnUpstreamConnected() {
+            is_upstream_connected_ = true;
+            Deliver(to_server_);
+        }
+
+        void OnUpstreamClosed() {
+            if (is_upstream_closed_) {
+                return;
+            }
+            is_upstream_closed_ = true;
+            to_client_.is_source_closed = true;
+            Drop(to_server_);
+            MaybeFinish(to_client_);
+        }
+
+        ImpairmentProxy& proxy_;
+        TCPServerConnection::pointer ptr_downstream_;
+        Upstream upstream_;
+        Direction to_server_;
+        Direction to_client_;
+        bool is_upstream_connected_;
+        bool is_upstream_closed_;
+        bool is_downstream_closed_;
+    };
+
+    ImpairmentProxy::ImpairmentProxy(boost::asio::io_service& io_service,
+                                     uint16_t listen_port,
+                                     const std::string& upstream_host,
+                                     const std::string& upstream_service,
+                                     std::mt19937::result_type seed) :
+        io_service_(io_service),
+        server_(io_service, listen_port),
+        upstream_host_(upstream_host),
+        upstream_service_(upstream_service),
+        generator_(seed),
+        resets_(0) {
+        server_.set_on_accept_callback([this](const TCPServerConnection::pointer& connection) { HandleAccept(connection); });
+        server_.set_on_close_callback([this](const TCPServerConnection::pointer& connection) { HandleClose(connection); });
+        server_.set_on_read_callback([this](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            return HandleRead(connection, bytes);
+        });
+    }
+
+    ImpairmentProxy::~ImpairmentProxy() { }
+
+    void ImpairmentProxy::HandleAccept(const TCPServerConnection::pointer& connection) {
+        std::mt19937::result_type to_server_seed = generator_();
+        std::mt19937::result_type to_client_seed = generator_();
+        sessions_.push_back(std::make_unique<Session>(*this, connection, to_server_seed, to_client_seed));
+        live_sessions_[connection.get()] = sessions_.back().get();
+        sessions_.back()->Start();
+    }
+
+    void ImpairmentProxy::HandleClose(const TCPServerConnection::pointer& connection) {
+        auto it = live_sessions_.find(connection.get());
+        if (it == live_sessions_.end()) {
+            return;
+        }
+        Session* p_session = it->second;
+        live_sessions_.erase(it);
+        p_session->OnDownstreamClosed();
+    }
+
+    size_t ImpairmentProxy::HandleRead(const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+        auto it = live_sessions_.find(connection.get());
+        if (it != live_sessions_.end()) {
+            it->second->OnDownstreamRead(bytes);
+        }
+        return bytes.size();
+    }
+
+    void ImpairmentProxy::Stop() {
+        server_.Stop();
+        for (std::unique_ptr<Session>& ptr_session : sessions_) {
+            ptr_session->Close();
+        }
+    }
+
+}
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+#include "tcp_server.h"
+
+namespace Phyre {
+namespace Networking {
+
+// What an ImpairmentProxy does to the bytes going one way
+struct Impairments {
+    Impairments() :
+        latency(0),
+        jitter(0),
+        bytes_per_second(0),
+        max_segment_size(0),
+        reset_probability(0),
+        max_in_flight_bytes(256 * 1024) { }
+
+    // Every segment is delayed by the latency plus a uniform draw from [0, jitter].
+    // Segments still arrive in order, as they would over TCP, jitter only bunches them up.
+    std::chrono::milliseconds latency;
+    std::chrono::milliseconds jitter;
+
+    // The bandwidth of the link, 0 for unlimited
+    size_t bytes_per_second;
+
+    // Cuts the stream into segments of a uniform size in [1, max_segment_size], 0 to forward reads whole
+    size_t max_segment_size;
+
+    // The chance of each segment resetting the connection instead of arriving
+    double reset_probability;
+
+    // Reading from the sender pauses while this many bytes are on the link or being written,
+    // so backpressure reaches the sender the way a full receive window would
+    size_t max_in_flight_bytes;
+};
+
+// The schedule of one direction of an impaired connection. Given the same seed and the same
+// transmissions, it cuts and delays them the very same way, so a failing run can be replayed.
+class ImpairedLink {
+
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Segment {
+        Clock::time_point deliver_at;
+        std::string data;
+
+        // The connection is reset at this point instead, and nothing comes after it
+        bool is_reset;
+    };
+
+    ImpairedLink(const Impairments& impairments, std::mt19937::result_type seed);
+
+    // Cuts the data into segments and works out when each of them reaches the far end
+    std::vector<Segment> Transmit(boost::string_ref data, Clock::time_point now = Clock::now());
+
+    const Impairments& impairments() const { return impairments_; }
+    bool is_reset() const { return is_reset_; }
+
+private:
+    Impairments impairments_;
+    std::mt19937 generator_;
+    Clock::time_point link_free_at_;
+    Clock::time_point last_delivery_;
+    bool is_reset_;
+};
+
+/**
+* An in-process TCP proxy which forwards every accepted connection to an upstream service
+* over an impaired link: latency, jitter, a bandwidth cap, segmentation and random resets,
+* configured for each direction. Lets tests and benchmarks see how buffering, Nagle and
+* backpressure behave over a WAN without leaving loopback or reaching for external tools.
+* A reset aborts the client's connection with an RST and closes the upstream one.
+*
+* Every connection draws the seeds of its links from the proxy's seed in the order they
+* were accepted. Run the io_service on a single thread; connections are kept around until
+* the proxy is destroyed, which has to outlive the io_service's handlers like any TCPClient.
+*/
+class ImpairmentProxy {
+
+public:
+    ImpairmentProxy(boost::asio::io_service& io_service,
+                    uint16_t listen_port,
+                    const std::string& upstream_host,
+                    const std::string& upstream_service,
+                    std::mt19937::result_type seed);
+    ~ImpairmentProxy();
+
+    // Impairments of connections accepted from now on
+    void set_impairments(const Impairments& impairments) {
+        client_to_server_ = impairments;
+        server_to_client_ = impairments;
+    }
+    void set_client_to_server(const Impairments& impairments) { client_to_server_ = impairments; }
+    void set_server_to_client(const Impairments& impairments) { server_to_client_ = impairments; }
+
+    void StartAccept() { server_.StartAccept(); }
+
+    // Stops accepting and closes every connection
+    void Stop();
+
+    size_t connections() const { return sessions_.size(); }
+
+    // How many connections a reset was injected into
+    size_t resets() const { return resets_; }
+
+    StreamEndpoint local_endpoint() const { return server_.local_endpoint(); }
+
+private:
+    class Session;
+
+    void HandleAccept(const TCPServerConnection::pointer& connection);
+    void HandleClose(const TCPServerConnection::pointer& connection);
+    size_t HandleRead(const TCPServerConnection::pointer& connection, boost::string_ref bytes);
+
+    boost::asio::io_service& io_service_;
+    TCPServer server_;
+    std::string upstream_host_;
+    std::string upstream_service_;
+    std::mt19937 generator_;
+    Impairments client_to_server_;
+    Impairments server_to_client_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+    std::map<const TCPServerConnection*, Session*> live_sessions_;
+    size_t resets_;
+
+    static const std::string kWho;
+};
+
+}
+}
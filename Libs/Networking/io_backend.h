@@ -0,0 +1,26 @@
+#pragma once
+#include <boost/asio/detail/config.hpp>
+
+namespace Phyre {
+namespace Networking {
+
+// The name of the reactor every io_service of this build runs on.
+// io_uring is opted into with the PHYRE_IO_URING build option, otherwise Boost.Asio picks the platform default.
+inline const char* IOBackendName() {
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+    return "io_uring";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+    return "iocp";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+    return "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+    return "kqueue";
+#elif defined(BOOST_ASIO_HAS_DEV_POLL)
+    return "/dev/poll";
+#else
+    return "select";
+#endif
+}
+
+}
+}
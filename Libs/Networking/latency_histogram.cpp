@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cmath>
+#include "latency_histogram.h"
+
+namespace Phyre {
+namespace Networking {
+
+    const uint32_t LatencyHistogram::kSubBucketBits;
+    const uint32_t LatencyHistogram::kSubBuckets;
+    const uint32_t LatencyHistogram::kMaxExponent;
+    const uint32_t LatencyHistogram::kBucketCount;
+
+    namespace {
+        void UpdateMax(std::atomic<uint64_t>& max, uint64_t value) {
+            uint64_t current = max.load(std::memory_order_relaxed);
+            while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+        }
+
+        uint32_t HighestBit(uint64_t value) {
+            uint32_t bit = 0;
+            while (value >>= 1) {
+                ++bit;
+            }
+            return bit;
+        }
+    }
+
+    LatencyHistogram::LatencyHistogram() : count_(0), sum_(0), max_(0) {
+        for (std::atomic<uint64_t>& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t LatencyHistogram::BucketIndex(uint64_t value) {
+        // Small values are counted exactly
+        if (value < kSubBuckets) {
+            return static_cast<uint32_t>(value);
+        }
+
+        uint32_t exponent = HighestBit(value);
+        if (exponent > kMaxExponent) {
+            return kBucketCount - 1;
+        }
+        uint32_t sub_bucket = static_cast<uint32_t>(value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+        return (exponent - kSubBucketBits + 1) * kSubBuckets + sub_bucket;
+    }
+
+    uint64_t LatencyHistogram::BucketUpperBound(uint32_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        uint32_t exponent = index / kSubBuckets + kSubBucketBits - 1;
+        uint64_t sub_bucket = index % kSubBuckets;
+        return ((kSubBuckets + sub_bucket + 1) << (exponent - kSubBucketBits)) - 1;
+    }
+
+    void LatencyHistogram::Record(std::chrono::microseconds latency) {
+        uint64_t value = static_cast<uint64_t>(std::max<std::chrono::microseconds::rep>(latency.count(), 0));
+        buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        UpdateMax(max_, value);
+    }
+
+    void LatencyHistogram::Merge(const LatencyHistogram& other) {
+        for (uint32_t i = 0; i < kBucketCount; ++i) {
+            buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        count_.fetch_add(other.count(), std::memory_order_relaxed);
+        sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        UpdateMax(max_, other.max_.load(std::memory_order_relaxed));
+    }
+
+    std::chrono::microseconds LatencyHistogram::Percentile(double percentile) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return std::chrono::microseconds(0);
+        }
+
+        double clamped = std::min(std::max(percentile, 0.0), 100.0);
+        uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(clamped / 100.0 * total)), 1);
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < kBucketCount; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                // A bucket's upper bound may overshoot the largest sample actually recorded
+                uint64_t value = std::min(BucketUpperBound(i), max_.load(std::memory_order_relaxed));
+                return std::chrono::microseconds(value);
+            }
+        }
+        return max();
+    }
+
+    std::chrono::microseconds LatencyHistogram::mean() const {
+        uint64_t total = count();
+        if (total == 0) {
+            return std::chrono::microseconds(0);
+        }
+        return std::chrono::microseconds(sum_.load(std::memory_order_relaxed) / total);
+    }
+
+}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace Phyre {
+namespace Networking {
+
+// A lock free, fixed size latency histogram in the spirit of HdrHistogram.
+// Values are recorded in microseconds into log-linear buckets: every power of two
+// is split into kSubBuckets linear buckets, which bounds the relative error of a
+// reported percentile to 1 / kSubBuckets regardless of the magnitude of the value.
+// Recording is a couple of relaxed atomic increments, so any thread may record
+// or read concurrently; readers get a consistent enough view for monitoring.
+class LatencyHistogram {
+
+public:
+    static const uint32_t kSubBucketBits = 4;
+    static const uint32_t kSubBuckets = 1 << kSubBucketBits;
+
+    // Anything slower than 2^kMaxExponent microseconds (about 12 days) lands in the last bucket
+    static const uint32_t kMaxExponent = 40;
+    static const uint32_t kBucketCount = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+    LatencyHistogram();
+
+    void Record(std::chrono::microseconds latency);
+
+    // Adds every sample of other to this histogram
+    void Merge(const LatencyHistogram& other);
+
+    // @return The smallest latency which at least percentile percent of the samples did not exceed,
+    // or zero if nothing was recorded
+    std::chrono::microseconds Percentile(double percentile) const;
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    std::chrono::microseconds max() const { return std::chrono::microseconds(max_.load(std::memory_order_relaxed)); }
+    std::chrono::microseconds mean() const;
+
+    static uint32_t BucketIndex(uint64_t value);
+
+    // The largest value which maps to the bucket at index
+    static uint64_t BucketUpperBound(uint32_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+}
+}
@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <cstring>
+#include "receive_buffer.h"
+
+namespace Phyre {
+namespace Networking {
+
+    const size_t ReceiveBuffer::kDefaultInitialCapacity;
+    const size_t ReceiveBuffer::kDefaultMaxCapacity;
+
+    ReceiveBuffer::ReceiveBuffer(size_t initial_capacity, size_t max_capacity) :
+        storage_(std::max<size_t>(1, std::min(initial_capacity, max_capacity))),
+        read_index_(0),
+        write_index_(0),
+        max_capacity_(std::max(initial_capacity, max_capacity)),
+        prepared_(0),
+        should_grow_(false) { }
+
+    boost::asio::mutable_buffers_1 ReceiveBuffer::Prepare() {
+        if (empty()) {
+            read_index_ = 0;
+            write_index_ = 0;
+        }
+
+        bool is_full = write_index_ == capacity();
+        if (is_full || should_grow_) {
+            Compact();
+
+            // Compacting alone is enough if it freed up at least half of the window
+            bool is_crowded = size() > capacity() / 2;
+            if ((is_crowded || should_grow_) && capacity() < max_capacity_) {
+                storage_.resize(std::min(capacity() * 2, max_capacity_));
+            }
+            should_grow_ = false;
+        }
+
+        prepared_ = capacity() - write_index_;
+        return boost::asio::buffer(storage_.data() + write_index_, prepared_);
+    }
+
+    void ReceiveBuffer::Commit(size_t bytes) {
+        bytes = std::min(bytes, capacity() - write_index_);
+        write_index_ += bytes;
+        should_grow_ = bytes > 0 && bytes == prepared_;
+    }
+
+    void ReceiveBuffer::Consume(size_t bytes) {
+        read_index_ += std::min(bytes, size());
+    }
+
+    void ReceiveBuffer::Compact() {
+        if (read_index_ == 0) {
+            return;
+        }
+        std::memmove(storage_.data(), storage_.data() + read_index_, size());
+        write_index_ -= read_index_;
+        read_index_ = 0;
+    }
+
+}
+}
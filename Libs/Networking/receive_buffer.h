@@ -0,0 +1,58 @@
+#pragma once
+#include <boost/asio/buffer.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <vector>
+
+namespace Phyre {
+namespace Networking {
+
+// A growable receive window for a stream socket.
+// Reads are committed after the bytes which have not been consumed yet, so that
+// protocol layers can parse messages in place and leave partial ones for the next read.
+// The window doubles whenever a read fills all of the free space, up to max_capacity,
+// and consumed bytes are reclaimed by compacting the readable bytes to the front.
+class ReceiveBuffer {
+
+public:
+    static const size_t kDefaultInitialCapacity = 4096;
+    static const size_t kDefaultMaxCapacity = 1024 * 1024;
+
+    explicit ReceiveBuffer(size_t initial_capacity = kDefaultInitialCapacity,
+                           size_t max_capacity = kDefaultMaxCapacity);
+
+    // @return The free space to read into.
+    // The buffer is empty if the window has reached max_capacity without any bytes being consumed.
+    boost::asio::mutable_buffers_1 Prepare();
+
+    // Makes bytes which were read into the prepared space readable
+    void Commit(size_t bytes);
+
+    // Discards bytes from the front of the readable bytes
+    void Consume(size_t bytes);
+
+    // @return The readable bytes, valid until the next call to Prepare
+    boost::string_ref data() const { return boost::string_ref(storage_.data() + read_index_, size()); }
+
+    size_t size() const { return write_index_ - read_index_; }
+    size_t capacity() const { return storage_.size(); }
+    size_t max_capacity() const { return max_capacity_; }
+    bool empty() const { return size() == 0; }
+
+private:
+    void Compact();
+
+    std::vector<char> storage_;
+    size_t read_index_;
+    size_t write_index_;
+    size_t max_capacity_;
+
+    // The size of the most recently prepared space
+    size_t prepared_;
+
+    // Set when the last read filled all of the prepared space,
+    // a hint that the kernel likely had more to give
+    bool should_grow_;
+};
+
+}
+}
@@ -0,0 +1,29 @@
+#include <cmath>
+#include "reconnect_policy.h"
+
+namespace Phyre {
+namespace Networking {
+
+    ReconnectBackoff::ReconnectBackoff(const ReconnectPolicy& policy) :
+        ReconnectBackoff(policy, std::random_device()()) { }
+
+    ReconnectBackoff::ReconnectBackoff(const ReconnectPolicy& policy, std::mt19937::result_type seed) :
+        policy_(policy),
+        generator_(seed),
+        attempts_(0) { }
+
+    std::chrono::milliseconds ReconnectBackoff::ceiling() const {
+        // Computed in floating point, since the exponential overflows any integer long before attempts do
+        double ceiling = static_cast<double>(policy_.initial_delay.count()) * std::pow(policy_.multiplier, static_cast<double>(attempts_));
+        double max_delay = static_cast<double>(policy_.max_delay.count());
+        return std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(std::min(ceiling, max_delay)));
+    }
+
+    std::chrono::milliseconds ReconnectBackoff::NextDelay() {
+        std::uniform_int_distribution<std::chrono::milliseconds::rep> distribution(0, ceiling().count());
+        ++attempts_;
+        return std::chrono::milliseconds(distribution(generator_));
+    }
+
+}
+}
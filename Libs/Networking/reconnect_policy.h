@@ -0,0 +1,64 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <random>
+
+namespace Phyre {
+namespace Networking {
+
+// How a TCPClient gets back on its feet after losing its connection, see TCPClient::set_reconnect_policy
+struct ReconnectPolicy {
+    // A max_attempts of 0 keeps trying forever.
+    // Up to max_buffered_bytes of writes issued while reconnecting are held back and
+    // flushed once the session is resumed; 0 fails them right away with not_connected.
+    ReconnectPolicy(std::chrono::milliseconds initial = std::chrono::milliseconds(100),
+                    std::chrono::milliseconds max = std::chrono::seconds(30),
+                    double backoff_multiplier = 2.0,
+                    size_t attempts = 0,
+                    size_t buffered_bytes = 64 * 1024) :
+        initial_delay(initial),
+        max_delay(std::max(initial, max)),
+        multiplier(std::max(backoff_multiplier, 1.0)),
+        max_attempts(attempts),
+        max_buffered_bytes(buffered_bytes) { }
+
+    std::chrono::milliseconds initial_delay;
+    std::chrono::milliseconds max_delay;
+    double multiplier;
+    size_t max_attempts;
+    size_t max_buffered_bytes;
+};
+
+// Exponential backoff with full jitter: the n-th delay is drawn uniformly from
+// [0, min(max_delay, initial_delay * multiplier^n)]. Without the jitter, every client
+// dropped by the same server restart would come back in lockstep, again and again.
+// Every backoff draws from a generator of its own, seeded randomly unless told otherwise.
+class ReconnectBackoff {
+
+public:
+    explicit ReconnectBackoff(const ReconnectPolicy& policy = ReconnectPolicy());
+    ReconnectBackoff(const ReconnectPolicy& policy, std::mt19937::result_type seed);
+
+    // The delay before the next attempt, which counts as made from then on
+    std::chrono::milliseconds NextDelay();
+
+    // Starts over from the initial delay, once a connection succeeded
+    void Reset() { attempts_ = 0; }
+
+    // The upper bound of the next delay
+    std::chrono::milliseconds ceiling() const;
+
+    // Whether the policy allows another attempt
+    bool is_exhausted() const { return policy_.max_attempts > 0 && attempts_ >= policy_.max_attempts; }
+    size_t attempts() const { return attempts_; }
+    const ReconnectPolicy& policy() const { return policy_; }
+
+private:
+    ReconnectPolicy policy_;
+    std::mt19937 generator_;
+    size_t attempts_;
+};
+
+}
+}
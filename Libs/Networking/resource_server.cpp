@@ -0,0 +1,121 @@
+#include <boost/lexical_cast.hpp>
+#include <sstream>
+#include <Logging/logging.h>
+#include "resource_server.h"
+
+namespace Phyre {
+namespace Networking {
+
+    const std::string ResourceServer::kWho = "[ResourceServer]";
+
+    namespace {
+        bool ParseOffset(const std::string& text, uint64_t& offset) {
+            if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+                return false;
+            }
+            try {
+                offset = boost::lexical_cast<uint64_t>(text);
+            } catch (const boost::bad_lexical_cast&) {
+                return false;
+            }
+            return true;
+        }
+    }
+
+    ResourceServer::ResourceServer(boost::asio::io_service& io_service,
+                                   uint16_t listen_port,
+                                   Configuration::Provider::Pointer ptr_provider) :
+        server_(io_service, listen_port),
+        ptr_provider_(ptr_provider) {
+        server_.set_on_read_callback([this](const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+            return HandleRead(connection, bytes);
+        });
+    }
+
+    bool ResourceServer::ParseRange(const std::string& range_spec, uint64_t size, FileRange& range) {
+        size_t separator = range_spec.find('-');
+        if (separator == std::string::npos) {
+            return false;
+        }
+        std::string first_text = range_spec.substr(0, separator);
+        std::string last_text = range_spec.substr(separator + 1);
+
+        uint64_t first = 0;
+        uint64_t last = 0;
+        if (first_text.empty()) {
+            // The last bytes of the resource
+            if (!ParseOffset(last_text, last) || last == 0 || size == 0) {
+                return false;
+            }
+            range.length = std::min(last, size);
+            range.offset = size - range.length;
+            return true;
+        }
+
+        if (!ParseOffset(first_text, first) || first >= size) {
+            return false;
+        }
+        if (last_text.empty()) {
+            last = size - 1;
+        } else if (!ParseOffset(last_text, last) || last < first) {
+            return false;
+        }
+        range.offset = first;
+        range.length = std::min(last, size - 1) - first + 1;
+        return true;
+    }
+
+    size_t ResourceServer::HandleRead(const TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+        size_t consumed = 0;
+        for (size_t end = bytes.find('\n'); end != boost::string_ref::npos; end = bytes.substr(consumed).find('\n')) {
+            std::string request(bytes.data() + consumed, end);
+            consumed += end + 1;
+            if (!request.empty() && request.back() == '\r') {
+                request.pop_back();
+            }
+            if (!request.empty()) {
+                HandleRequest(connection, request);
+            }
+        }
+
+        if (bytes.size() - consumed > kMaxRequestSize) {
+            PHYRE_LOG(warning, kWho) << "Closing a connection which sent a request of more than " << kMaxRequestSize << " bytes";
+            connection->Close();
+            return bytes.size();
+        }
+        return consumed;
+    }
+
+    void ResourceServer::HandleRequest(const TCPServerConnection::pointer& connection, const std::string& request) {
+        std::istringstream request_stream(request);
+        std::string method, application, resource, range_spec, extra;
+        request_stream >> method >> application >> resource >> range_spec >> extra;
+        if (method != "GET" || resource.empty() || !extra.empty()) {
+            connection->Write("ERROR bad-request\r\n");
+            return;
+        }
+
+        std::string path = ptr_provider_->GetResourcePath(application, resource);
+        boost::system::error_code ec;
+        SendableFile::pointer ptr_file = path.empty() ? SendableFile::pointer() : SendableFile::Open(path, ec);
+        if (!ptr_file) {
+            PHYRE_LOG(debug, kWho) << "No resource " << resource << " of " << application << (ec ? ": " + ec.message() : std::string());
+            connection->Write("ERROR not-found\r\n");
+            return;
+        }
+
+        FileRange range(0, ptr_file->size());
+        if (!range_spec.empty() && !ParseRange(range_spec, ptr_file->size(), range)) {
+            connection->Write("ERROR range-not-satisfiable\r\n");
+            return;
+        }
+
+        PHYRE_LOG(debug, kWho) << "Serving " << range.length << " bytes of " << path << " from offset " << range.offset;
+        std::ostringstream header;
+        header << "OK " << range.offset << ' ' << range.length << ' ' << ptr_file->size() << "\r\n";
+        connection->Write(header.str());
+        connection->WriteFile(ptr_file, range);
+    }
+
+}
+}
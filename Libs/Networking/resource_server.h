@@ -0,0 +1,56 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <Configuration/provider.h>
+#include "sendable_file.h"
+#include "tcp_server.h"
+
+namespace Phyre {
+namespace Networking {
+
+/**
+* Serves the resources applications list in phyre.json, e.g. shaders, XML fixtures and assets,
+* to remote tools. Resources are streamed with sendfile, so large files never pass through
+* user space, and only what an application lists can be fetched.
+*
+* Clients send one request per line, which are answered in order:
+*     GET <application> <resource> [<range>]\r\n
+* where the optional range is first-last (inclusive), first- or -suffix_length in bytes,
+* as in an HTTP Range header. The answer is either
+*     OK <offset> <length> <size>\r\n followed by exactly length bytes of the resource, or
+*     ERROR <reason>\r\n with bad-request, not-found or range-not-satisfiable as the reason.
+*/
+class ResourceServer {
+
+public:
+    ResourceServer(boost::asio::io_service& io_service,
+                   uint16_t listen_port,
+                   Configuration::Provider::Pointer ptr_provider);
+
+    void StartAccept() { server_.StartAccept(); }
+
+    // See TCPServer::Run
+    void Run(size_t worker_count = 0) { server_.Run(worker_count); }
+    void Stop() { server_.Stop(); }
+
+    // For anything beyond the defaults, e.g. TLS, timeouts or write limits
+    TCPServer& server() { return server_; }
+
+    // Resolves a range as it is given in a request against a resource of the given size
+    // @return false if the range is malformed or not within the resource
+    static bool ParseRange(const std::string& range_spec, uint64_t size, FileRange& range);
+
+    // Longer requests are turned down and the connection is closed
+    static const size_t kMaxRequestSize = 1024;
+
+private:
+    size_t HandleRead(const TCPServerConnection::pointer& connection, boost::string_ref bytes);
+    void HandleRequest(const TCPServerConnection::pointer& connection, const std::string& request);
+
+    TCPServer server_;
+    Configuration::Provider::Pointer ptr_provider_;
+
+    static const std::string kWho;
+};
+
+}
+}
@@ -0,0 +1,117 @@
+#include "sendable_file.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(PHYRE_HAS_SENDFILE)
+#include <sys/sendfile.h>
+#endif
+
+namespace Phyre {
+namespace Networking {
+
+    SendableFile::SendableFile(const std::string& path, uint64_t size) :
+        path_(path),
+        size_(size)
+#if !defined(_WIN32)
+        , file_descriptor_(-1)
+#endif
+    { }
+
+#if defined(_WIN32)
+    SendableFile::pointer SendableFile::Open(const std::string& path, boost::system::error_code& ec) {
+        ec.clear();
+        std::ifstream stream(path, std::ifstream::binary | std::ifstream::ate);
+        if (!stream) {
+            ec = boost::system::errc::make_error_code(boost::system::errc::no_such_file_or_directory);
+            return pointer();
+        }
+        pointer ptr_file(new SendableFile(path, static_cast<uint64_t>(stream.tellg())));
+        ptr_file->stream_ = std::move(stream);
+        return ptr_file;
+    }
+
+    SendableFile::~SendableFile() { }
+
+    size_t SendableFile::Read(uint64_t offset, boost::asio::mutable_buffer buffer, boost::system::error_code& ec) const {
+        ec.clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        stream_.clear();
+        stream_.seekg(static_cast<std::streamoff>(offset));
+        stream_.read(boost::asio::buffer_cast<char*>(buffer), static_cast<std::streamsize>(boost::asio::buffer_size(buffer)));
+        size_t read = static_cast<size_t>(stream_.gcount());
+        if (read == 0 && boost::asio::buffer_size(buffer) > 0) {
+            ec = boost::asio::error::eof;
+        }
+        return read;
+    }
+#else
+    SendableFile::pointer SendableFile::Open(const std::string& path, boost::system::error_code& ec) {
+        ec.clear();
+        int flags = O_RDONLY;
+#if defined(O_CLOEXEC)
+        flags |= O_CLOEXEC;
+#endif
+        int file_descriptor = ::open(path.c_str(), flags);
+        if (file_descriptor < 0) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return pointer();
+        }
+        struct stat status;
+        if (::fstat(file_descriptor, &status) != 0 || !S_ISREG(status.st_mode)) {
+            ec = boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+            ::close(file_descriptor);
+            return pointer();
+        }
+
+        pointer ptr_file(new SendableFile(path, static_cast<uint64_t>(status.st_size)));
+        ptr_file->file_descriptor_ = file_descriptor;
+        return ptr_file;
+    }
+
+    SendableFile::~SendableFile() {
+        if (file_descriptor_ >= 0) {
+            ::close(file_descriptor_);
+        }
+    }
+
+    size_t SendableFile::Read(uint64_t offset, boost::asio::mutable_buffer buffer, boost::system::error_code& ec) const {
+        ec.clear();
+        ssize_t read = ::pread(file_descriptor_, boost::asio::buffer_cast<void*>(buffer),
+                               boost::asio::buffer_size(buffer), static_cast<off_t>(offset));
+        if (read < 0) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return 0;
+        }
+        if (read == 0 && boost::asio::buffer_size(buffer) > 0) {
+            ec = boost::asio::error::eof;
+        }
+        return static_cast<size_t>(read);
+    }
+#endif
+
+#if defined(PHYRE_HAS_SENDFILE)
+    size_t SendableFile::SendTo(StreamSocket& socket, uint64_t offset, uint64_t length, boost::system::error_code& ec) const {
+        ec.clear();
+        // A single call moves at most this much on Linux anyway
+        static const uint64_t kMaxSendSize = 0x7ffff000;
+        off_t file_offset = static_cast<off_t>(offset);
+        ssize_t sent = ::sendfile(socket.native_handle(), file_descriptor_, &file_offset,
+                                  static_cast<size_t>(std::min(length, kMaxSendSize)));
+        if (sent < 0) {
+            int error = errno == EAGAIN ? EWOULDBLOCK : errno;
+            ec = boost::system::error_code(error, boost::system::system_category());
+            return 0;
+        }
+        if (sent == 0 && length > 0) {
+            // The file shrank since it was opened
+            ec = boost::asio::error::eof;
+        }
+        return static_cast<size_t>(sent);
+    }
+#endif
+
+}
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "stream_socket.h"
+
+// sendfile(2) only takes a socket as its destination on Linux, elsewhere files are copied through user space
+#if defined(__linux__)
+#define PHYRE_HAS_SENDFILE 1
+#endif
+
+#if defined(_WIN32)
+#include <fstream>
+#include <mutex>
+#endif
+
+namespace Phyre {
+namespace Networking {
+
+// The bytes [offset, offset + length) of a file
+struct FileRange {
+    FileRange(uint64_t first = 0, uint64_t count = 0) : offset(first), length(count) { }
+
+    uint64_t offset;
+    uint64_t length;
+};
+
+// A regular file opened for reading, which connections stream to their peers, see TCPServerConnection::WriteFile.
+// Every write of it shares the one descriptor, which is closed once the last of them is done.
+class SendableFile {
+
+public:
+    typedef std::shared_ptr<SendableFile> pointer;
+
+    // @return null, with ec telling why, if the file cannot be opened or is not a regular file
+    static pointer Open(const std::string& path, boost::system::error_code& ec);
+
+    ~SendableFile();
+    SendableFile(const SendableFile&) = delete;
+    SendableFile& operator=(const SendableFile&) = delete;
+
+    // The size when the file was opened
+    uint64_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+
+    // Copies from the file into the buffer, for streams sendfile cannot write to, e.g. TLS ones.
+    // Fails with eof at the end of the file.
+    size_t Read(uint64_t offset, boost::asio::mutable_buffer buffer, boost::system::error_code& ec) const;
+
+#if defined(PHYRE_HAS_SENDFILE)
+    // Has the kernel send straight from the page cache, the bytes never pass through user space.
+    // The socket has to be in non-blocking mode; fails with would_block instead of blocking.
+    size_t SendTo(StreamSocket& socket, uint64_t offset, uint64_t length, boost::system::error_code& ec) const;
+#endif
+
+private:
+    SendableFile(const std::string& path, uint64_t size);
+
+    std::string path_;
+    uint64_t size_;
+#if defined(_WIN32)
+    mutable std::ifstream stream_;
+    mutable std::mutex mutex_;
+#else
+    int file_descriptor_;
+#endif
+};
+
+// How much is copied through user space at a time, or sent per wake-up, so that a large
+// file does not keep the other connections of the io_service waiting
+static const size_t kFileChunkSize = 256 * 1024;
+
+namespace detail {
+
+template <typename AsyncWriteStream, typename Handler>
+void CopyFileChunks(AsyncWriteStream& stream,
+                    SendableFile::pointer ptr_file,
+                    FileRange range,
+                    std::shared_ptr<std::vector<char>> ptr_chunk,
+                    uint64_t transferred,
+                    Handler handler) {
+    size_t size = static_cast<size_t>(std::min<uint64_t>(ptr_chunk->size(), range.length - transferred));
+    boost::system::error_code ec;
+    size_t read = ptr_file->Read(range.offset + transferred, boost::asio::buffer(ptr_chunk->data(), size), ec);
+    if (ec) {
+        // Reported through an empty write, so that the handler never runs from within this call
+        boost::asio::async_write(stream, boost::asio::buffer(ptr_chunk->data(), 0),
+            [ec, transferred, handler](const boost::system::error_code&, size_t) mutable {
+                handler(ec, static_cast<size_t>(transferred));
+            });
+        return;
+    }
+
+    AsyncWriteStream* p_stream = &stream;
+    boost::asio::async_write(stream, boost::asio::buffer(ptr_chunk->data(), read),
+        [p_stream, ptr_file, range, ptr_chunk, transferred, handler](const boost::system::error_code& write_ec, size_t written) mutable {
+            uint64_t total = transferred + written;
+            if (write_ec || total == range.length) {
+                handler(write_ec, static_cast<size_t>(total));
+                return;
+            }
+            CopyFileChunks(*p_stream, std::move(ptr_file), range, std::move(ptr_chunk), total, std::move(handler));
+        });
+}
+
+#if defined(PHYRE_HAS_SENDFILE)
+template <typename Handler>
+void SendFileChunks(StreamSocket& socket, SendableFile::pointer ptr_file, FileRange range, uint64_t transferred, Handler handler) {
+    StreamSocket* p_socket = &socket;
+    AsyncWaitWritable(socket, [p_socket, ptr_file, range, transferred, handler](const boost::system::error_code& wait_ec) mutable {
+        if (wait_ec) {
+            handler(wait_ec, static_cast<size_t>(transferred));
+            return;
+        }
+        uint64_t sent_now = 0;
+        while (transferred < range.length && sent_now < kFileChunkSize) {
+            boost::system::error_code ec;
+            size_t sent = ptr_file->SendTo(*p_socket, range.offset + transferred, range.length - transferred, ec);
+            if (ec == boost::asio::error::would_block) {
+                break;
+            }
+            if (ec) {
+                handler(ec, static_cast<size_t>(transferred));
+                return;
+            }
+            transferred += sent;
+            sent_now += sent;
+        }
+        if (transferred == range.length) {
+            handler(boost::system::error_code(), static_cast<size_t>(transferred));
+            return;
+        }
+        SendFileChunks(*p_socket, std::move(ptr_file), range, transferred, std::move(handler));
+    });
+}
+#endif
+
+}
+
+// Writes the range of the file to any stream, a chunk at a time through user space.
+// handler(ec, bytes_transferred) is invoked once done, like for async_write. The range must not be empty.
+template <typename AsyncWriteStream, typename Handler>
+void AsyncCopyFile(AsyncWriteStream& stream, SendableFile::pointer ptr_file, FileRange range, Handler handler) {
+    auto ptr_chunk = std::make_shared<std::vector<char>>(static_cast<size_t>(std::min<uint64_t>(kFileChunkSize, range.length)));
+    detail::CopyFileChunks(stream, std::move(ptr_file), range, std::move(ptr_chunk), 0, std::move(handler));
+}
+
+// Writes the range of the file to the socket with sendfile, or copies it where that is not available.
+// handler(ec, bytes_transferred) is invoked once done, like for async_write. The range must not be empty.
+template <typename Handler>
+void AsyncSendFile(StreamSocket& socket, SendableFile::pointer ptr_file, FileRange range, Handler handler) {
+#if defined(PHYRE_HAS_SENDFILE)
+    // Asio's own asynchronous operations cope with either mode, sendfile only returns early in this one
+    boost::system::error_code ec;
+    socket.native_non_blocking(true, ec);
+    if (ec) {
+        AsyncCopyFile(socket, std::move(ptr_file), range, std::move(handler));
+        return;
+    }
+    detail::SendFileChunks(socket, std::move(ptr_file), range, 0, std::move(handler));
+#else
+    AsyncCopyFile(socket, std::move(ptr_file), range, std::move(handler));
+#endif
+}
+
+}
+}
@@ -0,0 +1,110 @@
+#include <boost/thread/thread.hpp>
+#include <Logging/logging.h>
+#include "sharded_tcp_server.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace Phyre {
+namespace Networking {
+
+    const std::string ShardedTCPServer::kWho = "[ShardedTCPServer]";
+
+    ShardedTCPServer::ShardedTCPServer(uint16_t listen_port,
+                                       size_t shard_count,
+                                       const std::queue<std::string>& message_queue) :
+        is_pinned_(false)
+    {
+        if (shard_count == 0) {
+            shard_count = std::max(1u, boost::thread::hardware_concurrency());
+        }
+#if !defined(SO_REUSEPORT)
+        PHYRE_LOG(warning, kWho) << "SO_REUSEPORT is not supported on this platform, serving from a single shard";
+        shard_count = 1;
+#endif
+
+        for (size_t i = 0; i < shard_count; ++i) {
+            ptr_io_services_.push_back(std::make_unique<boost::asio::io_service>(1));
+            ptr_servers_.push_back(std::make_unique<TCPServer>(*ptr_io_services_.back(), listen_port, message_queue, shard_count > 1));
+            // Otherwise each shard would bind an ephemeral port of its own, so the others join the first one's
+            if (listen_port == 0) {
+                listen_port = ToTCPEndpoint(ptr_servers_.back()->local_endpoint()).port();
+            }
+        }
+    }
+
+    void ShardedTCPServer::Configure(const ConfigureCallback& configure) {
+        for (std::unique_ptr<TCPServer>& ptr_server : ptr_servers_) {
+            configure(*ptr_server);
+        }
+    }
+
+    void ShardedTCPServer::Run() {
+        PHYRE_LOG(info, kWho) << "Serving from " << shard_count() << " shard(s)";
+
+        boost::thread_group workers;
+        for (size_t i = 0; i < shard_count(); ++i) {
+            TCPServer* p_server = ptr_servers_[i].get();
+            boost::asio::io_service* p_io_service = ptr_io_services_[i].get();
+            bool is_pinned = is_pinned_;
+            workers.create_thread([i, p_server, p_io_service, is_pinned]() {
+                if (is_pinned) {
+                    PinToCpu(i % std::max(1u, boost::thread::hardware_concurrency()));
+                }
+                p_server->StartAccept();
+                p_io_service->run();
+            });
+        }
+        workers.join_all();
+    }
+
+    void ShardedTCPServer::Stop() {
+        // Each shard is only ever touched from its own thread
+        for (size_t i = 0; i < shard_count(); ++i) {
+            TCPServer* p_server = ptr_servers_[i].get();
+            ptr_io_services_[i]->post([p_server]() { p_server->Stop(); });
+        }
+    }
+
+    size_t ShardedTCPServer::connection_count() const {
+        size_t count = 0;
+        for (const std::unique_ptr<TCPServer>& ptr_server : ptr_servers_) {
+            count += ptr_server->connection_count();
+        }
+        return count;
+    }
+
+    size_t ShardedTCPServer::Broadcast(const WriteQueue::SharedBuffer& ptr_payload,
+                                       const ConnectionRegistry::OnDeliveredCallback& on_delivered,
+                                       const ConnectionRegistry::Filter& filter) {
+        size_t recipients = 0;
+        for (std::unique_ptr<TCPServer>& ptr_server : ptr_servers_) {
+            recipients += ptr_server->Broadcast(ptr_payload, on_delivered, filter);
+        }
+        return recipients;
+    }
+
+    void ShardedTCPServer::PinToCpu(size_t cpu) {
+#if defined(__linux__)
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+        if (error) {
+            PHYRE_LOG(warning, kWho) << "Failed to pin a shard to CPU " << cpu << ": " << error;
+        }
+#elif defined(_WIN32)
+        if (!SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu)) {
+            PHYRE_LOG(warning, kWho) << "Failed to pin a shard to CPU " << cpu << ": " << GetLastError();
+        }
+#else
+        PHYRE_LOG(debug, kWho) << "Thread affinity is not supported on this platform, not pinning to CPU " << cpu;
+#endif
+    }
+
+}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "tcp_server.h"
+
+namespace Phyre {
+namespace Networking {
+
+// Serves a port from several shards which share nothing: each shard is a TCPServer
+// with its own SO_REUSEPORT listener, io_service, connection registry and worker thread.
+// The kernel balances accepts across the listeners, and a connection stays on the
+// thread which accepted it for its whole lifetime, so there is no cross thread hand-off
+// and no lock shared by all connections. Where SO_REUSEPORT is not available, a single shard is used.
+class ShardedTCPServer {
+
+public:
+    typedef std::function<void(TCPServer&)> ConfigureCallback;
+
+    // A shard_count of 0 uses one shard per hardware thread.
+    // A listen_port of 0 picks an ephemeral port which every shard listens on, see local_endpoint.
+    ShardedTCPServer(uint16_t listen_port,
+                     size_t shard_count = 0,
+                     const std::queue<std::string>& message_queue = std::queue<std::string>());
+
+    // Applies the same configuration to every shard, e.g. a read callback or timeouts. Call before Run.
+    // Callbacks handed to the shards run on several threads at once.
+    void Configure(const ConfigureCallback& configure);
+
+    // Pins the thread of shard i to CPU i, modulo the number of CPUs. Set before Run.
+    // Ignored on platforms which do not support thread affinity.
+    void set_cpu_affinity(bool is_pinned) { is_pinned_ = is_pinned; }
+
+    // Runs every shard on a thread of its own.
+    // Blocks until all shards run out of work or get stopped.
+    void Run();
+
+    // Stops accepting new clients and closes every live connection. Safe to call from any thread.
+    void Stop();
+
+    size_t shard_count() const { return ptr_servers_.size(); }
+    TCPServer& shard(size_t index) { return *ptr_servers_[index]; }
+    boost::asio::io_service& io_service(size_t index) { return *ptr_io_services_[index]; }
+
+    // Queues one shared payload to the connections of every shard, see TCPServer::Broadcast.
+    // Callbacks run on the threads of the respective shards.
+    size_t Broadcast(const WriteQueue::SharedBuffer& ptr_payload,
+                     const ConnectionRegistry::OnDeliveredCallback& on_delivered = ConnectionRegistry::OnDeliveredCallback(),
+                     const ConnectionRegistry::Filter& filter = ConnectionRegistry::Filter());
+
+    StreamEndpoint local_endpoint() const { return ptr_servers_.front()->local_endpoint(); }
+
+    // The number of live connections across all shards
+    size_t connection_count() const;
+
+private:
+    static void PinToCpu(size_t cpu);
+
+    std::vector<std::unique_ptr<boost::asio::io_service>> ptr_io_services_;
+    std::vector<std::unique_ptr<TCPServer>> ptr_servers_;
+    bool is_pinned_;
+
+    static const std::string kWho;
+};
+
+}
+}
@@ -0,0 +1,185 @@
+#include <cstring>
+#include <sstream>
+#include "stream_socket.h"
+
+#if defined(PHYRE_HAS_FILE_DESCRIPTOR_PASSING)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace Phyre {
+namespace Networking {
+
+    using boost::asio::ip::tcp;
+
+    bool IsLocal(const StreamEndpoint& endpoint) {
+        int family = endpoint.protocol().family();
+        return family != AF_INET && family != AF_INET6;
+    }
+
+    tcp::endpoint ToTCPEndpoint(const StreamEndpoint& endpoint) {
+        tcp::endpoint tcp_endpoint;
+        if (IsLocal(endpoint) || endpoint.size() > tcp_endpoint.capacity()) {
+            return tcp_endpoint;
+        }
+        std::memcpy(tcp_endpoint.data(), endpoint.data(), endpoint.size());
+        tcp_endpoint.resize(endpoint.size());
+        return tcp_endpoint;
+    }
+
+    std::string LocalPath(const StreamEndpoint& endpoint) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        boost::asio::local::stream_protocol::endpoint local_endpoint;
+        if (IsLocal(endpoint) && endpoint.size() <= local_endpoint.capacity()) {
+            std::memcpy(local_endpoint.data(), endpoint.data(), endpoint.size());
+            local_endpoint.resize(endpoint.size());
+            return local_endpoint.path();
+        }
+#endif
+        return std::string();
+    }
+
+    std::string ToString(const StreamEndpoint& endpoint) {
+        if (IsLocal(endpoint)) {
+            return "unix:" + LocalPath(endpoint);
+        }
+        std::ostringstream stream;
+        stream << ToTCPEndpoint(endpoint);
+        return stream.str();
+    }
+
+#if defined(PHYRE_HAS_FILE_DESCRIPTOR_PASSING)
+    namespace {
+#if defined(MSG_NOSIGNAL)
+        const int kSendFlags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#else
+        const int kSendFlags = MSG_DONTWAIT;
+#endif
+#if defined(MSG_CMSG_CLOEXEC)
+        const int kReceiveFlags = MSG_DONTWAIT | MSG_CMSG_CLOEXEC;
+#else
+        const int kReceiveFlags = MSG_DONTWAIT;
+#endif
+    }
+
+    size_t SendWithFileDescriptors(StreamSocket& socket,
+                                   boost::asio::const_buffer data,
+                                   const std::vector<int>& file_descriptors,
+                                   boost::system::error_code& ec) {
+        ec.clear();
+        size_t size = boost::asio::buffer_size(data);
+        if (size == 0) {
+            ec = boost::asio::error::invalid_argument;
+            return 0;
+        }
+
+        iovec io_vector;
+        io_vector.iov_base = const_cast<void*>(boost::asio::buffer_cast<const void*>(data));
+        io_vector.iov_len = size;
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &io_vector;
+        message.msg_iovlen = 1;
+
+        std::vector<char> control;
+        if (!file_descriptors.empty()) {
+            size_t descriptors_size = file_descriptors.size() * sizeof(int);
+            control.resize(CMSG_SPACE(descriptors_size));
+            message.msg_control = control.data();
+            message.msg_controllen = control.size();
+            cmsghdr* p_header = CMSG_FIRSTHDR(&message);
+            p_header->cmsg_level = SOL_SOCKET;
+            p_header->cmsg_type = SCM_RIGHTS;
+            p_header->cmsg_len = CMSG_LEN(descriptors_size);
+            std::memcpy(CMSG_DATA(p_header), file_descriptors.data(), descriptors_size);
+        }
+
+        ssize_t sent = ::sendmsg(socket.native_handle(), &message, kSendFlags);
+        if (sent < 0) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return 0;
+        }
+        return static_cast<size_t>(sent);
+    }
+
+    size_t ReceiveWithFileDescriptors(StreamSocket& socket,
+                                      boost::asio::mutable_buffer buffer,
+                                      std::vector<int>& file_descriptors,
+                                      boost::system::error_code& ec) {
+        ec.clear();
+        iovec io_vector;
+        io_vector.iov_base = boost::asio::buffer_cast<void*>(buffer);
+        io_vector.iov_len = boost::asio::buffer_size(buffer);
+
+        // Room for as many descriptors as a single message may carry on Linux
+        static const size_t kMaxDescriptors = 253;
+        union {
+            cmsghdr alignment;
+            char buffer[CMSG_SPACE(kMaxDescriptors * sizeof(int))];
+        } control;
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &io_vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        ssize_t received = ::recvmsg(socket.native_handle(), &message, kReceiveFlags);
+        if (received < 0) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return 0;
+        }
+        if (received == 0 && io_vector.iov_len > 0) {
+            ec = boost::asio::error::eof;
+            return 0;
+        }
+
+        for (cmsghdr* p_header = CMSG_FIRSTHDR(&message); p_header; p_header = CMSG_NXTHDR(&message, p_header)) {
+            if (p_header->cmsg_level != SOL_SOCKET || p_header->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            size_t count = (p_header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char* p_data = CMSG_DATA(p_header);
+            for (size_t i = 0; i < count; ++i) {
+                int file_descriptor;
+                std::memcpy(&file_descriptor, p_data + i * sizeof(int), sizeof(int));
+                file_descriptors.push_back(file_descriptor);
+            }
+        }
+        if (message.msg_flags & MSG_CTRUNC) {
+            // The kernel dropped the descriptors which did not fit, the stream itself is intact
+            ec = boost::asio::error::message_size;
+        }
+        return static_cast<size_t>(received);
+    }
+
+    void CloseFileDescriptors(std::vector<int>& file_descriptors) {
+        for (int file_descriptor : file_descriptors) {
+            ::close(file_descriptor);
+        }
+        file_descriptors.clear();
+    }
+#else
+    size_t SendWithFileDescriptors(StreamSocket&,
+                                   boost::asio::const_buffer,
+                                   const std::vector<int>&,
+                                   boost::system::error_code& ec) {
+        ec = boost::asio::error::operation_not_supported;
+        return 0;
+    }
+
+    size_t ReceiveWithFileDescriptors(StreamSocket&,
+                                      boost::asio::mutable_buffer,
+                                      std::vector<int>&,
+                                      boost::system::error_code& ec) {
+        ec = boost::asio::error::operation_not_supported;
+        return 0;
+    }
+
+    void CloseFileDescriptors(std::vector<int>& file_descriptors) {
+        file_descriptors.clear();
+    }
+#endif
+
+}
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <string>
+#include <vector>
+
+// SCM_RIGHTS only exists on POSIX AF_UNIX sockets
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && !defined(_WIN32)
+#define PHYRE_HAS_FILE_DESCRIPTOR_PASSING 1
+#endif
+
+namespace Phyre {
+namespace Networking {
+
+// Connections sit on generic stream sockets, so that TCPSocket, TCPServer and the rest serve
+// TCP and, where the platform has them, AF_UNIX stream sockets between processes on the same host
+// through the same API. The latter skip the TCP/IP stack and are the cheaper choice locally.
+typedef boost::asio::generic::stream_protocol StreamProtocol;
+typedef StreamProtocol::socket StreamSocket;
+typedef StreamProtocol::endpoint StreamEndpoint;
+typedef boost::asio::basic_socket_acceptor<StreamProtocol> StreamAcceptor;
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+// An AF_UNIX endpoint at the given path
+inline StreamEndpoint LocalEndpoint(const std::string& path) {
+    return StreamEndpoint(boost::asio::local::stream_protocol::endpoint(path));
+}
+#endif
+
+// Whether the endpoint is an AF_UNIX rather than a TCP one
+bool IsLocal(const StreamEndpoint& endpoint);
+
+// The TCP endpoint behind a generic one, or a default constructed one if it is not TCP
+boost::asio::ip::tcp::endpoint ToTCPEndpoint(const StreamEndpoint& endpoint);
+
+// The path of an AF_UNIX endpoint, empty for any other
+std::string LocalPath(const StreamEndpoint& endpoint);
+
+// address:port for TCP, unix: followed by the path for AF_UNIX
+std::string ToString(const StreamEndpoint& endpoint);
+
+/**
+* File descriptor passing over AF_UNIX. The descriptors ride along with the first byte of data,
+* so there has to be at least one, and the receiving side has to read with ReceiveWithFileDescriptors
+* or the descriptors are lost. Both calls do not block and fail with would_block instead.
+* Sent descriptors stay owned by the sender; received ones are owned by the receiver.
+* Without PHYRE_HAS_FILE_DESCRIPTOR_PASSING, both fail with operation_not_supported.
+*/
+size_t SendWithFileDescriptors(StreamSocket& socket,
+                               boost::asio::const_buffer data,
+                               const std::vector<int>& file_descriptors,
+                               boost::system::error_code& ec);
+
+// Received descriptors are appended to file_descriptors
+size_t ReceiveWithFileDescriptors(StreamSocket& socket,
+                                  boost::asio::mutable_buffer buffer,
+                                  std::vector<int>& file_descriptors,
+                                  boost::system::error_code& ec);
+
+// Closes descriptors nobody took ownership of
+void CloseFileDescriptors(std::vector<int>& file_descriptors);
+
+// Waits until the socket can be written to or read from without blocking
+template <typename Handler>
+void AsyncWaitWritable(StreamSocket& socket, Handler handler) {
+#if BOOST_VERSION >= 106600
+    socket.async_wait(StreamSocket::wait_write, std::move(handler));
+#else
+    socket.async_write_some(boost::asio::null_buffers(), [handler](const boost::system::error_code& ec, size_t) mutable { handler(ec); });
+#endif
+}
+
+template <typename Handler>
+void AsyncWaitReadable(StreamSocket& socket, Handler handler) {
+#if BOOST_VERSION >= 106600
+    socket.async_wait(StreamSocket::wait_read, std::move(handler));
+#else
+    socket.async_read_some(boost::asio::null_buffers(), [handler](const boost::system::error_code& ec, size_t) mutable { handler(ec); });
+#endif
+}
+
+// Writes all of data with the descriptors attached to its first byte.
+// handler(ec, bytes_transferred) is invoked once done, like for async_write.
+// The descriptors are copied, so the caller's may be closed right away.
+template <typename Handler>
+void AsyncWriteWithFileDescriptors(StreamSocket& socket,
+                                   boost::asio::const_buffer data,
+                                   std::vector<int> file_descriptors,
+                                   Handler handler) {
+    StreamSocket* p_socket = &socket;
+    AsyncWaitWritable(socket, [p_socket, data, file_descriptors, handler](const boost::system::error_code& wait_ec) mutable {
+        if (wait_ec) {
+            handler(wait_ec, 0);
+            return;
+        }
+        boost::system::error_code ec;
+        size_t sent = SendWithFileDescriptors(*p_socket, data, file_descriptors, ec);
+        if (ec == boost::asio::error::would_block) {
+            AsyncWriteWithFileDescriptors(*p_socket, data, std::move(file_descriptors), std::move(handler));
+            return;
+        }
+        if (ec || sent == boost::asio::buffer_size(data)) {
+            handler(ec, sent);
+            return;
+        }
+        // The descriptors went out with the first byte, the rest is a plain write
+        boost::asio::async_write(*p_socket, boost::asio::buffer(data + sent),
+                                 [sent, handler](const boost::system::error_code& write_ec, size_t bytes_transferred) mutable {
+            handler(write_ec, sent + bytes_transferred);
+        });
+    });
+}
+
+// Reads whatever is available, at least a byte, appending any descriptors which come along.
+// handler(ec, bytes_transferred) is invoked once done, like for async_read_some.
+// The buffer and the descriptor list have to stay alive until then.
+template <typename Handler>
+void AsyncReadWithFileDescriptors(StreamSocket& socket,
+                                  boost::asio::mutable_buffer buffer,
+                                  std::vector<int>& file_descriptors,
+                                  Handler handler) {
+    StreamSocket* p_socket = &socket;
+    std::vector<int>* p_file_descriptors = &file_descriptors;
+    AsyncWaitReadable(socket, [p_socket, buffer, p_file_descriptors, handler](const boost::system::error_code& wait_ec) mutable {
+        if (wait_ec) {
+            handler(wait_ec, 0);
+            return;
+        }
+        boost::system::error_code ec;
+        size_t received = ReceiveWithFileDescriptors(*p_socket, buffer, *p_file_descriptors, ec);
+        if (ec == boost::asio::error::would_block) {
+            AsyncReadWithFileDescriptors(*p_socket, buffer, *p_file_descriptors, std::move(handler));
+            return;
+        }
+        handler(ec, received);
+    });
+}
+
+}
+}
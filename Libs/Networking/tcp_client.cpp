@@ -11,26 +11,110 @@ namespace Networking {
     using boost::asio::ip::tcp;
     const std::string TCPClient::kWho = "[TCPClient]";
 
-    TCPClient::TCPClient(boost::asio::io_service& io_service) :
+    TCPClient::TCPClient(boost::asio::io_service& io_service,
+                         size_t initial_receive_capacity,
+                         size_t max_receive_capacity) :
         io_service_(io_service),
-        host_resolver_(HostResolver(std::make_unique<tcp::resolver>(io_service_))),
+        host_resolver_(io_service_),
         ptr_tcp_socket_(std::make_unique<TCPSocket>(io_service_,
                                                 boost::bind(&TCPClient::ConnectHandler, this, boost::asio::placeholders::error),
                                                 boost::bind(&TCPClient::ReadHandler,
                                                             this,
                                                             boost::asio::placeholders::error,
-                                                            boost::asio::placeholders::bytes_transferred))) { }
+                                                            boost::asio::placeholders::bytes_transferred),
+                                                initial_receive_capacity,
+                                                max_receive_capacity)),
+        p_tls_context_(nullptr),
+        ptr_tls_session_cache_(TLSSessionCache::Instance()),
+        is_endpoint_target_(false),
+        reconnect_timer_(io_service),
+        unsent_bytes_(0),
+        reconnects_(0),
+        is_reconnect_enabled_(false),
+        is_reconnecting_(false),
+        has_connected_(false) { }
 
     TCPClient::~TCPClient() { }
 
     void TCPClient::Connect(const std::string& host, const std::string& service)
     {
         PHYRE_LOG(info, kWho) << "Connecting to " << host << ':' << service;
+        host_ = host;
+        service_ = service;
+        is_endpoint_target_ = false;
+        StartConnect();
+    }
+
+    void TCPClient::Connect(const StreamEndpoint& endpoint)
+    {
+        PHYRE_LOG(info, kWho) << "Connecting to " << ToString(endpoint);
+        endpoint_ = endpoint;
+        is_endpoint_target_ = true;
+        StartConnect();
+    }
+
+    void TCPClient::StartConnect()
+    {
+        if (is_endpoint_target_) {
+            ptr_tcp_socket_->Connect(endpoint_);
+            return;
+        }
         HostResolver::OnHostResolvedCallback callback = boost::bind(&TCPClient::ResolveHostHandler,
                                                                     this,
-                                                                    boost::asio::placeholders::error,
-                                                                    boost::asio::placeholders::iterator);
-        host_resolver_.ResolveHost(host, service, callback);
+                                                                    boost::placeholders::_1,
+                                                                    boost::placeholders::_2);
+        host_resolver_.ResolveHost(host_, service_, callback);
+    }
+
+    void TCPClient::set_reconnect_policy(const ReconnectPolicy& reconnect_policy)
+    {
+        reconnect_backoff_ = ReconnectBackoff(reconnect_policy);
+        is_reconnect_enabled_ = true;
+    }
+
+    void TCPClient::ScheduleReconnect()
+    {
+        std::chrono::milliseconds delay = reconnect_backoff_.NextDelay();
+        PHYRE_LOG(info, kWho) << "Reconnecting in " << delay.count() << "ms, attempt " << reconnect_backoff_.attempts();
+        reconnect_timer_.expires_from_now(delay);
+        reconnect_timer_.async_wait([this](const boost::system::error_code& ec) {
+            // Cancelled by Disconnect, or the client is gone
+            if (ec || !is_reconnecting_) {
+                return;
+            }
+            StartConnect();
+        });
+    }
+
+    void TCPClient::OnReconnect() {
+        OnConnect();
+        ResumeSession();
+    }
+
+    void TCPClient::ResumeSession()
+    {
+        if (!unsent_writes_.empty()) {
+            PHYRE_LOG(debug, kWho) << "Flushing " << unsent_bytes_ << " bytes held back while reconnecting";
+        }
+        // Writes may fail the connection again, which holds back whatever is left
+        while (!unsent_writes_.empty() && is_connected()) {
+            UnsentWrite unsent = std::move(unsent_writes_.front());
+            unsent_writes_.pop_front();
+            unsent_bytes_ -= unsent.data.size();
+            ptr_tcp_socket_->Write(unsent.data, unsent.on_write_callback);
+        }
+    }
+
+    void TCPClient::FailUnsentWrites(const boost::system::error_code& ec)
+    {
+        std::deque<UnsentWrite> failed;
+        failed.swap(unsent_writes_);
+        unsent_bytes_ = 0;
+        for (UnsentWrite& unsent : failed) {
+            if (unsent.on_write_callback) {
+                unsent.on_write_callback(ec, 0);
+            }
+        }
     }
 
     void TCPClient::OnConnect() {
@@ -43,6 +127,10 @@ namespace Networking {
 
     void TCPClient::Disconnect()
     {
+        is_reconnecting_ = false;
+        boost::system::error_code ignored;
+        reconnect_timer_.cancel(ignored);
+        FailUnsentWrites(boost::asio::error::operation_aborted);
         ptr_tcp_socket_->Close();
         OnDisconnect();
     }
@@ -54,22 +142,81 @@ namespace Networking {
         }
 
         PHYRE_LOG(info, kWho) << ": Connection established";
+        if (p_tls_context_) {
+            StartTLS(*p_tls_context_, tls_server_name_, [this]() { OnEstablished(); });
+            return;
+        }
+        OnEstablished();
+    }
+
+    void TCPClient::OnEstablished() {
+        // The backoff only starts over once a connection made it this far
+        bool is_reconnect = has_connected_;
+        has_connected_ = true;
+        is_reconnecting_ = false;
+        reconnect_backoff_.Reset();
+        if (is_reconnect) {
+            ++reconnects_;
+            OnReconnect();
+            return;
+        }
         OnConnect();
+        ResumeSession();
+    }
+
+    void TCPClient::set_timeouts(std::chrono::milliseconds read_timeout,
+                                 std::chrono::milliseconds write_timeout,
+                                 std::chrono::milliseconds idle_timeout,
+                                 TimingWheel::pointer ptr_timing_wheel) {
+        if (!ptr_timing_wheel) {
+            ptr_timing_wheel = TimingWheel::Create(io_service_);
+        }
+        ptr_tcp_socket_->set_timeouts(ptr_timing_wheel, read_timeout, write_timeout, idle_timeout);
+    }
+
+    void TCPClient::StartTLS(boost::asio::ssl::context& context, const std::string& server_name, std::function<void()> on_secured) {
+        ptr_tcp_socket_->StartTLS(context, server_name, [this, on_secured](const boost::system::error_code& ec) {
+            if (ec) {
+                ErrorHandler(ec);
+                return;
+            }
+            on_secured();
+        }, ptr_tls_session_cache_);
     }
 
     void TCPClient::OnRead(const std::string& data) {
         std::cout << data;
     }
 
-    void TCPClient::ReadHandler(const boost::system::error_code& ec, size_t bytes_transferred) {
+    void TCPClient::ReadHandler(const boost::system::error_code& ec, size_t /*bytes_transferred*/) {
         if (ec) {
             ErrorHandler(ec);
             return;
         }
 
-        std::ostringstream read_buffer;
-        read_buffer.write(ptr_tcp_socket_->buffer().data(), bytes_transferred);
-        OnRead(read_buffer.str());
+        ReceiveBuffer& receive_buffer = ptr_tcp_socket_->receive_buffer();
+        if (!ptr_frame_codec_) {
+            receive_buffer.Consume(OnReadView(receive_buffer.data()));
+            return;
+        }
+
+        boost::system::error_code frame_ec;
+        receive_buffer.Consume(ptr_frame_codec_->Decode(receive_buffer.data(),
+                                                        [this](boost::string_ref frame) { OnFrame(frame); },
+                                                        frame_ec));
+        if (frame_ec) {
+            PHYRE_LOG(error, kWho) << "Received a malformed frame: " << frame_ec.message();
+            ErrorHandler(frame_ec);
+        }
+    }
+
+    void TCPClient::OnFrame(boost::string_ref frame) {
+        PHYRE_LOG(debug, kWho) << "Received a frame of " << frame.size() << " bytes";
+    }
+
+    size_t TCPClient::OnReadView(boost::string_ref bytes) {
+        OnRead(bytes.to_string());
+        return bytes.size();
     }
 
     void TCPClient::OnError(const boost::system::error_code& ec) {
@@ -77,33 +224,78 @@ namespace Networking {
     }
 
     void TCPClient::ErrorHandler(const boost::system::error_code& ec) {
+        if (!is_reconnect_enabled_ || reconnect_backoff_.is_exhausted()) {
+            if (is_reconnect_enabled_) {
+                PHYRE_LOG(warning, kWho) << "Giving up after " << reconnect_backoff_.attempts() << " reconnect attempt(s)";
+            }
+            OnError(ec);
+            Disconnect();
+            return;
+        }
+
+        // Closed before OnError runs, so that anything it writes is held back for the next connection
+        ptr_tcp_socket_->Close();
+        is_reconnecting_ = true;
         OnError(ec);
-        Disconnect();
+        if (is_reconnecting_) {
+            ScheduleReconnect();
+        }
+    }
+
+    void TCPClient::Write(const std::ostringstream& data_stream, TCPSocket::OnWriteCallback on_write_callback) {
+        Write(data_stream.str(), on_write_callback);
     }
 
-    void TCPClient::Write(const std::ostringstream& data_stream) {
+    void TCPClient::Write(const std::string& data, TCPSocket::OnWriteCallback on_write_callback) {
         if (is_connected()) {
-            std::string data(data_stream.str());
-            ptr_tcp_socket_->Write(data);
-            PHYRE_LOG(info, kWho) << "Sent " << data.size() << " bytes to endpoint:\n";
+            PHYRE_LOG(debug, kWho) << "Queued " << data.size() << " bytes for endpoint";
+            ptr_tcp_socket_->Write(data, on_write_callback);
+            return;
+        }
+
+        if (is_reconnecting_) {
+            if (unsent_bytes_ + data.size() > reconnect_backoff_.policy().max_buffered_bytes) {
+                PHYRE_LOG(warning, kWho) << "Dropping a write of " << data.size() << " bytes, "
+                                         << unsent_bytes_ << " bytes are already held back while reconnecting";
+                if (on_write_callback) {
+                    on_write_callback(boost::asio::error::no_buffer_space, 0);
+                }
+                return;
+            }
+            unsent_bytes_ += data.size();
+            unsent_writes_.push_back(UnsentWrite{ data, on_write_callback });
             return;
         }
 
         PHYRE_LOG(warning, kWho) << "Attempting to write when no connection has been established";
+        if (on_write_callback) {
+            on_write_callback(boost::asio::error::not_connected, 0);
+        }
+    }
+
+    void TCPClient::WriteFrame(boost::string_ref payload, TCPSocket::OnWriteCallback on_write_callback) {
+        if (!ptr_frame_codec_) {
+            PHYRE_LOG(error, kWho) << "Cannot write a frame without a frame codec";
+            if (on_write_callback) {
+                on_write_callback(boost::asio::error::operation_not_supported, 0);
+            }
+            return;
+        }
+        Write(ptr_frame_codec_->Encode(payload), on_write_callback);
     }
 
     void TCPClient::OnHostResolved() {
         PHYRE_LOG(info, kWho) << "Host resolved";
     }
 
-    void TCPClient::ResolveHostHandler(const boost::system::error_code& ec, tcp::resolver::iterator it) {
+    void TCPClient::ResolveHostHandler(const boost::system::error_code& ec, const DnsCache::Endpoints& endpoints) {
         if (ec) {
             ErrorHandler(ec);
             return;
         }
 
         OnHostResolved();
-        ptr_tcp_socket_->Connect(it);
+        ptr_tcp_socket_->Connect(endpoints);
     }
 }
 }
@@ -1,6 +1,11 @@
 #pragma once
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <deque>
+#include "frame_codec.h"
 #include "host_resolver.h"
+#include "reconnect_policy.h"
 #include "tcp_socket.h"
 
 namespace Phyre
@@ -11,32 +16,145 @@ namespace Networking
     {
 
     public:
-        TCPClient(boost::asio::io_service& io_service);
+        TCPClient(boost::asio::io_service& io_service,
+                  size_t initial_receive_capacity = ReceiveBuffer::kDefaultInitialCapacity,
+                  size_t max_receive_capacity = ReceiveBuffer::kDefaultMaxCapacity);
         virtual ~TCPClient();
 
         void Connect(const std::string& host, const std::string& service);
+
+        // Skips resolution, e.g. for an AF_UNIX endpoint of a service on the same host
+        void Connect(const StreamEndpoint& endpoint);
+        // Also stops reconnecting, failing the writes held back meanwhile with operation_aborted
         void Disconnect();
-        void Write(const std::ostringstream& data_stream);
+        void Write(const std::ostringstream& data_stream,
+                   TCPSocket::OnWriteCallback on_write_callback = TCPSocket::OnWriteCallback());
+        void Write(const std::string& data,
+                   TCPSocket::OnWriteCallback on_write_callback = TCPSocket::OnWriteCallback());
+
+        // Frames the payload with the codec, see set_frame_codec
+        void WriteFrame(boost::string_ref payload,
+                        TCPSocket::OnWriteCallback on_write_callback = TCPSocket::OnWriteCallback());
+
+        // File descriptor passing over AF_UNIX, see TCPSocket::WriteFileDescriptors
+        void WriteFileDescriptors(const std::string& data,
+                                  const std::vector<int>& file_descriptors,
+                                  TCPSocket::OnWriteCallback on_write_callback = TCPSocket::OnWriteCallback()) {
+            ptr_tcp_socket_->WriteFileDescriptors(data, file_descriptors, on_write_callback);
+        }
+        void set_file_descriptor_passing(bool is_enabled) { ptr_tcp_socket_->set_file_descriptor_passing(is_enabled); }
+        std::vector<int> TakeFileDescriptors() { return ptr_tcp_socket_->TakeFileDescriptors(); }
+
+        // Flow control: stop reading from the endpoint until reading is resumed
+        void PauseReading() { ptr_tcp_socket_->PauseReading(); }
+        void ResumeReading() { ptr_tcp_socket_->ResumeReading(); }
+
+        // Secures every connection with TLS before OnConnect is called
+        void EnableTLS(boost::asio::ssl::context& context, const std::string& server_name) {
+            p_tls_context_ = &context;
+            tls_server_name_ = server_name;
+        }
+
+        // Upgrades the established connection to TLS, see TCPSocket::StartTLS.
+        // on_secured is called once the handshake succeeded; failures end up in OnError.
+        void StartTLS(boost::asio::ssl::context& context, const std::string& server_name, std::function<void()> on_secured);
+
+        // Disconnects with a timed_out error once a deadline passes, see ConnectionDeadlines.
+        // Without a wheel, the client gets one of its own.
+        void set_timeouts(std::chrono::milliseconds read_timeout,
+                          std::chrono::milliseconds write_timeout,
+                          std::chrono::milliseconds idle_timeout,
+                          TimingWheel::pointer ptr_timing_wheel = TimingWheel::pointer());
+
+        // Splits received bytes into frames which are handed to OnFrame instead of OnReadView.
+        // Frames are parsed in place, so the maximum receive capacity has to fit the largest frame.
+        void set_frame_codec(FrameCodec::Pointer ptr_frame_codec) { ptr_frame_codec_ = std::move(ptr_frame_codec); }
+
+        /**
+        * Reconnects with jittered exponential backoff whenever the connection fails or drops,
+        * instead of disconnecting for good, until the policy runs out of attempts.
+        * OnError still reports every failure. Writes issued while reconnecting are held back, up to
+        * the policy's budget, and flushed once the session is resumed, see OnReconnect.
+        * Writes which were already handed to the lost connection fail through their callbacks.
+        */
+        void set_reconnect_policy(const ReconnectPolicy& reconnect_policy);
+
+        // Where TLS sessions are kept for resumption; defaults to the process wide cache
+        void set_tls_session_cache(TLSSessionCache::Pointer ptr_tls_session_cache) { ptr_tls_session_cache_ = ptr_tls_session_cache; }
 
         bool is_connected() const { return ptr_tcp_socket_->is_connected(); }
+        bool is_tls() const { return ptr_tcp_socket_->is_tls(); }
+        bool is_tls_session_reused() const { return ptr_tcp_socket_->is_tls_session_reused(); }
+        const ConnectionMetrics& metrics() const { return ptr_tcp_socket_->metrics(); }
+        bool is_reconnecting() const { return is_reconnecting_; }
+
+        // How often a lost connection was re-established
+        size_t reconnects() const { return reconnects_; }
+        size_t unsent_bytes() const { return unsent_bytes_; }
 
     protected:
         virtual void OnConnect();
+
+        // Called instead of OnConnect once a lost connection is back. Replay the session setup here,
+        // e.g. re-authenticate, and call ResumeSession once done; writes issued before that go out
+        // ahead of the ones held back. By default, this runs OnConnect and resumes right away.
+        virtual void OnReconnect();
+
+        // Flushes the writes held back while reconnecting
+        void ResumeSession();
         virtual void OnHostResolved();
         virtual void OnRead(const std::string& buffer);
+
+        // Called with a view straight into the socket's receive buffer.
+        // The bytes are only valid for the duration of the call, so copy whatever must outlive it.
+        // Returns how many bytes were consumed; the rest are handed back, followed by any
+        // newly read bytes, on the next call. This lets protocols parse partial messages in place.
+        // By default, the bytes are copied into a string and forwarded to OnRead for compatibility.
+        virtual size_t OnReadView(boost::string_ref bytes);
+
+        // Called with each complete frame once a codec is set, valid for the duration of the call
+        virtual void OnFrame(boost::string_ref frame);
         virtual void OnDisconnect();
         virtual void OnError(const boost::system::error_code& ec);
 
         boost::asio::io_service& io_service_;
 
     private:
+        struct UnsentWrite {
+            std::string data;
+            TCPSocket::OnWriteCallback on_write_callback;
+        };
+
+        void StartConnect();
+        void OnEstablished();
+        void ScheduleReconnect();
+        void FailUnsentWrites(const boost::system::error_code& ec);
         void ConnectHandler(const boost::system::error_code& ec);
-        void ResolveHostHandler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator it);
+        void ResolveHostHandler(const boost::system::error_code& ec, const DnsCache::Endpoints& endpoints);
         void ReadHandler(const boost::system::error_code& ec, size_t bytes_transferred);
         void ErrorHandler(const boost::system::error_code& ec);
 
         HostResolver host_resolver_;
         std::unique_ptr<TCPSocket> ptr_tcp_socket_;
+        FrameCodec::Pointer ptr_frame_codec_;
+        boost::asio::ssl::context* p_tls_context_;
+        std::string tls_server_name_;
+        TLSSessionCache::Pointer ptr_tls_session_cache_;
+
+        // What Connect was last called with, so that reconnects go to the same place
+        std::string host_;
+        std::string service_;
+        StreamEndpoint endpoint_;
+        bool is_endpoint_target_;
+
+        ReconnectBackoff reconnect_backoff_;
+        boost::asio::steady_timer reconnect_timer_;
+        std::deque<UnsentWrite> unsent_writes_;
+        size_t unsent_bytes_;
+        size_t reconnects_;
+        bool is_reconnect_enabled_;
+        bool is_reconnecting_;
+        bool has_connected_;
         static const std::string kWho;
     };
 }
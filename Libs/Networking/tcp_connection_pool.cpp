@@ -0,0 +1,363 @@
+#include <Logging/logging.h>
+#include "tcp_connection_pool.h"
+
+namespace Phyre {
+namespace Networking {
+
+    const std::string TCPConnectionPool::kWho = "[TCPConnectionPool]";
+    const size_t TCPConnectionPool::kDefaultMaxIdlePerEndpoint;
+    const size_t TCPConnectionPool::kDefaultMaxTotal;
+    const std::chrono::milliseconds TCPConnectionPool::kDefaultIdleTimeout(std::chrono::seconds(30));
+
+    TCPConnectionPool::TCPConnectionPool(boost::asio::io_service& io_service,
+                                         size_t max_idle_per_endpoint,
+                                         size_t max_total,
+                                         std::chrono::milliseconds idle_timeout) :
+        io_service_(io_service),
+        host_resolver_(io_service),
+        reaper_timer_(io_service),
+        max_idle_per_endpoint_(max_idle_per_endpoint),
+        max_total_(max_total),
+        idle_timeout_(idle_timeout),
+        next_checkout_id_(0),
+        is_shut_down_(false) { }
+
+    TCPConnectionPool::~TCPConnectionPool() {
+        for (auto& entry : idle_) {
+            for (IdleSocket& idle_socket : entry.second) {
+                Close(idle_socket.socket);
+            }
+        }
+        for (auto& entry : connecting_) {
+            Close(entry.second.socket);
+        }
+    }
+
+    TCPConnectionPool::pointer TCPConnectionPool::Create(boost::asio::io_service& io_service,
+                                                         size_t max_idle_per_endpoint,
+                                                         size_t max_total,
+                                                         std::chrono::milliseconds idle_timeout) {
+        pointer pool(new TCPConnectionPool(io_service, max_idle_per_endpoint, max_total, idle_timeout));
+        pool->ScheduleReaper();
+        return pool;
+    }
+
+    void TCPConnectionPool::Acquire(const std::string& host, const std::string& service, OnAcquireCallback on_acquire_callback) {
+        Key key(host, service);
+        if (is_shut_down_) {
+            Complete(on_acquire_callback, boost::asio::error::operation_aborted, nullptr);
+            return;
+        }
+
+        SocketPointer socket = TakeIdle(key);
+        if (socket) {
+            PHYRE_LOG(trace, kWho) << "Reusing a connection to " << host << ':' << service;
+            Complete(on_acquire_callback, boost::system::error_code(), socket);
+            return;
+        }
+
+        if (endpoints_.size() < max_total_) {
+            Connect(key, on_acquire_callback);
+            return;
+        }
+
+        PHYRE_LOG(debug, kWho) << "All " << max_total_ << " connections are in use, waiting for one to be released";
+        waiters_.push_back(Waiter{ key, on_acquire_callback });
+    }
+
+    void TCPConnectionPool::Connect(const Key& key, OnAcquireCallback on_acquire_callback) {
+        SocketPointer socket = std::make_shared<TCPSocket>(io_service_,
+                                                           TCPSocket::OnConnectCallback(),
+                                                           [](const boost::system::error_code&, size_t) { });
+        TCPSocket* p_socket = socket.get();
+        endpoints_[p_socket] = key;
+        connecting_[p_socket] = Connecting{ socket, on_acquire_callback };
+
+        // The socket holds on to its own callbacks, so they only refer back to it by address
+        std::weak_ptr<TCPConnectionPool> weak_pool = shared_from_this();
+        socket->set_on_connect_callback([weak_pool, p_socket](const boost::system::error_code& ec) {
+            pointer pool = weak_pool.lock();
+            if (pool) {
+                pool->HandleConnect(p_socket, ec);
+            }
+        });
+
+        host_resolver_.ResolveHost(key.first, key.second, [weak_pool, p_socket](const boost::system::error_code& ec, const DnsCache::Endpoints& endpoints) {
+            pointer pool = weak_pool.lock();
+            if (!pool) {
+                return;
+            }
+            auto it = pool->connecting_.find(p_socket);
+            if (it == pool->connecting_.end()) {
+                return;
+            }
+            if (ec) {
+                pool->HandleConnect(p_socket, ec);
+                return;
+            }
+            it->second.socket->Connect(endpoints);
+        });
+    }
+
+    void TCPConnectionPool::HandleConnect(TCPSocket* p_socket, const boost::system::error_code& ec) {
+        auto it = connecting_.find(p_socket);
+        if (it == connecting_.end()) {
+            return;
+        }
+        Connecting connecting = it->second;
+        connecting_.erase(it);
+
+        if (ec) {
+            const Key& key = endpoints_[p_socket];
+            PHYRE_LOG(warning, kWho) << "Failed to connect to " << key.first << ':' << key.second << ": " << ec.message();
+            Close(connecting.socket);
+            Complete(connecting.callback, ec, nullptr);
+            ServeWaiters();
+            return;
+        }
+        Complete(connecting.callback, ec, connecting.socket);
+    }
+
+    TCPConnectionPool::SocketPointer TCPConnectionPool::TakeIdle(const Key& key) {
+        auto it = idle_.find(key);
+        if (it == idle_.end()) {
+            return nullptr;
+        }
+
+        // The most recently used socket is the most likely to still be alive
+        std::deque<IdleSocket>& idle_sockets = it->second;
+        while (!idle_sockets.empty()) {
+            SocketPointer socket = idle_sockets.back().socket;
+            idle_sockets.pop_back();
+            if (IsHealthy(*socket)) {
+                socket->set_on_read_callback([](const boost::system::error_code&, size_t) { });
+                return socket;
+            }
+            PHYRE_LOG(debug, kWho) << "Discarding an unhealthy idle connection to " << key.first << ':' << key.second;
+            Close(socket);
+        }
+        return nullptr;
+    }
+
+    void TCPConnectionPool::Release(const SocketPointer& handed_out) {
+        SocketPointer socket = CheckIn(handed_out);
+        auto endpoint = socket ? endpoints_.find(socket.get()) : endpoints_.end();
+        if (endpoint == endpoints_.end()) {
+            PHYRE_LOG(warning, kWho) << "Released a socket which does not belong to this pool or is not checked out";
+            return;
+        }
+
+        std::deque<IdleSocket>& idle_sockets = idle_[endpoint->second];
+        if (is_shut_down_ || !IsHealthy(*socket) || idle_sockets.size() >= max_idle_per_endpoint_) {
+            Close(socket);
+            ServeWaiters();
+            return;
+        }
+
+        // Keep reading while idle: any event at all means the socket is no longer reusable,
+        // so it is evicted right away, before anyone gets the chance to check it out
+        std::weak_ptr<TCPConnectionPool> weak_pool = shared_from_this();
+        TCPSocket* p_socket = socket.get();
+        socket->set_on_read_callback([weak_pool, p_socket](const boost::system::error_code&, size_t) {
+            pointer pool = weak_pool.lock();
+            if (pool) {
+                pool->Evict(p_socket);
+            }
+        });
+        socket->ResumeReading();
+        idle_sockets.push_back(IdleSocket{ socket, Clock::now() });
+        ServeWaiters();
+    }
+
+    void TCPConnectionPool::Discard(const SocketPointer& handed_out) {
+        SocketPointer socket = CheckIn(handed_out);
+        if (!socket) {
+            return;
+        }
+        Close(socket);
+        ServeWaiters();
+    }
+
+    TCPConnectionPool::SocketPointer TCPConnectionPool::CheckIn(const SocketPointer& handed_out) {
+        auto it = handed_out ? checked_out_.find(handed_out.get()) : checked_out_.end();
+        if (it == checked_out_.end()) {
+            return nullptr;
+        }
+        SocketPointer socket = it->second.socket;
+        checked_out_.erase(it);
+        return socket;
+    }
+
+    void TCPConnectionPool::Reclaim(TCPSocket* p_socket, uint64_t checkout_id) {
+        auto it = checked_out_.find(p_socket);
+        if (it == checked_out_.end() || it->second.checkout_id != checkout_id) {
+            return;
+        }
+        PHYRE_LOG(debug, kWho) << "Discarding a connection which was dropped without being released";
+        SocketPointer socket = it->second.socket;
+        checked_out_.erase(it);
+        Close(socket);
+        ServeWaiters();
+    }
+
+    TCPConnectionPool::SocketPointer TCPConnectionPool::HandOut(const std::weak_ptr<TCPConnectionPool>& weak_pool,
+                                                                const SocketPointer& socket,
+                                                                uint64_t checkout_id) {
+        // Holds on to the socket itself, so that it outlives the pool if need be. Giving it back
+        // is posted since the last pointer may well be dropped from within a callback of the socket.
+        TCPSocket* p_socket = socket.get();
+        return SocketPointer(p_socket, [weak_pool, socket, checkout_id](TCPSocket* p_dropped) {
+            pointer pool = weak_pool.lock();
+            if (!pool) {
+                return;
+            }
+            auto it = pool->checked_out_.find(p_dropped);
+            if (it != pool->checked_out_.end() && it->second.checkout_id == checkout_id) {
+                std::weak_ptr<TCPConnectionPool> weak_reclaiming_pool = pool;
+                pool->io_service_.post([weak_reclaiming_pool, p_dropped, checkout_id]() {
+                    pointer reclaiming_pool = weak_reclaiming_pool.lock();
+                    if (reclaiming_pool) {
+                        reclaiming_pool->Reclaim(p_dropped, checkout_id);
+                    }
+                });
+            }
+        });
+    }
+
+    void TCPConnectionPool::Evict(TCPSocket* p_socket) {
+        auto endpoint = endpoints_.find(p_socket);
+        if (endpoint == endpoints_.end()) {
+            return;
+        }
+
+        std::deque<IdleSocket>& idle_sockets = idle_[endpoint->second];
+        for (auto it = idle_sockets.begin(); it != idle_sockets.end(); ++it) {
+            if (it->socket.get() == p_socket) {
+                PHYRE_LOG(debug, kWho) << "Evicting an idle connection to " << endpoint->second.first << ':' << endpoint->second.second;
+                SocketPointer socket = it->socket;
+                idle_sockets.erase(it);
+                Close(socket);
+                ServeWaiters();
+                return;
+            }
+        }
+    }
+
+    void TCPConnectionPool::Close(const SocketPointer& socket) {
+        if (socket->is_connected()) {
+            socket->Close();
+        }
+        endpoints_.erase(socket.get());
+        // Pooled sockets always have a read outstanding, whose handler refers to the socket by address.
+        // Closing only aborts it, so the socket has to stay around until that handler ran.
+        io_service_.post([socket]() { });
+    }
+
+    void TCPConnectionPool::ServeWaiters() {
+        while (!waiters_.empty()) {
+            Waiter& waiter = waiters_.front();
+            SocketPointer socket = TakeIdle(waiter.key);
+            if (socket) {
+                Complete(waiter.callback, boost::system::error_code(), socket);
+            } else if (endpoints_.size() < max_total_) {
+                Connect(waiter.key, waiter.callback);
+            } else {
+                return;
+            }
+            waiters_.pop_front();
+        }
+    }
+
+    void TCPConnectionPool::Complete(const OnAcquireCallback& callback, const boost::system::error_code& ec, const SocketPointer& socket) {
+        if (!socket) {
+            io_service_.post([callback, ec]() { callback(ec, nullptr); });
+            return;
+        }
+
+        // The socket counts as checked out from now on, the pointer of its own is only made once
+        // the callback runs so that nothing needs giving back if it never does
+        uint64_t checkout_id = ++next_checkout_id_;
+        checked_out_[socket.get()] = CheckedOut{ socket, checkout_id };
+        std::weak_ptr<TCPConnectionPool> weak_pool = shared_from_this();
+        io_service_.post([weak_pool, callback, ec, socket, checkout_id]() {
+            callback(ec, HandOut(weak_pool, socket, checkout_id));
+        });
+    }
+
+    void TCPConnectionPool::Shutdown() {
+        is_shut_down_ = true;
+        reaper_timer_.cancel();
+        for (auto& entry : idle_) {
+            for (IdleSocket& idle_socket : entry.second) {
+                Close(idle_socket.socket);
+            }
+        }
+        idle_.clear();
+
+        for (auto& entry : connecting_) {
+            Close(entry.second.socket);
+            Complete(entry.second.callback, boost::asio::error::operation_aborted, nullptr);
+        }
+        connecting_.clear();
+
+        for (Waiter& waiter : waiters_) {
+            Complete(waiter.callback, boost::asio::error::operation_aborted, nullptr);
+        }
+        waiters_.clear();
+    }
+
+    size_t TCPConnectionPool::idle_count() const {
+        size_t count = 0;
+        for (const auto& entry : idle_) {
+            count += entry.second.size();
+        }
+        return count;
+    }
+
+    bool TCPConnectionPool::IsHealthy(TCPSocket& socket) {
+        if (!socket.is_connected() || !socket.socket().is_open() || !socket.receive_buffer().empty()) {
+            return false;
+        }
+
+        // Bytes waiting in the kernel mean the peer is not where we left it
+        boost::system::error_code ec;
+        size_t available = socket.socket().available(ec);
+        return !ec && available == 0;
+    }
+
+    void TCPConnectionPool::ScheduleReaper() {
+        if (is_shut_down_) {
+            return;
+        }
+        std::weak_ptr<TCPConnectionPool> weak_pool = shared_from_this();
+        reaper_timer_.expires_from_now(std::max(idle_timeout_ / 2, std::chrono::milliseconds(1)));
+        reaper_timer_.async_wait([weak_pool](const boost::system::error_code& ec) {
+            pointer pool = weak_pool.lock();
+            if (pool) {
+                pool->Reap(ec);
+            }
+        });
+    }
+
+    void TCPConnectionPool::Reap(const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+
+        Clock::time_point now = Clock::now();
+        for (auto& entry : idle_) {
+            std::deque<IdleSocket>& idle_sockets = entry.second;
+            // Sockets are released in order, so the oldest ones sit at the front
+            while (!idle_sockets.empty() && now - idle_sockets.front().idle_since >= idle_timeout_) {
+                PHYRE_LOG(debug, kWho) << "Reaping an idle connection to " << entry.first.first << ':' << entry.first.second;
+                SocketPointer socket = idle_sockets.front().socket;
+                idle_sockets.pop_front();
+                Close(socket);
+            }
+        }
+        ServeWaiters();
+        ScheduleReaper();
+    }
+
+}
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include "host_resolver.h"
+#include "tcp_socket.h"
+
+namespace Phyre {
+namespace Networking {
+
+// Hands out already connected TCPSockets keyed by (host, service) so that
+// request style traffic does not pay for a resolve and a handshake each time.
+// Sockets are checked for health on checkout, idle sockets are reaped once they
+// have been idle for too long, and an idle socket which the peer closes (or sends
+// unsolicited bytes on) gets evicted right away.
+// A socket which is dropped without being released or discarded is discarded once the
+// last copy of the pointer handed out goes away, so it never keeps holding its slot.
+// The pool is not thread safe; drive it from a single io_service thread.
+class TCPConnectionPool : public std::enable_shared_from_this<TCPConnectionPool> {
+
+public:
+    typedef std::shared_ptr<TCPConnectionPool> pointer;
+    typedef std::shared_ptr<TCPSocket> SocketPointer;
+
+    // The socket is null on failure.
+    // Sockets are handed out through pointers of their own which give the socket back once dropped.
+    typedef std::function<void(const boost::system::error_code&, SocketPointer)> OnAcquireCallback;
+
+    static const size_t kDefaultMaxIdlePerEndpoint = 8;
+    static const size_t kDefaultMaxTotal = 64;
+    static const std::chrono::milliseconds kDefaultIdleTimeout;
+
+    static pointer Create(boost::asio::io_service& io_service,
+                          size_t max_idle_per_endpoint = kDefaultMaxIdlePerEndpoint,
+                          size_t max_total = kDefaultMaxTotal,
+                          std::chrono::milliseconds idle_timeout = kDefaultIdleTimeout);
+
+    // Closes whatever is still idle or connecting, checked out sockets are left alone
+    ~TCPConnectionPool();
+
+    // Checks out an idle socket to the endpoint, or connects a new one.
+    // Once max_total sockets are out, the request waits for one to be released or discarded.
+    // The callback is always invoked asynchronously.
+    void Acquire(const std::string& host, const std::string& service, OnAcquireCallback on_acquire_callback);
+
+    // Returns a socket to the pool. Every received byte must have been consumed,
+    // otherwise the socket is in an unknown protocol state and gets discarded.
+    // The socket must not be used anymore afterwards, even though the pointer may be kept.
+    void Release(const SocketPointer& socket);
+
+    // Closes a socket which is no longer usable and frees its slot
+    void Discard(const SocketPointer& socket);
+
+    // Closes every idle and connecting socket and fails every pending request.
+    // Sockets which are checked out stay usable and are closed once released.
+    void Shutdown();
+
+    size_t idle_count() const;
+    size_t total_count() const { return endpoints_.size(); }
+
+private:
+    typedef std::pair<std::string, std::string> Key;
+    typedef std::chrono::steady_clock Clock;
+
+    struct IdleSocket {
+        SocketPointer socket;
+        Clock::time_point idle_since;
+    };
+
+    struct Connecting {
+        SocketPointer socket;
+        OnAcquireCallback callback;
+    };
+
+    struct Waiter {
+        Key key;
+        OnAcquireCallback callback;
+    };
+
+    struct CheckedOut {
+        SocketPointer socket;
+        // Tells a socket dropped while still out from one which was checked out again since
+        uint64_t checkout_id;
+    };
+
+    TCPConnectionPool(boost::asio::io_service& io_service,
+                      size_t max_idle_per_endpoint,
+                      size_t max_total,
+                      std::chrono::milliseconds idle_timeout);
+
+    void Connect(const Key& key, OnAcquireCallback on_acquire_callback);
+    void HandleConnect(TCPSocket* p_socket, const boost::system::error_code& ec);
+    SocketPointer TakeIdle(const Key& key);
+    void Evict(TCPSocket* p_socket);
+    void Close(const SocketPointer& socket);
+    void ServeWaiters();
+    void Complete(const OnAcquireCallback& callback, const boost::system::error_code& ec, const SocketPointer& socket);
+    SocketPointer CheckIn(const SocketPointer& socket);
+    void Reclaim(TCPSocket* p_socket, uint64_t checkout_id);
+    static SocketPointer HandOut(const std::weak_ptr<TCPConnectionPool>& weak_pool, const SocketPointer& socket, uint64_t checkout_id);
+    void ScheduleReaper();
+    void Reap(const boost::system::error_code& ec);
+    static bool IsHealthy(TCPSocket& socket);
+
+    boost::asio::io_service& io_service_;
+    HostResolver host_resolver_;
+    boost::asio::steady_timer reaper_timer_;
+    size_t max_idle_per_endpoint_;
+    size_t max_total_;
+    std::chrono::milliseconds idle_timeout_;
+
+    // Idle sockets per endpoint; the most recently released one is at the back
+    std::map<Key, std::deque<IdleSocket>> idle_;
+
+    // Every socket this pool accounts for, be it connecting, checked out or idle
+    std::unordered_map<TCPSocket*, Key> endpoints_;
+
+    // Sockets are only owned by the pool until they are handed out
+    std::unordered_map<TCPSocket*, Connecting> connecting_;
+
+    // The sockets behind the pointers which are handed out
+    std::unordered_map<TCPSocket*, CheckedOut> checked_out_;
+    uint64_t next_checkout_id_;
+
+    std::deque<Waiter> waiters_;
+    bool is_shut_down_;
+
+    static const std::string kWho;
+};
+
+}
+}
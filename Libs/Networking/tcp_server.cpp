@@ -1,6 +1,12 @@
 #include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
 #include "tcp_server.h"
 
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && !defined(_WIN32)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace Phyre
 {
 namespace Networking
@@ -9,36 +15,232 @@ namespace Networking
     using boost::asio::ip::tcp;
     using std::queue;
     using std::string;
-    
+
     const string TCPServer::kWho = "[TCPServer]";
+    const std::chrono::milliseconds TCPServer::kAcceptRetryDelay(100);
+
+    namespace {
+        TCPServerConnection::MessageList MakeMessageList(queue<string> message_queue) {
+            auto ptr_messages = std::make_shared<std::vector<string>>();
+            ptr_messages->reserve(message_queue.size());
+            while (!message_queue.empty()) {
+                ptr_messages->push_back(std::move(message_queue.front()));
+                message_queue.pop();
+            }
+            return ptr_messages;
+        }
+
+        // Errors which accepting right away again would only run into again
+        bool IsOutOfResources(const boost::system::error_code& error) {
+            return error == boost::asio::error::no_descriptors ||
+                   error == boost::asio::error::no_buffer_space ||
+                   error == boost::asio::error::no_memory ||
+                   error == boost::system::errc::too_many_files_open_in_system;
+        }
 
-    TCPServer::TCPServer(boost::asio::io_service& io_service, uint16_t listen_port, const queue<string>& message_queue):
-        acceptor_(io_service, tcp::endpoint(tcp::v4(), listen_port)),
-        message_queue_(message_queue) { }
+        // Binding fails while the socket file exists, even though nobody listens on it anymore.
+        // Only a socket file nobody accepts on is removed: anything else at the path is left alone,
+        // and a live server keeps its path, which the bind is then refused with address_in_use.
+        void RemoveStaleSocketFile(boost::asio::io_service& io_service, const StreamEndpoint& endpoint) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && !defined(_WIN32)
+            // Abstract socket names start with a NUL and have no file to remove
+            std::string path = LocalPath(endpoint);
+            struct stat status;
+            if (path.empty() || path[0] == '\0' || ::lstat(path.c_str(), &status) != 0 || !S_ISSOCK(status.st_mode)) {
+                return;
+            }
+            StreamSocket probe(io_service);
+            boost::system::error_code ec;
+            probe.connect(endpoint, ec);
+            if (!ec) {
+                throw boost::system::system_error(boost::asio::error::address_in_use, "A server is listening on " + path);
+            }
+            if (ec == boost::asio::error::connection_refused) {
+                ::unlink(path.c_str());
+            }
+#else
+            (void)io_service;
+            (void)endpoint;
+#endif
+        }
+    }
+
+    TCPServer::TCPServer(boost::asio::io_service& io_service,
+                         uint16_t listen_port,
+                         const queue<string>& message_queue,
+                         bool reuse_port):
+        TCPServer(io_service, StreamEndpoint(tcp::endpoint(tcp::v4(), listen_port)), message_queue, reuse_port) { }
+
+    TCPServer::TCPServer(boost::asio::io_service& io_service,
+                         const StreamEndpoint& endpoint,
+                         const queue<string>& message_queue,
+                         bool reuse_port):
+        p_io_service_(&io_service),
+        acceptor_(io_service),
+        ptr_accept_strand_(std::make_unique<boost::asio::io_service::strand>(io_service)),
+        accept_retry_timer_(io_service),
+        ptr_lifetime_(std::make_shared<char>()),
+        ptr_registry_(std::make_shared<ConnectionRegistry>()),
+        ptr_metrics_(std::make_shared<ConnectionMetrics>()),
+        ptr_messages_(MakeMessageList(message_queue)),
+        p_tls_context_(nullptr),
+        read_timeout_(0),
+        write_timeout_(0),
+        idle_timeout_(0),
+        initial_receive_capacity_(ReceiveBuffer::kDefaultInitialCapacity),
+        max_receive_capacity_(ReceiveBuffer::kDefaultMaxCapacity),
+        is_file_descriptor_passing_(false)
+    {
+        RemoveStaleSocketFile(io_service, endpoint);
+        acceptor_.open(endpoint.protocol());
+        if (!IsLocal(endpoint)) {
+            acceptor_.set_option(boost::asio::socket_base::reuse_address(true));
+        }
+        if (reuse_port) {
+#if defined(SO_REUSEPORT)
+            acceptor_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#else
+            throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+        }
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+    }
 
-    // For now, this server is only meant to hold one single connection.
-    // It will need tweaking to support multiple simultaneous connections.
     void TCPServer::StartAccept() {
-        ptr_connection_ = TCPServerConnection::Create(acceptor_.get_io_service(), message_queue_);
-        if (!ptr_connection_) {
+        TCPServerConnection::pointer connection = TCPServerConnection::Create(*p_io_service_, ptr_messages_, ptr_metrics_);
+        if (!connection) {
             PHYRE_LOG(error, kWho) << "No connection available";
             return;
         }
+        connection->receive_buffer() = ReceiveBuffer(initial_receive_capacity_, max_receive_capacity_);
+        connection->set_on_read_callback(on_read_callback_);
+        connection->set_tls_context(p_tls_context_);
+        connection->set_file_descriptor_passing(is_file_descriptor_passing_);
+        connection->set_write_limits(write_limits_);
+        connection->set_on_writable_callback(on_writable_callback_);
+        connection->set_read_rate_limits(read_rate_limits_);
+        connection->set_global_read_rate_limiter(ptr_global_read_rate_limiter_);
+        if (ptr_timing_wheel_) {
+            connection->set_timeouts(ptr_timing_wheel_, read_timeout_, write_timeout_, idle_timeout_);
+        }
 
-        acceptor_.async_accept(ptr_connection_->socket(),
-                               boost::bind(&TCPServer::HandleAccept,
-                                           this,
-                                           boost::asio::placeholders::error));
+        acceptor_.async_accept(connection->socket(),
+                               ptr_accept_strand_->wrap(boost::bind(&TCPServer::HandleAccept,
+                                                                    this,
+                                                                    connection,
+                                                                    boost::asio::placeholders::error)));
     }
 
-    void TCPServer::HandleAccept(const boost::system::error_code& error) {
-        if (!error)
-        {
-            ptr_connection_->Write();
-            StartAccept();
+    void TCPServer::HandleAccept(const TCPServerConnection::pointer& connection, const boost::system::error_code& error) {
+        if (error == boost::asio::error::operation_aborted || !acceptor_.is_open()) {
+            return;
         }
+
+        if (error) {
+            // Running out of descriptors should not bring the whole server down, but the pending
+            // connection stays in the backlog so accepting again right away would just spin
+            PHYRE_LOG(warning, kWho) << "Failed to accept a connection: " << error.message();
+            if (!IsOutOfResources(error)) {
+                StartAccept();
+                return;
+            }
+            accept_retry_timer_.expires_from_now(kAcceptRetryDelay);
+            accept_retry_timer_.async_wait(ptr_accept_strand_->wrap(boost::bind(&TCPServer::HandleAcceptRetry,
+                                                                                this,
+                                                                                boost::asio::placeholders::error)));
+            return;
+        }
+
+        // The registry only holds a weak reference to itself through the callback
+        // so that connections which outlive the server do not keep it alive
+        std::weak_ptr<ConnectionRegistry> weak_registry = ptr_registry_;
+        ConnectionCallback on_close_callback = on_close_callback_;
+        connection->set_on_close_callback([weak_registry, on_close_callback](const TCPServerConnection::pointer& closed) {
+            ConnectionRegistry::pointer registry = weak_registry.lock();
+            if (registry) {
+                registry->Remove(closed);
+            }
+            if (on_close_callback) {
+                on_close_callback(closed);
+            }
+        });
+        ptr_registry_->Add(connection);
+        if (on_accept_callback_) {
+            on_accept_callback_(connection);
+        }
+        connection->Start();
+        StartAccept();
+    }
+
+    void TCPServer::HandleAcceptRetry(const boost::system::error_code& error) {
+        if (error == boost::asio::error::operation_aborted || !acceptor_.is_open()) {
+            return;
+        }
+        StartAccept();
+    }
+
+    void TCPServer::set_tls_context(boost::asio::ssl::context* p_tls_context) {
+        if (p_tls_context) {
+            // Required for clients to resume sessions from the server side session cache
+            static const unsigned char kSessionIdContext[] = "Phyre";
+            SSL_CTX_set_session_id_context(p_tls_context->native_handle(), kSessionIdContext, sizeof(kSessionIdContext) - 1);
+        }
+        p_tls_context_ = p_tls_context;
+    }
+
+    void TCPServer::set_global_read_rate_limits(const ReadRateLimits& read_rate_limits) {
+        ptr_global_read_rate_limiter_ = read_rate_limits.is_limited()
+            ? std::make_shared<ReadRateLimiter>(read_rate_limits)
+            : ReadRateLimiter::pointer();
+    }
+
+    void TCPServer::set_timeouts(std::chrono::milliseconds read_timeout,
+                                 std::chrono::milliseconds write_timeout,
+                                 std::chrono::milliseconds idle_timeout) {
+        if (!ptr_timing_wheel_) {
+            ptr_timing_wheel_ = TimingWheel::Create(*p_io_service_);
+        }
+        read_timeout_ = read_timeout;
+        write_timeout_ = write_timeout;
+        idle_timeout_ = idle_timeout;
+    }
+
+    void TCPServer::Run(size_t worker_count) {
+        if (worker_count == 0) {
+            worker_count = std::max(1u, boost::thread::hardware_concurrency());
+        }
+
+        StartAccept();
+        PHYRE_LOG(info, kWho) << "Serving on " << ToString(acceptor_.local_endpoint())
+                              << " with " << worker_count << " worker thread(s)";
+
+        boost::thread_group workers;
+        for (size_t i = 0; i < worker_count; ++i) {
+            boost::asio::io_service* p_io_service = p_io_service_;
+            workers.create_thread([p_io_service]() { p_io_service->run(); });
+        }
+        workers.join_all();
+    }
+
+    StreamEndpoint TCPServer::local_endpoint() const {
+        boost::system::error_code ignored;
+        return acceptor_.local_endpoint(ignored);
+    }
+
+    void TCPServer::Stop() {
+        // Closing from the caller's thread would race with the workers accepting
+        std::weak_ptr<char> lifetime = ptr_lifetime_;
+        ptr_accept_strand_->dispatch([this, lifetime]() {
+            if (lifetime.expired()) {
+                return;
+            }
+            boost::system::error_code ignored;
+            acceptor_.close(ignored);
+            accept_retry_timer_.cancel(ignored);
+            ptr_registry_->CloseAll();
+        });
     }
 }
 }
 
-
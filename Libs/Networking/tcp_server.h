@@ -1,5 +1,6 @@
 #pragma once
 #include <boost/asio.hpp>
+#include "connection_registry.h"
 #include "tcp_server_connection.h"
 
 namespace Phyre {
@@ -7,18 +8,125 @@ namespace Networking {
 class TCPServer {
 
 public:
-    TCPServer(boost::asio::io_service& io_service, uint16_t listen_port, const std::queue<std::string>& message_queue = std::queue<std::string>());
+    typedef std::function<void(const TCPServerConnection::pointer&)> ConnectionCallback;
+
+    // With reuse_port, several servers may listen on the same port and the kernel balances
+    // accepts between them, see ShardedTCPServer. Only available where SO_REUSEPORT is.
+    TCPServer(boost::asio::io_service& io_service,
+              uint16_t listen_port,
+              const std::queue<std::string>& message_queue = std::queue<std::string>(),
+              bool reuse_port = false);
+
+    // Listens on any endpoint, e.g. an AF_UNIX one from LocalEndpoint for clients on the same host.
+    // A socket file left behind at that path by an earlier run, which nobody accepts on anymore, is replaced.
+    // Throws with address_in_use if a server still listens there or the path is anything but a socket.
+    TCPServer(boost::asio::io_service& io_service,
+              const StreamEndpoint& endpoint,
+              const std::queue<std::string>& message_queue = std::queue<std::string>(),
+              bool reuse_port = false);
 
     void StartAccept();
-    void HandleAccept(const boost::system::error_code& error);
+    void HandleAccept(const TCPServerConnection::pointer& connection, const boost::system::error_code& error);
+
+    // Starts accepting and runs the io_service on worker_count threads.
+    // Blocks until the io_service runs out of work or gets stopped.
+    // A worker_count of 0 uses one worker per hardware thread.
+    void Run(size_t worker_count = 0);
+
+    // Stops accepting new clients and closes every live connection.
+    // Safe to call from any thread, it takes effect once the io_service gets to run it.
+    void Stop();
+
+    // Sizes of the receive window of connections accepted from now on
+    void set_receive_buffer_capacity(size_t initial_capacity, size_t max_capacity) {
+        initial_receive_capacity_ = initial_capacity;
+        max_receive_capacity_ = max_capacity;
+    }
+
+    // Handles the reads of connections accepted from now on, see TCPServerConnection::set_on_read_callback
+    void set_on_read_callback(TCPServerConnection::OnReadCallback on_read_callback) { on_read_callback_ = on_read_callback; }
+
+    // Told about every connection accepted from now on right before it is started, and once it is closed
+    void set_on_accept_callback(ConnectionCallback on_accept_callback) { on_accept_callback_ = on_accept_callback; }
+    void set_on_close_callback(ConnectionCallback on_close_callback) { on_close_callback_ = on_close_callback; }
+
+    // Bounds the outbound queue of connections accepted from now on, see TCPServerConnection::set_write_limits
+    void set_write_limits(const WriteLimits& write_limits) { write_limits_ = write_limits; }
+    void set_on_writable_callback(TCPServerConnection::OnWritableCallback on_writable_callback) { on_writable_callback_ = on_writable_callback; }
+
+    // Bounds how fast each connection accepted from now on may send, see TCPServerConnection::set_read_rate_limits
+    void set_read_rate_limits(const ReadRateLimits& read_rate_limits) { read_rate_limits_ = read_rate_limits; }
+
+    // Bounds how fast all connections accepted from now on may send together, on top of their own limits
+    void set_global_read_rate_limits(const ReadRateLimits& read_rate_limits);
+
+    // Shares a budget beyond this server, e.g. across every shard of a ShardedTCPServer
+    void set_global_read_rate_limiter(ReadRateLimiter::pointer ptr_read_rate_limiter) {
+        ptr_global_read_rate_limiter_ = ptr_read_rate_limiter;
+    }
+
+    // Has connections accepted from now on collect passed file descriptors, see TCPServerConnection::set_file_descriptor_passing
+    void set_file_descriptor_passing(bool is_enabled) { is_file_descriptor_passing_ = is_enabled; }
+
+    // Has connections accepted from now on handshake with this context before being served,
+    // or serves them in plaintext if it is null. The context must outlive the server.
+    void set_tls_context(boost::asio::ssl::context* p_tls_context);
+
+    // Deadlines of connections accepted from now on, all checked on a single timing wheel.
+    // A timeout of zero disables the respective deadline; see ConnectionDeadlines.
+    void set_timeouts(std::chrono::milliseconds read_timeout,
+                      std::chrono::milliseconds write_timeout,
+                      std::chrono::milliseconds idle_timeout);
+
+    // Queues one shared payload to every live connection, or those the filter accepts, see ConnectionRegistry::Broadcast.
+    // Safe to call from any thread. @return The number of connections the payload was queued to
+    size_t Broadcast(const WriteQueue::SharedBuffer& ptr_payload,
+                     const ConnectionRegistry::OnDeliveredCallback& on_delivered = ConnectionRegistry::OnDeliveredCallback(),
+                     const ConnectionRegistry::Filter& filter = ConnectionRegistry::Filter()) {
+        return ptr_registry_->Broadcast(ptr_payload, on_delivered, filter);
+    }
+
+    StreamEndpoint local_endpoint() const;
+    size_t connection_count() const { return ptr_registry_->size(); }
+    const ConnectionRegistry& connections() const { return *ptr_registry_; }
+
+    // The sum of the metrics of every connection this server has accepted
+    const ConnectionMetrics& metrics() const { return *ptr_metrics_; }
 
 private:
-    boost::asio::ip::tcp::acceptor acceptor_;
-    TCPServerConnection::pointer ptr_connection_;
-    std::queue<std::string> message_queue_;
+    // How long to back off once the process or the system ran out of descriptors or memory
+    static const std::chrono::milliseconds kAcceptRetryDelay;
+
+    void HandleAcceptRetry(const boost::system::error_code& error);
+
+    boost::asio::io_service* p_io_service_;
+    StreamAcceptor acceptor_;
+    // Every worker may run the accept handlers, so they and Stop take turns touching the acceptor
+    std::unique_ptr<boost::asio::io_service::strand> ptr_accept_strand_;
+    boost::asio::steady_timer accept_retry_timer_;
+    // Tells handlers posted by Stop whether the server is still around
+    std::shared_ptr<char> ptr_lifetime_;
+    ConnectionRegistry::pointer ptr_registry_;
+    ConnectionMetrics::pointer ptr_metrics_;
+    // Built once and shared by every connection instead of being copied into each of them
+    TCPServerConnection::MessageList ptr_messages_;
+    WriteLimits write_limits_;
+    ReadRateLimits read_rate_limits_;
+    ReadRateLimiter::pointer ptr_global_read_rate_limiter_;
+    TCPServerConnection::OnWritableCallback on_writable_callback_;
+    TCPServerConnection::OnReadCallback on_read_callback_;
+    ConnectionCallback on_accept_callback_;
+    ConnectionCallback on_close_callback_;
+    boost::asio::ssl::context* p_tls_context_;
+    TimingWheel::pointer ptr_timing_wheel_;
+    std::chrono::milliseconds read_timeout_;
+    std::chrono::milliseconds write_timeout_;
+    std::chrono::milliseconds idle_timeout_;
+    size_t initial_receive_capacity_;
+    size_t max_receive_capacity_;
+    bool is_file_descriptor_passing_;
     static const std::string kWho;
 };
 }
 }
 
-
@@ -5,52 +5,471 @@ namespace Networking {
 
     const std::string TCPServerConnection::kWho = "[TCPServerConnection]";
 
-    TCPServerConnection::TCPServerConnection(boost::asio::io_service& io_service, const std::queue<std::string>& message_queue):
+    TCPServerConnection::TCPServerConnection(boost::asio::io_service& io_service,
+                                             MessageList ptr_messages,
+                                             ConnectionMetrics::pointer ptr_aggregate_metrics):
         socket_(io_service),
+        p_tls_context_(nullptr),
+        strand_(io_service),
+        ptr_metrics_(std::make_shared<ConnectionMetrics>(ptr_aggregate_metrics)),
+        ptr_read_handler_memory_(std::make_shared<HandlerMemory>()),
+        ptr_write_handler_memory_(std::make_shared<HandlerMemory>()),
         default_message_("Greetings From TCPServerConnection!\r\n"),
-        message_queue_(message_queue) { }
+        ptr_messages_(ptr_messages),
+        next_message_(0),
+        is_write_blocked_(false),
+        throttle_timer_(io_service),
+        is_read_throttled_(false),
+        is_closed_(false),
+        is_read_in_flight_(false),
+        is_reading_paused_(false),
+        is_handshaking_(false),
+        is_tls_(false),
+        is_file_descriptor_passing_(false) {
+        write_queue_.set_metrics(ptr_metrics_);
+    }
+
 
+    TCPServerConnection::~TCPServerConnection() {
+        CloseFileDescriptors(received_file_descriptors_);
+    }
 
     TCPServerConnection::pointer
-    TCPServerConnection::Create(boost::asio::io_service& io_service, const std::queue<std::string>& message_queue) {
-        return pointer(new TCPServerConnection(io_service, message_queue));
+    TCPServerConnection::Create(boost::asio::io_service& io_service,
+                                MessageList ptr_messages,
+                                ConnectionMetrics::pointer ptr_aggregate_metrics) {
+        return pointer(new TCPServerConnection(io_service, ptr_messages, ptr_aggregate_metrics));
+    }
+
+    void TCPServerConnection::Start() {
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoStart, shared_from_this()));
+    }
+
+    void TCPServerConnection::DoStart() {
+        // The clocks start before any handshake so that stalled handshakes time out too
+        deadlines_.Start();
+        if (p_tls_context_) {
+            // The handshake handler keeps the connection alive while this runs
+            DoStartTLS(*p_tls_context_, [this]() { Serve(); });
+            return;
+        }
+        Serve();
+    }
+
+    void TCPServerConnection::set_timeouts(TimingWheel::pointer ptr_timing_wheel,
+                                           std::chrono::milliseconds read_timeout,
+                                           std::chrono::milliseconds write_timeout,
+                                           std::chrono::milliseconds idle_timeout) {
+        // The wheel only holds on to a weak reference so that it does not keep closed connections around
+        std::weak_ptr<TCPServerConnection> weak_self = shared_from_this();
+        deadlines_.Configure(ptr_timing_wheel, read_timeout, write_timeout, idle_timeout, [weak_self]() {
+            pointer self = weak_self.lock();
+            if (self) {
+                self->strand_.dispatch(boost::bind(&TCPServerConnection::CheckDeadlines, self));
+            }
+        });
+    }
+
+    void TCPServerConnection::CheckDeadlines() {
+        ConnectionDeadlines::Expiry expiry = deadlines_.Check();
+        if (expiry != ConnectionDeadlines::kNone) {
+            PHYRE_LOG(info, kWho) << "Closing the connection after its " << ConnectionDeadlines::ToString(expiry) << " timeout";
+            DoClose();
+        }
+    }
+
+    void TCPServerConnection::Serve() {
+        if (!on_read_callback_) {
+            DoWrite();
+        }
+        DoResumeReading();
+    }
+
+    void TCPServerConnection::StartTLS(boost::asio::ssl::context& context, std::function<void()> on_secured) {
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoStartTLS, shared_from_this(), boost::ref(context), on_secured));
+    }
+
+    void TCPServerConnection::DoStartTLS(boost::asio::ssl::context& context, const std::function<void()>& on_secured) {
+        if (is_closed_ || is_handshaking_ || is_tls_) {
+            return;
+        }
+        on_secured_callback_ = on_secured;
+        is_handshaking_ = true;
+        ptr_ssl_stream_ = std::make_unique<boost::asio::ssl::stream<StreamSocket&>>(socket_, context);
+
+        // The plaintext read has to get out of the way first, HandleRead picks up from there
+        if (is_read_in_flight_) {
+            boost::system::error_code ignored;
+            socket_.cancel(ignored);
+            return;
+        }
+        StartHandshake();
+    }
+
+    void TCPServerConnection::StartHandshake(size_t received_bytes) {
+        if (received_bytes > 0) {
+            ptr_ssl_stream_->async_handshake(boost::asio::ssl::stream_base::server,
+                    boost::asio::buffer(receive_buffer_.data().data(), received_bytes),
+                    strand_.wrap(boost::bind(&TCPServerConnection::HandleBufferedHandshake, shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred)));
+            return;
+        }
+        ptr_ssl_stream_->async_handshake(boost::asio::ssl::stream_base::server,
+                strand_.wrap(boost::bind(&TCPServerConnection::HandleHandshake, shared_from_this(),
+                    boost::asio::placeholders::error)));
+    }
+
+    void TCPServerConnection::HandleBufferedHandshake(const boost::system::error_code& error, size_t bytes_used) {
+        receive_buffer_.Consume(bytes_used);
+        HandleHandshake(error);
+    }
+
+    void TCPServerConnection::HandleHandshake(const boost::system::error_code& error) {
+        is_handshaking_ = false;
+        if (error) {
+            PHYRE_LOG(warning, kWho) << "TLS handshake failed: " << error.message();
+            DoClose();
+            return;
+        }
+
+        is_tls_ = true;
+        std::function<void()> on_secured;
+        on_secured.swap(on_secured_callback_);
+        if (on_secured) {
+            on_secured();
+        }
+        StartRead();
+        if (!is_closed_ && !write_queue_.empty() && !write_queue_.write_in_flight()) {
+            StartWrite();
+        }
+    }
+
+    void TCPServerConnection::Close() {
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoClose, shared_from_this()));
+    }
+
+    void TCPServerConnection::DoClose() {
+        if (is_closed_) {
+            return;
+        }
+        is_closed_ = true;
+        deadlines_.Stop();
+        throttle_timer_.cancel();
+
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        write_queue_.Clear(boost::asio::error::operation_aborted);
+        if (on_close_callback_) {
+            on_close_callback_(shared_from_this());
+        }
     }
 
     void TCPServerConnection::HandleError(const boost::system::error_code& error) {
-        PHYRE_LOG(error, kWho) << error.message();
-        socket_.close();
+        if (error != boost::asio::error::eof && error != boost::asio::error::operation_aborted) {
+            PHYRE_LOG(error, kWho) << error.message();
+        }
+        DoClose();
     }
 
     void TCPServerConnection::HandleRead(const boost::system::error_code& error, size_t bytes_transferred) {
+        is_read_in_flight_ = false;
+
+        // This is the plaintext read StartTLS cancelled. It may have completed before the cancellation
+        // got to it, in which case what it read is already the client's side of the handshake.
+        if (is_handshaking_ && !is_closed_) {
+            if (error || bytes_transferred == 0) {
+                StartHandshake();
+                return;
+            }
+            // Plaintext the owner left unconsumed means nothing on the secured stream
+            size_t plaintext = receive_buffer_.size();
+            receive_buffer_.Commit(bytes_transferred);
+            receive_buffer_.Consume(plaintext);
+            ptr_metrics_->RecordRead(bytes_transferred);
+            StartHandshake(bytes_transferred);
+            return;
+        }
         if (error) {
             HandleError(error);
             return;
         }
-        std::ostringstream oss;
-        oss.write(buffer_.data(), bytes_transferred);
-        PHYRE_LOG(info, kWho) << oss.str();
-        Write();
+        receive_buffer_.Commit(bytes_transferred);
+        ptr_metrics_->RecordRead(bytes_transferred);
+        deadlines_.OnRead();
+        ThrottleReads(bytes_transferred);
+        if (on_read_callback_) {
+            receive_buffer_.Consume(on_read_callback_(shared_from_this(), receive_buffer_.data()));
+            StartRead();
+            return;
+        }
+
+        // Kept off the default log level, a chatty client would otherwise spend the server's time on logging
+        PHYRE_LOG(trace, kWho) << receive_buffer_.data();
+        receive_buffer_.Consume(receive_buffer_.size());
+        DoWrite();
+        StartRead();
     }
 
     void TCPServerConnection::Write() {
-        std::string message;
-        if (!message_queue_.empty()) {
-            message = message_queue_.front();
-            message_queue_.pop();
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoWrite, shared_from_this()));
+    }
+
+    void TCPServerConnection::Write(const std::string& data, WriteQueue::OnWriteCallback on_write_callback) {
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoSend, shared_from_this(), data, on_write_callback));
+    }
+
+    void TCPServerConnection::Write(WriteQueue::SharedBuffer ptr_data, WriteQueue::OnWriteCallback on_write_callback) {
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoSendShared, shared_from_this(), ptr_data, on_write_callback));
+    }
+
+    void TCPServerConnection::DoSend(const std::string& data, const WriteQueue::OnWriteCallback& on_write_callback) {
+        if (PrepareSend(on_write_callback)) {
+            FinishSend(write_queue_.Push(data, on_write_callback));
+        }
+    }
+
+    void TCPServerConnection::DoSendShared(const WriteQueue::SharedBuffer& ptr_data, const WriteQueue::OnWriteCallback& on_write_callback) {
+        if (PrepareSend(on_write_callback)) {
+            FinishSend(write_queue_.Push(ptr_data, on_write_callback));
+        }
+    }
+
+    void TCPServerConnection::WriteFile(SendableFile::pointer ptr_file, FileRange range, WriteQueue::OnWriteCallback on_write_callback) {
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoSendFile, shared_from_this(), ptr_file, range, on_write_callback));
+    }
+
+    void TCPServerConnection::DoSendFile(const SendableFile::pointer& ptr_file, FileRange range, const WriteQueue::OnWriteCallback& on_write_callback) {
+        if (!ptr_file || range.offset > ptr_file->size() || range.length > ptr_file->size() - range.offset) {
+            PHYRE_LOG(warning, kWho) << "Cannot send a range which is not within the file";
+            if (on_write_callback) {
+                on_write_callback(boost::asio::error::invalid_argument, 0);
+            }
+            return;
+        }
+        if (range.length == 0) {
+            if (on_write_callback) {
+                on_write_callback(boost::system::error_code(), 0);
+            }
+            return;
+        }
+        if (PrepareSend(on_write_callback)) {
+            FinishSend(write_queue_.Push(ptr_file, range, on_write_callback));
+        }
+    }
+
+    bool TCPServerConnection::PrepareSend(const WriteQueue::OnWriteCallback& on_write_callback) {
+        if (is_closed_) {
+            if (on_write_callback) {
+                on_write_callback(boost::asio::error::not_connected, 0);
+            }
+            return false;
+        }
+        return AdmitWrite(on_write_callback);
+    }
+
+    void TCPServerConnection::FinishSend(bool should_start_write) {
+        // Writes queued during a handshake go out encrypted once it is done
+        if (should_start_write && !is_handshaking_) {
+            StartWrite();
+        }
+        if (write_limits_.is_bounded() && !is_write_blocked_ && write_queue_.pending_bytes() >= write_limits_.high_water_mark) {
+            PHYRE_LOG(debug, kWho) << "The client fell " << write_queue_.pending_bytes() << " bytes behind, pausing reads";
+            is_write_blocked_ = true;
+        }
+    }
+
+    void TCPServerConnection::WriteFileDescriptors(const std::string& data,
+                                                   const std::vector<int>& file_descriptors,
+                                                   WriteQueue::OnWriteCallback on_write_callback) {
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoSendFileDescriptors, shared_from_this(),
+                                     data, file_descriptors, on_write_callback));
+    }
+
+    void TCPServerConnection::DoSendFileDescriptors(const std::string& data,
+                                                    const std::vector<int>& file_descriptors,
+                                                    const WriteQueue::OnWriteCallback& on_write_callback) {
+        boost::system::error_code ec;
+#if !defined(PHYRE_HAS_FILE_DESCRIPTOR_PASSING)
+        ec = boost::asio::error::operation_not_supported;
+#endif
+        if (is_closed_) {
+            ec = boost::asio::error::not_connected;
+        } else if (is_tls_ || is_handshaking_) {
+            ec = boost::asio::error::operation_not_supported;
+        } else if (data.empty()) {
+            ec = boost::asio::error::invalid_argument;
+        }
+        if (ec) {
+            PHYRE_LOG(warning, kWho) << "Cannot pass file descriptors: " << ec.message();
+            if (on_write_callback) {
+                on_write_callback(ec, 0);
+            }
+            return;
+        }
+        if (AdmitWrite(on_write_callback)) {
+            FinishSend(write_queue_.Push(data, on_write_callback, file_descriptors));
+        }
+    }
+
+    std::vector<int> TCPServerConnection::TakeFileDescriptors() {
+        std::vector<int> file_descriptors;
+        file_descriptors.swap(received_file_descriptors_);
+        return file_descriptors;
+    }
+
+    bool TCPServerConnection::AdmitWrite(const WriteQueue::OnWriteCallback& on_write_callback) {
+        // The write which crosses the high water mark still goes through, so a
+        // single message larger than the mark does not get stuck forever
+        if (!is_write_blocked_) {
+            return true;
+        }
+
+        if (on_write_callback) {
+            on_write_callback(write_limits_.policy == WriteLimits::kBlock ? boost::asio::error::would_block
+                                                                          : boost::asio::error::no_buffer_space, 0);
+        }
+        if (write_limits_.policy == WriteLimits::kDisconnect) {
+            PHYRE_LOG(warning, kWho) << "Disconnecting a client which fell " << write_queue_.pending_bytes() << " bytes behind";
+            DoClose();
+        }
+        return false;
+    }
+
+    void TCPServerConnection::StartWrite() {
+        deadlines_.OnWriteStarted();
+        // The memory is handed to the inner handler since the strand forwards its allocations there
+        auto handle_write = strand_.wrap(MakeCustomAllocHandler(ptr_write_handler_memory_,
+                    boost::bind(&TCPServerConnection::HandleWrite, shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred)));
+        WriteQueue::BufferSequence batch = write_queue_.PrepareBatch();
+        if (write_queue_.batch_file()) {
+            if (is_tls_) {
+                AsyncCopyFile(*ptr_ssl_stream_, write_queue_.batch_file(), write_queue_.batch_file_range(), handle_write);
+            } else {
+                AsyncSendFile(socket_, write_queue_.batch_file(), write_queue_.batch_file_range(), handle_write);
+            }
+        } else if (is_tls_) {
+            boost::asio::async_write(*ptr_ssl_stream_, batch, handle_write);
+        } else if (!write_queue_.batch_file_descriptors().empty()) {
+            AsyncWriteWithFileDescriptors(socket_, *batch.begin(), write_queue_.batch_file_descriptors(), handle_write);
         } else {
-            message = default_message_;
+            boost::asio::async_write(socket_, batch, handle_write);
         }
+    }
 
-        write(socket_, boost::asio::buffer(message));
+    void TCPServerConnection::HandleWrite(const boost::system::error_code& error, size_t bytes_transferred) {
+        deadlines_.OnWriteCompleted();
+        if (write_queue_.Complete(error, bytes_transferred)) {
+            StartWrite();
+        }
+        if (error) {
+            HandleError(error);
+            return;
+        }
 
+        if (is_write_blocked_ && write_queue_.pending_bytes() <= write_limits_.low_water_mark) {
+            PHYRE_LOG(debug, kWho) << "The client caught up, resuming reads";
+            is_write_blocked_ = false;
+            StartRead();
+            if (on_writable_callback_) {
+                on_writable_callback_(shared_from_this());
+            }
+        }
+    }
+
+    void TCPServerConnection::DoWrite() {
+        if (is_closed_) {
+            return;
+        }
+
+        if (ptr_messages_ && next_message_ < ptr_messages_->size()) {
+            DoSend((*ptr_messages_)[next_message_++], WriteQueue::OnWriteCallback());
+        } else {
+            DoSend(default_message_, WriteQueue::OnWriteCallback());
+        }
+    }
+
+    void TCPServerConnection::set_read_rate_limits(const ReadRateLimits& read_rate_limits) {
+        ptr_read_rate_limiter_ = read_rate_limits.is_limited()
+            ? std::make_shared<ReadRateLimiter>(read_rate_limits)
+            : ReadRateLimiter::pointer();
+    }
+
+    void TCPServerConnection::ThrottleReads(size_t bytes_transferred) {
+        // The bytes are in already, so they are charged after the fact and the next read waits out the debt
+        TokenBucket::Clock::time_point now = TokenBucket::Clock::now();
+        TokenBucket::Clock::duration pause = TokenBucket::Clock::duration::zero();
+        if (ptr_read_rate_limiter_) {
+            pause = ptr_read_rate_limiter_->Charge(bytes_transferred, now);
+        }
+        if (ptr_global_read_rate_limiter_) {
+            pause = std::max(pause, ptr_global_read_rate_limiter_->Charge(bytes_transferred, now));
+        }
+        if (pause <= TokenBucket::Clock::duration::zero()) {
+            return;
+        }
+
+        PHYRE_LOG(debug, kWho) << "The client went over its read rate, pausing reads for "
+                               << std::chrono::duration_cast<std::chrono::milliseconds>(pause).count() << "ms";
+        is_read_throttled_ = true;
+        throttle_timer_.expires_from_now(pause);
+        throttle_timer_.async_wait(strand_.wrap(boost::bind(&TCPServerConnection::HandleThrottle, shared_from_this(),
+                                                            boost::asio::placeholders::error)));
+    }
+
+    void TCPServerConnection::HandleThrottle(const boost::system::error_code& error) {
+        is_read_throttled_ = false;
+        if (!error) {
+            StartRead();
+        }
+    }
+
+    void TCPServerConnection::PauseReading() {
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoPauseReading, shared_from_this()));
+    }
+
+    void TCPServerConnection::ResumeReading() {
+        strand_.dispatch(boost::bind(&TCPServerConnection::DoResumeReading, shared_from_this()));
+    }
+
+    void TCPServerConnection::DoPauseReading() {
+        is_reading_paused_ = true;
+    }
+
+    void TCPServerConnection::DoResumeReading() {
+        is_reading_paused_ = false;
+        StartRead();
+    }
+
+    void TCPServerConnection::StartRead() {
+        // Exactly one read is outstanding at any time, no matter how many writes are issued.
         // This is an asynchronous read, therefore, data may come in bursts.
         // i.e. multiple messages in the message queue may be sent at the same
         // time. However, the order in which the messages were queued in the
         // buffer should remain the same.
-        socket_.async_read_some(boost::asio::buffer(buffer_),
-                boost::bind(&TCPServerConnection::HandleRead, shared_from_this(),
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
+        if (is_closed_ || is_reading_paused_ || is_write_blocked_ || is_read_throttled_ || is_read_in_flight_ || is_handshaking_) {
+            return;
+        }
+        boost::asio::mutable_buffers_1 free_space = receive_buffer_.Prepare();
+        if (boost::asio::buffer_size(free_space) == 0) {
+            HandleError(boost::asio::error::no_buffer_space);
+            return;
+        }
+
+        is_read_in_flight_ = true;
+        auto handle_read = strand_.wrap(MakeCustomAllocHandler(ptr_read_handler_memory_,
+                    boost::bind(&TCPServerConnection::HandleRead, shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred)));
+        if (is_tls_) {
+            ptr_ssl_stream_->async_read_some(free_space, handle_read);
+        } else if (is_file_descriptor_passing_) {
+            AsyncReadWithFileDescriptors(socket_, free_space, received_file_descriptors_, handle_read);
+        } else {
+            socket_.async_read_some(free_space, handle_read);
+        }
     }
 
 }
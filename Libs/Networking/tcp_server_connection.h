@@ -1,8 +1,20 @@
 #pragma once
 #include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/bind/bind.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <atomic>
 #include <queue>
+#include <vector>
 #include <Logging/logging.h>
+#include "connection_deadlines.h"
+#include "connection_metrics.h"
+#include "handler_allocator.h"
+#include "receive_buffer.h"
+#include "stream_socket.h"
+#include "token_bucket.h"
+#include "write_queue.h"
 
 namespace Phyre {
 namespace Networking {
@@ -11,38 +23,215 @@ class TCPServerConnection : public std::enable_shared_from_this<TCPServerConnect
 
 public:
     typedef std::shared_ptr<TCPServerConnection> pointer;
+    typedef std::function<void(const pointer&)> OnCloseCallback;
 
+    // Invoked in the connection's strand once a connection which hit its high water mark has drained
+    typedef std::function<void(const pointer&)> OnWritableCallback;
+
+    // Messages shared by every connection of a server, which each walk through them on their own
+    typedef std::shared_ptr<const std::vector<std::string>> MessageList;
+
+    // Handed every received byte which has not been consumed yet, and returns how many of them it consumed.
+    // Runs in the connection's strand, and the bytes are only valid for the duration of the call.
+    typedef std::function<size_t(const pointer&, boost::string_ref)> OnReadCallback;
+
+    // Metrics of the connection are also reported into ptr_aggregate_metrics if one is given
     static pointer Create(boost::asio::io_service& io_service,
-                            const std::queue<std::string>& message_queue = std::queue<std::string>());
+                            MessageList ptr_messages = MessageList(),
+                            ConnectionMetrics::pointer ptr_aggregate_metrics = ConnectionMetrics::pointer());
+
+    ~TCPServerConnection();
+
+    // Begins serving the client once the socket has been accepted.
+    // With a TLS context, the client has to complete a handshake first.
+    // Without a read callback, the client is greeted right away.
+    void Start();
 
+    // Upgrades the connection to TLS, right away or after a STARTTLS style negotiation.
+    // Reads resume once the handshake succeeded, a failed handshake closes the connection.
+    // Safe to call from any thread since it is dispatched through the strand.
+    void StartTLS(boost::asio::ssl::context& context, std::function<void()> on_secured = std::function<void()>());
+
+    // Sends the next queued message to the client.
+    // Safe to call from any thread since it is dispatched through the strand.
     void Write();
 
-    boost::asio::ip::tcp::socket& socket() { return socket_; }
-    std::queue<std::string>& message_queue() { return message_queue_; }
+    // Queues data to be sent to the client without blocking the calling thread.
+    // Writes beyond the high water mark are subject to the overflow policy, see set_write_limits.
+    // Safe to call from any thread since it is dispatched through the strand.
+    void Write(const std::string& data, WriteQueue::OnWriteCallback on_write_callback = WriteQueue::OnWriteCallback());
+
+    // Queues a reference to an immutable payload, which any number of connections may share
+    // without copying it, see TCPServer::Broadcast. Otherwise the same as writing a string.
+    void Write(WriteQueue::SharedBuffer ptr_data, WriteQueue::OnWriteCallback on_write_callback = WriteQueue::OnWriteCallback());
+
+    // Queues a range of a file, which goes out with sendfile so that its bytes never pass through
+    // user space, or is copied a chunk at a time over TLS and where sendfile is not available.
+    // Ordered with every other write. Safe to call from any thread since it is dispatched through the strand.
+    void WriteFile(SendableFile::pointer ptr_file, FileRange range, WriteQueue::OnWriteCallback on_write_callback = WriteQueue::OnWriteCallback());
+
+    // Queues data with file descriptors attached to its first byte, see TCPSocket::WriteFileDescriptors.
+    // Safe to call from any thread since it is dispatched through the strand.
+    void WriteFileDescriptors(const std::string& data,
+                              const std::vector<int>& file_descriptors,
+                              WriteQueue::OnWriteCallback on_write_callback = WriteQueue::OnWriteCallback());
+
+    // Closes the socket. Safe to call from any thread.
+    void Close();
+
+    // Flow control: the outstanding read completes but no further read is issued
+    // until reading is resumed. Safe to call from any thread.
+    void PauseReading();
+    void ResumeReading();
+
+    StreamSocket& socket() { return socket_; }
+
+    // Configure before Start, since reads land in this window
+    ReceiveBuffer& receive_buffer() { return receive_buffer_; }
+
+    // Traffic counters of this connection, safe to query from any thread
+    const ConnectionMetrics& metrics() const { return *ptr_metrics_; }
+
+    // Replaces the default behaviour of logging what was read and answering with the next queued message.
+    // Set before Start.
+    void set_on_read_callback(OnReadCallback on_read_callback) { on_read_callback_ = on_read_callback; }
+
+    // Closes the connection once one of its deadlines passes, see ConnectionDeadlines. Set before Start.
+    void set_timeouts(TimingWheel::pointer ptr_timing_wheel,
+                      std::chrono::milliseconds read_timeout,
+                      std::chrono::milliseconds write_timeout,
+                      std::chrono::milliseconds idle_timeout);
+
+    // Bounds the outbound queue so that a peer which does not keep up cannot grow it without limit.
+    // Reads pause while the queue is above the high water mark. Set before Start.
+    void set_write_limits(const WriteLimits& write_limits) { write_limits_ = write_limits; }
+
+    // Bounds how fast this client may send. Once it goes over, reads pause until the bucket
+    // has refilled, so the peer is slowed down by TCP flow control and nothing is dropped. Set before Start.
+    void set_read_rate_limits(const ReadRateLimits& read_rate_limits);
+
+    // A budget shared with other connections, e.g. every connection of a server, which is
+    // charged on top of this connection's own limits. Set before Start.
+    void set_global_read_rate_limiter(ReadRateLimiter::pointer ptr_read_rate_limiter) {
+        ptr_global_read_rate_limiter_ = ptr_read_rate_limiter;
+    }
+
+    // Whether reads are paused for going over a read rate limit
+    bool is_read_throttled() const { return is_read_throttled_; }
+
+    // Called once a blocked queue drains down to the low water mark, which is when writes
+    // turned down with would_block should be tried again. Set before Start.
+    void set_on_writable_callback(OnWritableCallback on_writable_callback) { on_writable_callback_ = on_writable_callback; }
+
+    // Whether the outbound queue is above its high water mark. Safe to query from any thread.
+    bool is_write_blocked() const { return is_write_blocked_; }
+
+    // Reads collect file descriptors passed by an AF_UNIX client, see TakeFileDescriptors. Set before Start.
+    void set_file_descriptor_passing(bool is_enabled) { is_file_descriptor_passing_ = is_enabled; }
+
+    // Hands over the descriptors received so far. Call it from the read callback, the only place
+    // no read is collecting descriptors. Untaken ones are closed once the connection is destroyed.
+    std::vector<int> TakeFileDescriptors();
+
+    // Has the connection handshake with this context as soon as it is started. Set before Start.
+    void set_tls_context(boost::asio::ssl::context* p_tls_context) { p_tls_context_ = p_tls_context; }
+    bool is_tls() const { return is_tls_; }
+
+    // Invoked exactly once when the connection gets closed
+    void set_on_close_callback(OnCloseCallback on_close_callback) { on_close_callback_ = on_close_callback; }
 
 private:
-    TCPServerConnection(boost::asio::io_service& io_service, const std::queue<std::string>& message_queue);
+    TCPServerConnection(boost::asio::io_service& io_service,
+                        MessageList ptr_messages,
+                        ConnectionMetrics::pointer ptr_aggregate_metrics);
+    void DoStart();
+    void Serve();
+    void CheckDeadlines();
+    void DoStartTLS(boost::asio::ssl::context& context, const std::function<void()>& on_secured);
+    // Hands the first received_bytes of the receive buffer to the handshake, for a client which got there first
+    void StartHandshake(size_t received_bytes = 0);
+    void HandleBufferedHandshake(const boost::system::error_code& error, size_t bytes_used);
+    void HandleHandshake(const boost::system::error_code& error);
+    void DoWrite();
+    void DoSend(const std::string& data, const WriteQueue::OnWriteCallback& on_write_callback);
+    void DoSendShared(const WriteQueue::SharedBuffer& ptr_data, const WriteQueue::OnWriteCallback& on_write_callback);
+    void DoSendFile(const SendableFile::pointer& ptr_file, FileRange range, const WriteQueue::OnWriteCallback& on_write_callback);
+
+    // The checks every write goes through before it is queued
+    // @return false if the write was turned down, which its callback has been told
+    bool PrepareSend(const WriteQueue::OnWriteCallback& on_write_callback);
+
+    // Issues the write if none is in flight and applies the high water mark
+    void FinishSend(bool should_start_write);
+    void DoSendFileDescriptors(const std::string& data,
+                               const std::vector<int>& file_descriptors,
+                               const WriteQueue::OnWriteCallback& on_write_callback);
+    bool AdmitWrite(const WriteQueue::OnWriteCallback& on_write_callback);
+    void StartWrite();
+    void DoClose();
+    void DoPauseReading();
+    void DoResumeReading();
+    void StartRead();
+    void ThrottleReads(size_t bytes_transferred);
+    void HandleThrottle(const boost::system::error_code& error);
     void HandleWrite(const boost::system::error_code& /*error*/, size_t /*bytes_transferred*/);
     void HandleRead(const boost::system::error_code& /*error*/, size_t /*bytes_transferred*/);
     void HandleError(const boost::system::error_code&);
 
 
     // A buffer to store bytes read from client
-    std::array<char, 4096> buffer_;
+    ReceiveBuffer receive_buffer_;
 
     // The socket used to write to the client
-    boost::asio::ip::tcp::socket socket_;
+    StreamSocket socket_;
+
+    // Layered over socket_ once TLS has been started
+    std::unique_ptr<boost::asio::ssl::stream<StreamSocket&>> ptr_ssl_stream_;
+    boost::asio::ssl::context* p_tls_context_;
+    std::function<void()> on_secured_callback_;
+
+    // Serializes all of this connection's handlers when the io_service
+    // is being run by several worker threads
+    boost::asio::io_service::strand strand_;
+
+    ConnectionMetrics::pointer ptr_metrics_;
+
+    // Recycled by the completion handlers of reads and writes respectively
+    HandlerMemory::pointer ptr_read_handler_memory_;
+    HandlerMemory::pointer ptr_write_handler_memory_;
+
+    // Outbound buffers waiting for the in flight write to complete
+    WriteQueue write_queue_;
 
     // This message is sent when all queue messages have been exhausted
     std::string default_message_;
 
-    // A queue of messages which will be sent each time some bytes are
-    // read from the client
-    std::queue<std::string> message_queue_;
+    // Messages which will be sent, one each time some bytes are read from the client
+    MessageList ptr_messages_;
+    size_t next_message_;
+
+    WriteLimits write_limits_;
+    OnWritableCallback on_writable_callback_;
+    std::atomic<bool> is_write_blocked_;
+
+    ReadRateLimiter::pointer ptr_read_rate_limiter_;
+    ReadRateLimiter::pointer ptr_global_read_rate_limiter_;
+    boost::asio::steady_timer throttle_timer_;
+    std::atomic<bool> is_read_throttled_;
+
+    ConnectionDeadlines deadlines_;
+    OnReadCallback on_read_callback_;
+    OnCloseCallback on_close_callback_;
+    std::vector<int> received_file_descriptors_;
+    bool is_closed_;
+    bool is_read_in_flight_;
+    bool is_reading_paused_;
+    bool is_handshaking_;
+    bool is_tls_;
+    bool is_file_descriptor_passing_;
 
     static const std::string kWho;
 };
 }
 }
 
-
@@ -11,74 +11,376 @@ namespace Networking {
 
     TCPSocket::TCPSocket(boost::asio::io_service& io_service,
                          OnConnectCallback on_connect_callback,
-                         OnReadCallback on_read_callback) :
+                         OnReadCallback on_read_callback,
+                         size_t initial_receive_capacity,
+                         size_t max_receive_capacity) :
+        io_service_(io_service),
         socket_(io_service),
-        buffer_(std::array<char, 4096>()),
+        connect_attempt_delay_(HappyEyeballsConnector::kDefaultAttemptDelay),
+        receive_buffer_(initial_receive_capacity, max_receive_capacity),
+        ptr_metrics_(std::make_shared<ConnectionMetrics>()),
+        ptr_read_handler_memory_(std::make_shared<HandlerMemory>()),
+        ptr_write_handler_memory_(std::make_shared<HandlerMemory>()),
         on_connect_callback_(on_connect_callback),
         on_read_callback_(on_read_callback),
-        is_connected_(false)
+        ptr_lifetime_(std::make_shared<char>()),
+        is_connected_(false),
+        is_read_in_flight_(false),
+        is_reading_paused_(false),
+        is_handshaking_(false),
+        is_tls_(false),
+        is_file_descriptor_passing_(false)
     {
+        write_queue_.set_metrics(ptr_metrics_);
     }
 
     TCPSocket::~TCPSocket()
     {
+        // The connector calls back into this socket, which must not happen once it is gone
+        if (ptr_connector_) {
+            ptr_connector_->Cancel();
+        }
     }
 
     void TCPSocket::Connect(tcp::resolver::iterator it)
+    {
+        Connect(std::vector<tcp::endpoint>(it, tcp::resolver::iterator()));
+    }
+
+    void TCPSocket::Connect(const std::vector<tcp::endpoint>& endpoints)
     {
         PHYRE_LOG(trace, kWho) << "Opening connection";
-        socket_.async_connect(*it, boost::bind(&TCPSocket::OnConnect, this, boost::asio::placeholders::error));
+        connect_started_at_ = ConnectionMetrics::Clock::now();
+        if (ptr_connector_) {
+            ptr_connector_->Cancel();
+        }
+        ptr_connector_ = HappyEyeballsConnector::Create(io_service_, connect_attempt_delay_);
+        ptr_connector_->Connect(endpoints, boost::bind(&TCPSocket::OnEndpointConnected, this,
+                                                       boost::placeholders::_1, boost::placeholders::_2));
+    }
+
+    void TCPSocket::Connect(const StreamEndpoint& endpoint)
+    {
+        PHYRE_LOG(trace, kWho) << "Opening connection to " << ToString(endpoint);
+        connect_started_at_ = ConnectionMetrics::Clock::now();
+        if (ptr_connector_) {
+            ptr_connector_->Cancel();
+            ptr_connector_.reset();
+        }
+        // Reopened with the endpoint's protocol, which may differ from the last connection's
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        socket_.async_connect(endpoint, boost::bind(&TCPSocket::OnConnect, this, boost::asio::placeholders::error));
+    }
+
+    void TCPSocket::OnEndpointConnected(const boost::system::error_code& ec, tcp::socket* winner)
+    {
+        if (!ec) {
+            socket_ = std::move(*winner);
+        }
+        ptr_connector_.reset();
+        OnConnect(ec);
     }
 
     void TCPSocket::OnConnect(const boost::system::error_code& ec)
     {
-        is_connected_ = true;
+        is_connected_ = !ec;
+        is_tls_ = false;
+        if (is_connected_) {
+            ptr_metrics_->RecordConnect(ConnectionMetrics::Clock::now() - connect_started_at_);
+            deadlines_.Start();
+        }
         on_connect_callback_(ec);
+
+        // The callback may very well have closed the socket already
+        if (is_connected_) {
+            StartRead();
+        }
     }
 
     void TCPSocket::Close()
     {
         PHYRE_LOG(debug, kWho) << "Closing TCP connection";
+        if (ptr_connector_) {
+            ptr_connector_->Cancel();
+            ptr_connector_.reset();
+        }
         socket_.close();
+        deadlines_.Stop();
         is_connected_ = false;
+        is_handshaking_ = false;
+        is_tls_ = false;
+        write_queue_.Clear(boost::asio::error::operation_aborted);
+        CloseFileDescriptors(received_file_descriptors_);
+    }
+
+    void TCPSocket::StartTLS(boost::asio::ssl::context& context,
+                             const std::string& server_name,
+                             OnHandshakeCallback on_handshake_callback,
+                             TLSSessionCache::Pointer ptr_session_cache)
+    {
+        if (!is_connected_ || is_handshaking_ || is_tls_) {
+            io_service_.post([on_handshake_callback]() { on_handshake_callback(boost::asio::error::operation_not_supported); });
+            return;
+        }
+
+        PHYRE_LOG(trace, kWho) << "Starting TLS with " << server_name;
+        on_handshake_callback_ = on_handshake_callback;
+        is_handshaking_ = true;
+        ptr_ssl_stream_ = std::make_unique<boost::asio::ssl::stream<StreamSocket&>>(socket_, context);
+
+        SSL* ssl = ptr_ssl_stream_->native_handle();
+        SSL_set_tlsext_host_name(ssl, server_name.c_str());
+        ptr_ssl_stream_->set_verify_callback(boost::asio::ssl::rfc2818_verification(server_name));
+        if (ptr_session_cache) {
+            boost::system::error_code ignored;
+            ptr_session_cache->Prepare(ssl, server_name + ':' + std::to_string(ToTCPEndpoint(socket_.remote_endpoint(ignored)).port()));
+        }
+
+        // The plaintext read has to get out of the way first, OnRead picks up from there
+        if (is_read_in_flight_) {
+            boost::system::error_code ignored;
+            socket_.cancel(ignored);
+            return;
+        }
+        StartHandshake();
+    }
+
+    void TCPSocket::StartHandshake(size_t received_bytes)
+    {
+        if (received_bytes > 0) {
+            ptr_ssl_stream_->async_handshake(boost::asio::ssl::stream_base::client,
+                                             boost::asio::buffer(receive_buffer_.data().data(), received_bytes),
+                                             boost::bind(&TCPSocket::OnBufferedHandshake, this,
+                                                         boost::asio::placeholders::error,
+                                                         boost::asio::placeholders::bytes_transferred));
+            return;
+        }
+        ptr_ssl_stream_->async_handshake(boost::asio::ssl::stream_base::client,
+                                         boost::bind(&TCPSocket::OnHandshake, this, boost::asio::placeholders::error));
+    }
+
+    void TCPSocket::OnBufferedHandshake(const boost::system::error_code& ec, size_t bytes_used)
+    {
+        receive_buffer_.Consume(bytes_used);
+        OnHandshake(ec);
+    }
+
+    void TCPSocket::OnHandshake(const boost::system::error_code& ec)
+    {
+        is_handshaking_ = false;
+        if (!is_connected_) {
+            return;
+        }
+
+        if (ec) {
+            PHYRE_LOG(error, kWho) << "TLS handshake failed: " << ec.message();
+            on_handshake_callback_(ec);
+            return;
+        }
+
+        is_tls_ = true;
+        PHYRE_LOG(debug, kWho) << (is_tls_session_reused() ? "Resumed" : "Negotiated") << " a TLS session";
+        on_handshake_callback_(ec);
+        StartRead();
+        if (is_connected_ && !write_queue_.empty() && !write_queue_.write_in_flight()) {
+            StartWrite();
+        }
+    }
+
+    bool TCPSocket::is_tls_session_reused() const
+    {
+        return is_tls_ && SSL_session_reused(ptr_ssl_stream_->native_handle());
     }
 
     void TCPSocket::OnRead(const boost::system::error_code& ec, size_t bytes_transferred)
     {
-        if (is_connected_)
-        {
-            on_read_callback_(ec, bytes_transferred);
-            socket_.async_read_some(boost::asio::buffer(buffer_),
-                                    boost::bind(&TCPSocket::OnRead,
-                                                this,
-                                                boost::asio::placeholders::error,
-                                                boost::asio::placeholders::bytes_transferred));
+        is_read_in_flight_ = false;
+
+        // This is the plaintext read StartTLS cancelled. It may have completed before the cancellation
+        // got to it, in which case what it read already belongs to the handshake.
+        if (is_handshaking_ && is_connected_) {
+            if (ec || bytes_transferred == 0) {
+                StartHandshake();
+                return;
+            }
+            // Plaintext the owner left unconsumed means nothing on the secured stream
+            size_t plaintext = receive_buffer_.size();
+            receive_buffer_.Commit(bytes_transferred);
+            receive_buffer_.Consume(plaintext);
+            ptr_metrics_->RecordRead(bytes_transferred);
+            StartHandshake(bytes_transferred);
+            return;
+        }
+
+        // Reads aborted by Close are of no interest to the owner
+        if (!is_connected_) {
+            return;
+        }
+
+        if (!ec) {
+            receive_buffer_.Commit(bytes_transferred);
+            ptr_metrics_->RecordRead(bytes_transferred);
+            deadlines_.OnRead();
+        }
+        on_read_callback_(ec, bytes_transferred);
+        if (!ec) {
+            StartRead();
         }
     }
 
-    void TCPSocket::Write(const std::string& data)
+    void TCPSocket::Write(const std::string& data, OnWriteCallback on_write_callback)
     {
         if (!is_connected_)
         {
             PHYRE_LOG(warning, kWho) << "Cannot write to closed socket";
+            if (on_write_callback) {
+                on_write_callback(boost::asio::error::not_connected, 0);
+            }
             return;
         }
-        write(socket_, boost::asio::buffer(data));
-        Read();
+        // Writes queued during a handshake go out encrypted once it is done
+        if (write_queue_.Push(data, on_write_callback) && !is_handshaking_) {
+            StartWrite();
+        }
     }
 
-    void TCPSocket::Read()
+    void TCPSocket::WriteFileDescriptors(const std::string& data,
+                                         const std::vector<int>& file_descriptors,
+                                         OnWriteCallback on_write_callback)
     {
-        if (!is_connected_)
+        boost::system::error_code ec;
+#if !defined(PHYRE_HAS_FILE_DESCRIPTOR_PASSING)
+        ec = boost::asio::error::operation_not_supported;
+#endif
+        if (!is_connected_) {
+            ec = boost::asio::error::not_connected;
+        } else if (is_tls_ || is_handshaking_) {
+            ec = boost::asio::error::operation_not_supported;
+        } else if (data.empty()) {
+            // The descriptors need a byte to ride along with
+            ec = boost::asio::error::invalid_argument;
+        }
+        if (ec) {
+            PHYRE_LOG(warning, kWho) << "Cannot pass file descriptors: " << ec.message();
+            if (on_write_callback) {
+                on_write_callback(ec, 0);
+            }
+            return;
+        }
+        if (write_queue_.Push(data, on_write_callback, file_descriptors)) {
+            StartWrite();
+        }
+    }
+
+    std::vector<int> TCPSocket::TakeFileDescriptors()
+    {
+        std::vector<int> file_descriptors;
+        file_descriptors.swap(received_file_descriptors_);
+        return file_descriptors;
+    }
+
+    void TCPSocket::StartWrite()
+    {
+        deadlines_.OnWriteStarted();
+        auto on_write = MakeCustomAllocHandler(ptr_write_handler_memory_,
+                                               boost::bind(&TCPSocket::OnWrite,
+                                                           this,
+                                                           boost::asio::placeholders::error,
+                                                           boost::asio::placeholders::bytes_transferred));
+        WriteQueue::BufferSequence batch = write_queue_.PrepareBatch();
+        if (is_tls_) {
+            boost::asio::async_write(*ptr_ssl_stream_, batch, on_write);
+        } else if (!write_queue_.batch_file_descriptors().empty()) {
+            AsyncWriteWithFileDescriptors(socket_, *batch.begin(), write_queue_.batch_file_descriptors(), on_write);
+        } else {
+            boost::asio::async_write(socket_, batch, on_write);
+        }
+    }
+
+    void TCPSocket::OnWrite(const boost::system::error_code& ec, size_t bytes_transferred)
+    {
+        deadlines_.OnWriteCompleted();
+        if (ec) {
+            PHYRE_LOG(error, kWho) << "Failed to write " << bytes_transferred << " bytes: " << ec.message();
+            write_queue_.Complete(ec, bytes_transferred);
+            write_queue_.Clear(ec);
+            return;
+        }
+
+        PHYRE_LOG(trace, kWho) << "Sent " << bytes_transferred << " bytes";
+        if (write_queue_.Complete(ec, bytes_transferred)) {
+            StartWrite();
+        }
+    }
+
+    void TCPSocket::set_timeouts(TimingWheel::pointer ptr_timing_wheel,
+                                 std::chrono::milliseconds read_timeout,
+                                 std::chrono::milliseconds write_timeout,
+                                 std::chrono::milliseconds idle_timeout)
+    {
+        std::weak_ptr<char> lifetime = ptr_lifetime_;
+        deadlines_.Configure(ptr_timing_wheel, read_timeout, write_timeout, idle_timeout, [this, lifetime]() {
+            if (!lifetime.expired()) {
+                CheckDeadlines();
+            }
+        });
+        if (is_connected_) {
+            deadlines_.Start();
+        }
+    }
+
+    void TCPSocket::CheckDeadlines()
+    {
+        ConnectionDeadlines::Expiry expiry = deadlines_.Check();
+        if (expiry != ConnectionDeadlines::kNone && is_connected_) {
+            PHYRE_LOG(info, kWho) << "The connection hit its " << ConnectionDeadlines::ToString(expiry) << " timeout";
+            on_read_callback_(boost::asio::error::timed_out, 0);
+        }
+    }
+
+    void TCPSocket::PauseReading()
+    {
+        is_reading_paused_ = true;
+    }
+
+    void TCPSocket::ResumeReading()
+    {
+        is_reading_paused_ = false;
+        StartRead();
+    }
+
+    void TCPSocket::StartRead()
+    {
+        // Never stack reads on top of each other since they would all share the receive buffer
+        if (!is_connected_ || is_reading_paused_ || is_read_in_flight_ || is_handshaking_)
         {
-            PHYRE_LOG(warning, kWho) << "Cannot read from closed socket";
             return;
         }
-        socket_.async_read_some(boost::asio::buffer(buffer_),
-                                boost::bind(&TCPSocket::OnRead,
-                                    this,
-                                    boost::asio::placeholders::error,
-                                    boost::asio::placeholders::bytes_transferred));
+
+        boost::asio::mutable_buffers_1 free_space = receive_buffer_.Prepare();
+        if (boost::asio::buffer_size(free_space) == 0)
+        {
+            // Nobody consumed a single byte of a full window, so the peer is
+            // sending a message larger than we are willing to hold
+            PHYRE_LOG(error, kWho) << "Receive buffer exhausted at " << receive_buffer_.capacity() << " bytes";
+            on_read_callback_(boost::asio::error::no_buffer_space, 0);
+            return;
+        }
+
+        is_read_in_flight_ = true;
+        auto on_read = MakeCustomAllocHandler(ptr_read_handler_memory_,
+                                              boost::bind(&TCPSocket::OnRead,
+                                                          this,
+                                                          boost::asio::placeholders::error,
+                                                          boost::asio::placeholders::bytes_transferred));
+        if (is_tls_) {
+            ptr_ssl_stream_->async_read_some(free_space, on_read);
+        } else if (is_file_descriptor_passing_) {
+            AsyncReadWithFileDescriptors(socket_, free_space, received_file_descriptors_, on_read);
+        } else {
+            socket_.async_read_some(free_space, on_read);
+        }
     }
 }
 }
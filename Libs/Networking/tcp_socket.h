@@ -1,6 +1,15 @@
 #pragma once
 #include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
 #include <Logging/loggable_interface.h>
+#include "connection_deadlines.h"
+#include "connection_metrics.h"
+#include "handler_allocator.h"
+#include "happy_eyeballs_connector.h"
+#include "receive_buffer.h"
+#include "stream_socket.h"
+#include "tls_session_cache.h"
+#include "write_queue.h"
 
 namespace Phyre
 {
@@ -12,43 +21,147 @@ namespace Networking
 
         typedef std::function<void(const boost::system::error_code&)> OnConnectCallback;
         typedef std::function<void(const boost::system::error_code&, size_t)> OnReadCallback;
+        typedef WriteQueue::OnWriteCallback OnWriteCallback;
+        typedef std::function<void(const boost::system::error_code&)> OnHandshakeCallback;
 
         TCPSocket(boost::asio::io_service& io_service,
                   OnConnectCallback on_connect_callback,
-                  OnReadCallback on_read_callback);
+                  OnReadCallback on_read_callback,
+                  size_t initial_receive_capacity = ReceiveBuffer::kDefaultInitialCapacity,
+                  size_t max_receive_capacity = ReceiveBuffer::kDefaultMaxCapacity);
         ~TCPSocket();
 
+        // Races every resolved endpoint against each other and keeps the first one to connect
         void Connect(boost::asio::ip::tcp::resolver::iterator it);
+        void Connect(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints);
+
+        // Connects straight to a single endpoint, such as an AF_UNIX one from LocalEndpoint
+        void Connect(const StreamEndpoint& endpoint);
         void Close();
 
         /**
-        * Each time this is called, a read operation will immediately be called afterwards.
-        * It is therefore strongly advised to write all bytes to the data stream and read all necessary bytes
-        * before calling Write again.
+        * Upgrades the established connection to TLS, be it right after connecting or after
+        * a STARTTLS style negotiation, in which case nothing may be in flight in either direction.
+        * The server's certificate is verified against server_name if the context verifies peers.
+        * With a session cache, sessions are resumed across reconnects to the same server.
+        * Reads resume and queued writes go out encrypted once the handshake succeeded.
+        */
+        void StartTLS(boost::asio::ssl::context& context,
+                      const std::string& server_name,
+                      OnHandshakeCallback on_handshake_callback,
+                      TLSSessionCache::Pointer ptr_session_cache = TLSSessionCache::Instance());
+
+        /**
+        * Queues data to be sent asynchronously. Writes issued while another one is in flight
+        * are coalesced into a single scatter-gather write once it completes.
+        * The optional callback is invoked once this data has been written or has failed.
+        */
+        void Write(const std::string& data, OnWriteCallback on_write_callback = OnWriteCallback());
+
+        /**
+        * Queues data with file descriptors attached to its first byte, for AF_UNIX connections
+        * whose peer reads with file descriptor passing enabled. Ordered with every other write.
+        * The descriptors are duplicated into the peer, so the caller may close its own once written.
+        * Fails with operation_not_supported over TLS or where PHYRE_HAS_FILE_DESCRIPTOR_PASSING is not defined.
         */
-        void Write(const std::string& data);
-        void Read();
+        void WriteFileDescriptors(const std::string& data,
+                                  const std::vector<int>& file_descriptors,
+                                  OnWriteCallback on_write_callback = OnWriteCallback());
+
+        // Reads collect file descriptors passed by the peer, see TakeFileDescriptors.
+        // Set before connecting, since descriptors arriving with a plain read are lost.
+        void set_file_descriptor_passing(bool is_enabled) { is_file_descriptor_passing_ = is_enabled; }
 
+        // Hands over the descriptors received so far. Untaken ones are closed along with the socket.
+        std::vector<int> TakeFileDescriptors();
+
+        /**
+        * Reading starts on its own once connected and keeps exactly one read outstanding
+        * until the socket is closed or an error occurs.
+        * Pausing lets the outstanding read complete but does not issue the next one.
+        */
+        void PauseReading();
+        void ResumeReading();
 
         /**
-         * This TCP buffer has a window frame of 4kb
+         * Bytes read from the socket accumulate here until they are consumed.
+         * The window grows from its initial capacity up to its max capacity as reads fill it up.
          */
-        std::array<char, 4096>& buffer()  { return buffer_; }
+        ReceiveBuffer& receive_buffer() { return receive_buffer_; }
         bool is_connected() const { return is_connected_; }
+        bool is_reading_paused() const { return is_reading_paused_; }
+        bool is_tls() const { return is_tls_; }
+
+        // Whether the TLS handshake resumed a previous session rather than negotiating a new one
+        bool is_tls_session_reused() const;
+        StreamSocket& socket() { return socket_; }
+        const WriteQueue& write_queue() const { return write_queue_; }
+
+        // Traffic counters of this socket, safe to query from any thread
+        const ConnectionMetrics& metrics() const { return *ptr_metrics_; }
+
+        // How long a connection attempt gets before the next endpoint is raced against it
+        void set_connect_attempt_delay(std::chrono::milliseconds connect_attempt_delay) { connect_attempt_delay_ = connect_attempt_delay; }
+
+        // Fails the connection with timed_out through the read callback once one of its deadlines
+        // passes, see ConnectionDeadlines. The clocks start once connected.
+        void set_timeouts(TimingWheel::pointer ptr_timing_wheel,
+                          std::chrono::milliseconds read_timeout,
+                          std::chrono::milliseconds write_timeout,
+                          std::chrono::milliseconds idle_timeout);
+
+        // Lets whoever currently owns the socket (e.g. after a pool checkout) receive its events
+        void set_on_connect_callback(OnConnectCallback on_connect_callback) { on_connect_callback_ = on_connect_callback; }
+        void set_on_read_callback(OnReadCallback on_read_callback) { on_read_callback_ = on_read_callback; }
 
         std::string log() override {
             return "[TCPSocket]";
         }
 
     private:
+        void OnEndpointConnected(const boost::system::error_code& ec, boost::asio::ip::tcp::socket* winner);
         void OnConnect(const boost::system::error_code& ec);
+        // Hands the first received_bytes of the receive buffer to the handshake, for a peer which got there first
+        void StartHandshake(size_t received_bytes = 0);
+        void OnBufferedHandshake(const boost::system::error_code& ec, size_t bytes_used);
+        void OnHandshake(const boost::system::error_code& ec);
+        void CheckDeadlines();
+        void StartRead();
         void OnRead(const boost::system::error_code& ec, size_t bytes_transferred);
+        void StartWrite();
+        void OnWrite(const boost::system::error_code& ec, size_t bytes_transferred);
+
+        boost::asio::io_service& io_service_;
+        StreamSocket socket_;
+
+        // Layered over socket_ once StartTLS is called. It outlives Close so that the
+        // handlers of operations aborted by closing the socket can still complete.
+        std::unique_ptr<boost::asio::ssl::stream<StreamSocket&>> ptr_ssl_stream_;
+        HappyEyeballsConnector::pointer ptr_connector_;
+        std::chrono::milliseconds connect_attempt_delay_;
+        ReceiveBuffer receive_buffer_;
+        ConnectionMetrics::pointer ptr_metrics_;
 
-        boost::asio::ip::tcp::socket socket_;
-        std::array<char, 4096> buffer_;
+        // Recycled by the completion handlers of reads and writes respectively
+        HandlerMemory::pointer ptr_read_handler_memory_;
+        HandlerMemory::pointer ptr_write_handler_memory_;
+        ConnectionMetrics::Clock::time_point connect_started_at_;
         OnConnectCallback on_connect_callback_;
         OnReadCallback on_read_callback_;
+        OnHandshakeCallback on_handshake_callback_;
+        WriteQueue write_queue_;
+        ConnectionDeadlines deadlines_;
+        std::vector<int> received_file_descriptors_;
+
+        // Wheel callbacks only hold a weak reference to this, so that they can tell the socket is gone
+        std::shared_ptr<char> ptr_lifetime_;
+
         bool is_connected_;
+        bool is_read_in_flight_;
+        bool is_reading_paused_;
+        bool is_handshaking_;
+        bool is_tls_;
+        bool is_file_descriptor_passing_;
 
         static const std::string kWho;
     };
@@ -0,0 +1,97 @@
+#include <Logging/logging.h>
+#include "tcp_stream.h"
+
+namespace Phyre {
+namespace Networking {
+
+    using boost::asio::ip::tcp;
+
+    const std::string TCPStream::kWho = "[TCPStream]";
+
+    namespace {
+        // Suspends the coroutine until start's callback reports an error code and a result,
+        // bridging the callback based building blocks of this library into coroutines
+        template <typename Result, typename Start>
+        Result Await(boost::asio::yield_context yield, Start start) {
+            typedef void Signature(boost::system::error_code, Result);
+#if BOOST_VERSION >= 106600
+            boost::asio::async_completion<boost::asio::yield_context, Signature> completion(yield);
+            start(completion.completion_handler);
+            return completion.result.get();
+#else
+            typename boost::asio::handler_type<boost::asio::yield_context, Signature>::type handler(yield);
+            boost::asio::async_result<decltype(handler)> result(handler);
+            start(handler);
+            return result.get();
+#endif
+        }
+
+        void Fail(const boost::asio::yield_context& yield, const boost::system::error_code& ec) {
+            if (!yield.ec_) {
+                throw boost::system::system_error(ec);
+            }
+            *yield.ec_ = ec;
+        }
+    }
+
+    TCPStream::TCPStream(boost::asio::io_service& io_service,
+                         size_t initial_receive_capacity,
+                         size_t max_receive_capacity) :
+        io_service_(io_service),
+        host_resolver_(io_service),
+        socket_(io_service),
+        receive_buffer_(initial_receive_capacity, max_receive_capacity) { }
+
+    TCPStream::TCPStream(boost::asio::io_service& io_service,
+                         tcp::socket socket,
+                         size_t initial_receive_capacity,
+                         size_t max_receive_capacity) :
+        io_service_(io_service),
+        host_resolver_(io_service),
+        socket_(std::move(socket)),
+        receive_buffer_(initial_receive_capacity, max_receive_capacity) { }
+
+    tcp::endpoint TCPStream::Connect(const std::string& host, const std::string& service, boost::asio::yield_context yield) {
+        PHYRE_LOG(info, kWho) << "Connecting to " << host << ':' << service;
+        DnsCache::Endpoints endpoints = Await<DnsCache::Endpoints>(yield, [this, &host, &service](auto handler) {
+            host_resolver_.ResolveHost(host, service, [handler](const boost::system::error_code& ec, const DnsCache::Endpoints& resolved) mutable {
+                handler(ec, resolved);
+            });
+        });
+        if (yield.ec_ && *yield.ec_) {
+            return tcp::endpoint();
+        }
+
+        // The connector has to stay alive while the coroutine waits on it
+        HappyEyeballsConnector::pointer ptr_connector = HappyEyeballsConnector::Create(io_service_);
+        return Await<tcp::endpoint>(yield, [this, &ptr_connector, &endpoints](auto handler) {
+            ptr_connector->Connect(endpoints, [this, handler](const boost::system::error_code& ec, tcp::socket* winner) mutable {
+                tcp::endpoint endpoint;
+                if (!ec) {
+                    socket_ = std::move(*winner);
+                    boost::system::error_code ignored;
+                    endpoint = socket_.remote_endpoint(ignored);
+                }
+                handler(ec, endpoint);
+            });
+        });
+    }
+
+    boost::string_ref TCPStream::Read(boost::asio::yield_context yield) {
+        boost::asio::mutable_buffers_1 free_space = receive_buffer_.Prepare();
+        if (boost::asio::buffer_size(free_space) == 0) {
+            PHYRE_LOG(error, kWho) << "Receive buffer exhausted at " << receive_buffer_.capacity() << " bytes";
+            Fail(yield, boost::asio::error::no_buffer_space);
+            return receive_buffer_.data();
+        }
+        receive_buffer_.Commit(socket_.async_read_some(free_space, yield));
+        return receive_buffer_.data();
+    }
+
+    void TCPStream::Close() {
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+    }
+
+}
+}
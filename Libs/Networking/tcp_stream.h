@@ -0,0 +1,67 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/asio/spawn.hpp>
+#include <boost/utility/string_ref.hpp>
+#include "happy_eyeballs_connector.h"
+#include "host_resolver.h"
+#include "receive_buffer.h"
+
+namespace Phyre {
+namespace Networking {
+
+// A TCP connection for code running in a coroutine started with boost::asio::spawn.
+// Every operation suspends the calling coroutine until it completes, so a protocol reads
+// top to bottom instead of being spread over OnX callbacks, and it may pipeline by writing
+// several requests before reading the first response.
+// Operations throw boost::system::system_error on failure, unless the yield context is
+// handed an error code to fill in instead, as in stream.Read(yield[ec]).
+// Like the coroutines driving it, a stream belongs to a single thread.
+class TCPStream {
+
+public:
+    explicit TCPStream(boost::asio::io_service& io_service,
+                       size_t initial_receive_capacity = ReceiveBuffer::kDefaultInitialCapacity,
+                       size_t max_receive_capacity = ReceiveBuffer::kDefaultMaxCapacity);
+
+    // Takes over a socket which is already connected, e.g. one that was just accepted
+    TCPStream(boost::asio::io_service& io_service,
+              boost::asio::ip::tcp::socket socket,
+              size_t initial_receive_capacity = ReceiveBuffer::kDefaultInitialCapacity,
+              size_t max_receive_capacity = ReceiveBuffer::kDefaultMaxCapacity);
+
+    // Resolves the host through the DNS cache and races its endpoints, see HappyEyeballsConnector
+    // @return The endpoint which got connected
+    boost::asio::ip::tcp::endpoint Connect(const std::string& host, const std::string& service, boost::asio::yield_context yield);
+
+    // Reads whatever is available, at least a byte, into the receive buffer
+    // @return Every unconsumed byte of the receive buffer; consume what was handled
+    boost::string_ref Read(boost::asio::yield_context yield);
+
+    // Reads whatever is available, at least a byte, into the caller's buffer
+    size_t ReadSome(boost::asio::mutable_buffers_1 buffer, boost::asio::yield_context yield) {
+        return socket_.async_read_some(buffer, yield);
+    }
+
+    // Writes every buffer in a single gathered write
+    template <typename ConstBufferSequence>
+    size_t WriteAll(const ConstBufferSequence& buffers, boost::asio::yield_context yield) {
+        return boost::asio::async_write(socket_, buffers, yield);
+    }
+
+    void Close();
+
+    bool is_open() const { return socket_.is_open(); }
+    boost::asio::ip::tcp::socket& socket() { return socket_; }
+    ReceiveBuffer& receive_buffer() { return receive_buffer_; }
+
+private:
+    boost::asio::io_service& io_service_;
+    HostResolver host_resolver_;
+    boost::asio::ip::tcp::socket socket_;
+    ReceiveBuffer receive_buffer_;
+
+    static const std::string kWho;
+};
+
+}
+}
@@ -0,0 +1,104 @@
+#include "timing_wheel.h"
+
+namespace Phyre {
+namespace Networking {
+
+    const std::chrono::milliseconds TimingWheel::kDefaultTick(100);
+    const size_t TimingWheel::kDefaultSlots;
+
+    TimingWheel::TimingWheel(boost::asio::io_service& io_service, std::chrono::milliseconds tick, size_t slots) :
+        timer_(io_service),
+        tick_(std::max(tick, std::chrono::milliseconds(1))),
+        slots_(std::max<size_t>(slots, 1)),
+        cursor_(0),
+        next_id_(1),
+        is_ticking_(false) { }
+
+    TimingWheel::pointer TimingWheel::Create(boost::asio::io_service& io_service, std::chrono::milliseconds tick, size_t slots) {
+        return pointer(new TimingWheel(io_service, tick, slots));
+    }
+
+    TimingWheel::TimerId TimingWheel::Schedule(Clock::duration delay, Callback callback) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        bool should_start_ticking = !is_ticking_;
+        if (should_start_ticking) {
+            next_tick_at_ = now + tick_;
+        }
+
+        // The n-th slot from the cursor expires at next_tick_at_ + (n - 1) * tick_, and part of the
+        // current tick has usually passed already. Round up so that a callback never fires early.
+        Clock::duration after_next_tick = now + delay - next_tick_at_;
+        Clock::duration::rep rounded_up = after_next_tick <= Clock::duration::zero()
+            ? 0
+            : (after_next_tick + tick_ - Clock::duration(1)) / tick_;
+        uint64_t ticks = static_cast<uint64_t>(rounded_up) + 1;
+
+        TimerId id = next_id_++;
+        slots_[(cursor_ + ticks) % slots_.size()].push_back(id);
+        entries_[id] = Entry{ (ticks - 1) / slots_.size(), std::move(callback) };
+
+        if (should_start_ticking) {
+            is_ticking_ = true;
+            ScheduleTick();
+        }
+        return id;
+    }
+
+    bool TimingWheel::Cancel(TimerId id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.erase(id) > 0;
+    }
+
+    size_t TimingWheel::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    void TimingWheel::ScheduleTick() {
+        timer_.expires_at(next_tick_at_);
+        timer_.async_wait(std::bind(&TimingWheel::Tick, shared_from_this(), std::placeholders::_1));
+    }
+
+    void TimingWheel::Tick(const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+
+        std::vector<Callback> expired;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cursor_ = (cursor_ + 1) % slots_.size();
+            std::vector<TimerId> slot;
+            slot.swap(slots_[cursor_]);
+            for (TimerId id : slot) {
+                auto it = entries_.find(id);
+                if (it == entries_.end()) {
+                    continue;
+                }
+                if (it->second.rounds > 0) {
+                    --it->second.rounds;
+                    slots_[cursor_].push_back(id);
+                    continue;
+                }
+                expired.push_back(std::move(it->second.callback));
+                entries_.erase(it);
+            }
+
+            // Ticks are scheduled on absolute times so that they do not drift
+            if (entries_.empty()) {
+                is_ticking_ = false;
+            } else {
+                next_tick_at_ += tick_;
+                ScheduleTick();
+            }
+        }
+
+        // Callbacks run without the lock held since they usually schedule the next deadline
+        for (Callback& callback : expired) {
+            callback();
+        }
+    }
+
+}
+}
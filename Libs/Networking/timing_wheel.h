@@ -0,0 +1,70 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Phyre {
+namespace Networking {
+
+// A hashed timing wheel: a single steady_timer ticks at a fixed resolution and
+// expires every callback in the slot it lands on, so scheduling and cancelling are
+// O(1) no matter how many timers are pending, and the reactor only ever sees one timer.
+// Delays longer than a full turn of the wheel wait out the extra rounds in their slot.
+// Callbacks never fire early but up to one tick late, which is fine for timeouts but not for pacing.
+// The wheel only ticks while something is scheduled: pending callbacks keep io_service::run()
+// from returning, just like any other timer, while an empty wheel leaves nothing pending.
+// Safe to use from any thread; callbacks run on a thread running the io_service.
+class TimingWheel : public std::enable_shared_from_this<TimingWheel> {
+
+public:
+    typedef std::shared_ptr<TimingWheel> pointer;
+    typedef std::chrono::steady_clock Clock;
+    typedef uint64_t TimerId;
+    typedef std::function<void()> Callback;
+
+    static const std::chrono::milliseconds kDefaultTick;
+    static const size_t kDefaultSlots = 512;
+
+    static pointer Create(boost::asio::io_service& io_service,
+                          std::chrono::milliseconds tick = kDefaultTick,
+                          size_t slots = kDefaultSlots);
+
+    // @return An id to cancel the callback with, which is never 0
+    TimerId Schedule(Clock::duration delay, Callback callback);
+
+    // @return false if the callback already fired or was cancelled
+    bool Cancel(TimerId id);
+
+    size_t size() const;
+    std::chrono::milliseconds tick() const { return tick_; }
+
+private:
+    struct Entry {
+        uint64_t rounds;
+        Callback callback;
+    };
+
+    TimingWheel(boost::asio::io_service& io_service, std::chrono::milliseconds tick, size_t slots);
+    void ScheduleTick();
+    void Tick(const boost::system::error_code& ec);
+
+    boost::asio::steady_timer timer_;
+    std::chrono::milliseconds tick_;
+    Clock::time_point next_tick_at_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<TimerId, Entry> entries_;
+
+    // Ids of the timers in each slot; cancelled ones are dropped once their slot comes up
+    std::vector<std::vector<TimerId>> slots_;
+    size_t cursor_;
+    TimerId next_id_;
+    bool is_ticking_;
+};
+
+}
+}
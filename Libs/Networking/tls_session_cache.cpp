@@ -0,0 +1,100 @@
+#include <Logging/logging.h>
+#include "tls_session_cache.h"
+
+namespace Phyre {
+namespace Networking {
+
+    const std::string TLSSessionCache::kWho = "[TLSSessionCache]";
+
+    namespace {
+        // Connections sharing a context may well store their sessions in different caches
+        struct Destination {
+            TLSSessionCache* p_cache;
+            std::string key;
+        };
+
+        void FreeDestination(void* /*parent*/, void* ptr, CRYPTO_EX_DATA* /*ad*/, int /*idx*/, long /*argl*/, void* /*argp*/) {
+            delete static_cast<Destination*>(ptr);
+        }
+
+        // Where a connection keeps the cache and key its sessions go to
+        int DestinationIndex() {
+            static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, FreeDestination);
+            return index;
+        }
+    }
+
+    TLSSessionCache::Pointer TLSSessionCache::Instance() {
+        static Pointer instance = std::make_shared<TLSSessionCache>();
+        return instance;
+    }
+
+    TLSSessionCache::TLSSessionCache() { }
+
+    TLSSessionCache::~TLSSessionCache() {
+        Clear();
+    }
+
+    void TLSSessionCache::Prepare(SSL* ssl, const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        SSL_CTX* context = SSL_get_SSL_CTX(ssl);
+        if (SSL_CTX_sess_get_new_cb(context) != &TLSSessionCache::OnNewSession) {
+            SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(context, &TLSSessionCache::OnNewSession);
+        }
+        delete static_cast<Destination*>(SSL_get_ex_data(ssl, DestinationIndex()));
+        SSL_set_ex_data(ssl, DestinationIndex(), new Destination{ this, key });
+
+        auto it = sessions_.find(key);
+        if (it != sessions_.end()) {
+            PHYRE_LOG(trace, kWho) << "Offering to resume the session with " << key;
+            SSL_set_session(ssl, it->second);
+        }
+    }
+
+    int TLSSessionCache::OnNewSession(SSL* ssl, SSL_SESSION* session) {
+        Destination* p_destination = static_cast<Destination*>(SSL_get_ex_data(ssl, DestinationIndex()));
+        if (!p_destination) {
+            return 0;
+        }
+        p_destination->p_cache->Store(p_destination->key, session);
+
+        // Tells OpenSSL that the cache now holds the reference it was handed
+        return 1;
+    }
+
+    void TLSSessionCache::Store(const std::string& key, SSL_SESSION* session) {
+        PHYRE_LOG(trace, kWho) << "Storing a session for " << key;
+        std::lock_guard<std::mutex> lock(mutex_);
+        SSL_SESSION*& stored = sessions_[key];
+        if (stored) {
+            SSL_SESSION_free(stored);
+        }
+        stored = session;
+    }
+
+    void TLSSessionCache::Remove(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sessions_.find(key);
+        if (it != sessions_.end()) {
+            SSL_SESSION_free(it->second);
+            sessions_.erase(it);
+        }
+    }
+
+    void TLSSessionCache::Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : sessions_) {
+            SSL_SESSION_free(entry.second);
+        }
+        sessions_.clear();
+    }
+
+    size_t TLSSessionCache::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sessions_.size();
+    }
+
+}
+}
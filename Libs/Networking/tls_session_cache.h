@@ -0,0 +1,53 @@
+#pragma once
+#include <boost/asio/ssl.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace Phyre {
+namespace Networking {
+
+// Remembers the TLS sessions (session IDs and session tickets alike) handed out
+// by servers, so that reconnecting to the same server resumes the previous session
+// and skips the certificate exchange and key agreement of a full handshake.
+// Sessions are keyed on whatever identifies the server to the caller, usually host:service.
+// Servers only hand out TLS 1.3 tickets after the handshake, so sessions are captured
+// through OpenSSL's new session callback rather than read back once the handshake is done.
+class TLSSessionCache {
+
+public:
+    typedef std::shared_ptr<TLSSessionCache> Pointer;
+
+    // The cache shared by the whole process
+    static Pointer Instance();
+
+    TLSSessionCache();
+    ~TLSSessionCache();
+
+    TLSSessionCache(const TLSSessionCache&) = delete;
+    TLSSessionCache& operator=(const TLSSessionCache&) = delete;
+
+    // Offers the cached session for key (if any) to a client connection which has not
+    // shaken hands yet, and has every session the server issues on it stored under key.
+    // The cache must outlive ssl; connections sharing a context may use different caches.
+    void Prepare(SSL* ssl, const std::string& key);
+
+    // Forgets the session of key, e.g. after the server rejected it
+    void Remove(const std::string& key);
+
+    void Clear();
+    size_t size() const;
+
+private:
+    static int OnNewSession(SSL* ssl, SSL_SESSION* session);
+    void Store(const std::string& key, SSL_SESSION* session);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, SSL_SESSION*> sessions_;
+
+    static const std::string kWho;
+};
+
+}
+}
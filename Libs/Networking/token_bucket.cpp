@@ -0,0 +1,43 @@
+#include <algorithm>
+#include "token_bucket.h"
+
+namespace Phyre {
+namespace Networking {
+
+    TokenBucket::TokenBucket(double rate_per_second, double burst) :
+        rate_per_second_(std::max(rate_per_second, 0.0)),
+        burst_(std::max(burst, 0.0)),
+        tokens_(burst_),
+        last_refill_(Clock::now()) { }
+
+    TokenBucket::Clock::duration TokenBucket::Take(double tokens, Clock::time_point now) {
+        if (!is_limited()) {
+            return Clock::duration::zero();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        Refill(now);
+        tokens_ -= tokens;
+        if (tokens_ >= 0) {
+            return Clock::duration::zero();
+        }
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-tokens_ / rate_per_second_));
+    }
+
+    double TokenBucket::available(Clock::time_point now) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Refill(now);
+        return tokens_;
+    }
+
+    void TokenBucket::Refill(Clock::time_point now) {
+        // Several threads may hand in their own idea of now, never go back in time
+        if (now <= last_refill_) {
+            return;
+        }
+        std::chrono::duration<double> elapsed = now - last_refill_;
+        tokens_ = std::min(burst_, tokens_ + elapsed.count() * rate_per_second_);
+        last_refill_ = now;
+    }
+
+}
+}
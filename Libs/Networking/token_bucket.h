@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace Phyre {
+namespace Networking {
+
+// A token bucket which refills at a steady rate up to its burst size.
+// Tokens are taken after the fact, e.g. for bytes which were already read, so the bucket
+// may go into debt; the caller then backs off until the refill has paid the debt off.
+// Safe to share between threads, e.g. as a budget across every connection of a server.
+class TokenBucket {
+
+public:
+    typedef std::shared_ptr<TokenBucket> pointer;
+    typedef std::chrono::steady_clock Clock;
+
+    // Starts out full. A rate of 0 never limits anything.
+    TokenBucket(double rate_per_second, double burst);
+
+    // @return How long until the bucket is out of debt again, zero if it is not in debt
+    Clock::duration Take(double tokens, Clock::time_point now = Clock::now());
+
+    double available(Clock::time_point now = Clock::now());
+    bool is_limited() const { return rate_per_second_ > 0; }
+
+private:
+    void Refill(Clock::time_point now);
+
+    std::mutex mutex_;
+    double rate_per_second_;
+    double burst_;
+    double tokens_;
+    Clock::time_point last_refill_;
+};
+
+// Bounds on how much a peer may send: bytes, and messages, where every completed read counts as one.
+// A rate of 0 leaves the respective bound off.
+struct ReadRateLimits {
+    ReadRateLimits(double bytes_per_second = 0, double bytes_burst = 0,
+                   double messages_per_second = 0, double messages_burst = 0) :
+        byte_rate(bytes_per_second),
+        byte_burst(bytes_burst > 0 ? bytes_burst : bytes_per_second),
+        message_rate(messages_per_second),
+        message_burst(messages_burst > 0 ? messages_burst : messages_per_second) { }
+
+    bool is_limited() const { return byte_rate > 0 || message_rate > 0; }
+
+    double byte_rate;
+    double byte_burst;
+    double message_rate;
+    double message_burst;
+};
+
+// Charges reads against a byte and a message bucket, see ReadRateLimits
+class ReadRateLimiter {
+
+public:
+    typedef std::shared_ptr<ReadRateLimiter> pointer;
+
+    explicit ReadRateLimiter(const ReadRateLimits& limits) :
+        bytes_(limits.byte_rate, limits.byte_burst),
+        messages_(limits.message_rate, limits.message_burst) { }
+
+    // @return How long reading has to pause for, zero if it may carry on
+    TokenBucket::Clock::duration Charge(size_t bytes, TokenBucket::Clock::time_point now = TokenBucket::Clock::now()) {
+        return std::max(bytes_.Take(static_cast<double>(bytes), now), messages_.Take(1, now));
+    }
+
+private:
+    TokenBucket bytes_;
+    TokenBucket messages_;
+};
+
+}
+}
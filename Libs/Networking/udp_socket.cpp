@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <cstring>
+#include <Logging/logging.h>
+#include "udp_socket.h"
+
+namespace Phyre {
+namespace Networking {
+
+    using boost::asio::ip::udp;
+
+    const std::string UDPSocket::kWho = "[UDPSocket]";
+
+    UDPSocket::UDPSocket(boost::asio::io_service& io_service,
+                         OnReceiveCallback on_receive_callback,
+                         size_t max_datagram_size,
+                         size_t batch_size) :
+        io_service_(io_service),
+        socket_(io_service),
+        on_receive_callback_(on_receive_callback),
+        max_datagram_size_(max_datagram_size),
+        batch_size_(std::max<size_t>(batch_size, 1)),
+        receive_buffer_size_(0),
+        send_buffer_size_(0),
+        ptr_metrics_(std::make_shared<ConnectionMetrics>()),
+        ptr_read_handler_memory_(std::make_shared<HandlerMemory>()),
+        ptr_write_handler_memory_(std::make_shared<HandlerMemory>()),
+        receive_storage_(batch_size_ * max_datagram_size_),
+        receive_senders_(batch_size_),
+#if defined(__linux__)
+        receive_headers_(batch_size_),
+        receive_iovecs_(batch_size_),
+        send_headers_(batch_size_),
+        send_iovecs_(batch_size_),
+#endif
+        ptr_lifetime_(std::make_shared<char>()),
+        is_receiving_(false),
+        is_flush_scheduled_(false),
+        is_waiting_writable_(false)
+    {
+#if defined(__linux__)
+        // Only the sender addresses and lengths change between batches
+        for (size_t i = 0; i < batch_size_; ++i) {
+            receive_iovecs_[i].iov_base = &receive_storage_[i * max_datagram_size_];
+            receive_iovecs_[i].iov_len = max_datagram_size_;
+        }
+#endif
+    }
+
+    UDPSocket::~UDPSocket()
+    {
+        Close();
+    }
+
+    void UDPSocket::Open(const udp::endpoint& local_endpoint)
+    {
+        socket_.open(local_endpoint.protocol());
+        ApplyBufferSizes();
+        socket_.non_blocking(true);
+        socket_.bind(local_endpoint);
+        PHYRE_LOG(info, kWho) << "Bound to " << socket_.local_endpoint();
+    }
+
+    void UDPSocket::Close()
+    {
+        if (!socket_.is_open()) {
+            return;
+        }
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        is_receiving_ = false;
+        is_waiting_writable_ = false;
+        while (!send_queue_.empty()) {
+            CompleteFront(boost::asio::error::operation_aborted);
+        }
+    }
+
+    void UDPSocket::set_receive_buffer_size(size_t bytes)
+    {
+        receive_buffer_size_ = bytes;
+        ApplyBufferSizes();
+    }
+
+    void UDPSocket::set_send_buffer_size(size_t bytes)
+    {
+        send_buffer_size_ = bytes;
+        ApplyBufferSizes();
+    }
+
+    size_t UDPSocket::receive_buffer_size() const
+    {
+        boost::asio::socket_base::receive_buffer_size option;
+        socket_.get_option(option);
+        return static_cast<size_t>(option.value());
+    }
+
+    size_t UDPSocket::send_buffer_size() const
+    {
+        boost::asio::socket_base::send_buffer_size option;
+        socket_.get_option(option);
+        return static_cast<size_t>(option.value());
+    }
+
+    udp::endpoint UDPSocket::local_endpoint() const
+    {
+        boost::system::error_code ignored;
+        return socket_.local_endpoint(ignored);
+    }
+
+    void UDPSocket::ApplyBufferSizes()
+    {
+        if (!socket_.is_open()) {
+            return;
+        }
+        boost::system::error_code ec;
+        if (receive_buffer_size_) {
+            socket_.set_option(boost::asio::socket_base::receive_buffer_size(static_cast<int>(receive_buffer_size_)), ec);
+            if (ec) {
+                PHYRE_LOG(warning, kWho) << "Failed to set the receive buffer to " << receive_buffer_size_ << " bytes: " << ec.message();
+            }
+        }
+        if (send_buffer_size_) {
+            socket_.set_option(boost::asio::socket_base::send_buffer_size(static_cast<int>(send_buffer_size_)), ec);
+            if (ec) {
+                PHYRE_LOG(warning, kWho) << "Failed to set the send buffer to " << send_buffer_size_ << " bytes: " << ec.message();
+            }
+        }
+    }
+
+    void UDPSocket::StartReceive()
+    {
+        if (is_receiving_) {
+            return;
+        }
+        is_receiving_ = true;
+        StartWaitReadable();
+    }
+
+    void UDPSocket::StartWaitReadable()
+    {
+        auto handler = MakeCustomAllocHandler(ptr_read_handler_memory_, [this](const boost::system::error_code& ec, size_t = 0) {
+            if (ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+            OnReadable(ec);
+        });
+#if BOOST_VERSION >= 106600
+        socket_.async_wait(udp::socket::wait_read, handler);
+#else
+        socket_.async_receive(boost::asio::null_buffers(), handler);
+#endif
+    }
+
+    void UDPSocket::OnReadable(const boost::system::error_code& ec)
+    {
+        if (!is_receiving_) {
+            return;
+        }
+        // Bounded, so that a flood of datagrams cannot starve everything else on the io_service
+        static const int kMaxBatchesPerWakeup = 8;
+        boost::system::error_code receive_ec = ec;
+        for (int batch = 0; batch < kMaxBatchesPerWakeup && !receive_ec && is_receiving_; ++batch) {
+            if (ReceiveBatch(receive_ec) < batch_size_) {
+                break;
+            }
+        }
+        if (receive_ec && receive_ec != boost::asio::error::would_block) {
+            PHYRE_LOG(warning, kWho) << "Receiving failed: " << receive_ec.message();
+            is_receiving_ = false;
+            if (on_receive_callback_) {
+                on_receive_callback_(receive_ec, boost::string_ref(), udp::endpoint());
+            }
+            return;
+        }
+        if (is_receiving_) {
+            StartWaitReadable();
+        }
+    }
+
+    size_t UDPSocket::ReceiveBatch(boost::system::error_code& ec)
+    {
+#if defined(__linux__)
+        for (size_t i = 0; i < batch_size_; ++i) {
+            msghdr& header = receive_headers_[i].msg_hdr;
+            std::memset(&header, 0, sizeof(header));
+            header.msg_name = receive_senders_[i].data();
+            header.msg_namelen = static_cast<socklen_t>(receive_senders_[i].capacity());
+            header.msg_iov = &receive_iovecs_[i];
+            header.msg_iovlen = 1;
+        }
+        int received = ::recvmmsg(socket_.native_handle(), receive_headers_.data(), static_cast<unsigned int>(batch_size_), MSG_DONTWAIT, nullptr);
+        if (received < 0) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return 0;
+        }
+        for (int i = 0; i < received && is_receiving_; ++i) {
+            const msghdr& header = receive_headers_[i].msg_hdr;
+            receive_senders_[i].resize(header.msg_namelen);
+            DeliverDatagram(&receive_storage_[i * max_datagram_size_], receive_headers_[i].msg_len,
+                            (header.msg_flags & MSG_TRUNC) != 0, receive_senders_[i]);
+        }
+        return static_cast<size_t>(received);
+#else
+        size_t received = 0;
+        while (received < batch_size_ && is_receiving_) {
+            size_t bytes = socket_.receive_from(boost::asio::buffer(&receive_storage_[0], max_datagram_size_), receive_senders_[0], 0, ec);
+            if (ec == boost::asio::error::message_size) {
+                ec.clear();
+                DeliverDatagram(&receive_storage_[0], bytes, true, receive_senders_[0]);
+            } else if (ec) {
+                break;
+            } else {
+                DeliverDatagram(&receive_storage_[0], bytes, false, receive_senders_[0]);
+            }
+            ++received;
+        }
+        if (received > 0 && ec == boost::asio::error::would_block) {
+            ec.clear();
+        }
+        return received;
+#endif
+    }
+
+    void UDPSocket::DeliverDatagram(const char* data, size_t size, bool is_truncated, const udp::endpoint& sender)
+    {
+        if (is_truncated) {
+            PHYRE_LOG(warning, kWho) << "Dropping a datagram from " << sender << " larger than " << max_datagram_size_ << " bytes";
+            return;
+        }
+        PHYRE_LOG(trace, kWho) << "Received " << size << " bytes from " << sender;
+        ptr_metrics_->RecordRead(size);
+        if (on_receive_callback_) {
+            on_receive_callback_(boost::system::error_code(), boost::string_ref(data, size), sender);
+        }
+    }
+
+    void UDPSocket::SendTo(std::string datagram, const udp::endpoint& destination, OnSendCallback on_send_callback)
+    {
+        if (!socket_.is_open()) {
+            if (on_send_callback) {
+                io_service_.post(std::bind(on_send_callback, boost::asio::error::bad_descriptor, 0));
+            }
+            return;
+        }
+        PendingDatagram pending;
+        pending.data = std::move(datagram);
+        pending.destination = destination;
+        pending.on_send_callback = std::move(on_send_callback);
+        pending.queued_at = ConnectionMetrics::Clock::now();
+        send_queue_.push_back(std::move(pending));
+        ptr_metrics_->RecordQueueDepth(send_queue_.size());
+        ScheduleFlush();
+    }
+
+    void UDPSocket::ScheduleFlush()
+    {
+        // Everything queued until the io_service gets around to the flush goes out as one batch
+        if (is_flush_scheduled_ || is_waiting_writable_) {
+            return;
+        }
+        is_flush_scheduled_ = true;
+        std::weak_ptr<char> lifetime = ptr_lifetime_;
+        io_service_.post([this, lifetime]() {
+            if (lifetime.expired()) {
+                return;
+            }
+            is_flush_scheduled_ = false;
+            Flush();
+        });
+    }
+
+    void UDPSocket::Flush()
+    {
+        while (!send_queue_.empty() && socket_.is_open()) {
+            boost::system::error_code ec;
+            size_t sent = SendBatch(ec);
+            // A callback may close the socket, which fails whatever is still queued
+            for (size_t i = 0; i < sent && !send_queue_.empty(); ++i) {
+                CompleteFront(boost::system::error_code());
+            }
+            if (ec == boost::asio::error::would_block) {
+                if (socket_.is_open()) {
+                    StartWaitWritable();
+                }
+                return;
+            }
+            if (ec && !send_queue_.empty()) {
+                // The datagram at the front is the one the kernel refused, the rest may still go out
+                PHYRE_LOG(warning, kWho) << "Sending to " << send_queue_.front().destination << " failed: " << ec.message();
+                CompleteFront(ec);
+            }
+        }
+    }
+
+    size_t UDPSocket::SendBatch(boost::system::error_code& ec)
+    {
+#if defined(__linux__)
+        size_t count = std::min(send_queue_.size(), batch_size_);
+        for (size_t i = 0; i < count; ++i) {
+            PendingDatagram& pending = send_queue_[i];
+            send_iovecs_[i].iov_base = &pending.data[0];
+            send_iovecs_[i].iov_len = pending.data.size();
+            msghdr& header = send_headers_[i].msg_hdr;
+            std::memset(&header, 0, sizeof(header));
+            header.msg_name = pending.destination.data();
+            header.msg_namelen = static_cast<socklen_t>(pending.destination.size());
+            header.msg_iov = &send_iovecs_[i];
+            header.msg_iovlen = 1;
+        }
+        int sent = ::sendmmsg(socket_.native_handle(), send_headers_.data(), static_cast<unsigned int>(count), MSG_DONTWAIT);
+        if (sent < 0) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return 0;
+        }
+        return static_cast<size_t>(sent);
+#else
+        size_t count = std::min(send_queue_.size(), batch_size_);
+        size_t sent = 0;
+        for (; sent < count; ++sent) {
+            const PendingDatagram& pending = send_queue_[sent];
+            socket_.send_to(boost::asio::buffer(pending.data), pending.destination, 0, ec);
+            if (ec) {
+                break;
+            }
+        }
+        return sent;
+#endif
+    }
+
+    void UDPSocket::CompleteFront(const boost::system::error_code& ec)
+    {
+        // Popped before the callback runs, which may queue the next datagram
+        PendingDatagram pending = std::move(send_queue_.front());
+        send_queue_.pop_front();
+        ptr_metrics_->RecordQueueDepth(send_queue_.size());
+        if (!ec) {
+            ptr_metrics_->RecordWrite(pending.data.size(), ConnectionMetrics::Clock::now() - pending.queued_at);
+        }
+        if (pending.on_send_callback) {
+            pending.on_send_callback(ec, ec ? 0 : pending.data.size());
+        }
+    }
+
+    void UDPSocket::StartWaitWritable()
+    {
+        PHYRE_LOG(debug, kWho) << "Send buffer full, waiting with " << send_queue_.size() << " datagram(s) queued";
+        is_waiting_writable_ = true;
+        auto handler = MakeCustomAllocHandler(ptr_write_handler_memory_, [this](const boost::system::error_code& ec, size_t = 0) {
+            if (ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+            is_waiting_writable_ = false;
+            Flush();
+        });
+#if BOOST_VERSION >= 106600
+        socket_.async_wait(udp::socket::wait_write, handler);
+#else
+        socket_.async_send(boost::asio::null_buffers(), handler);
+#endif
+    }
+
+}
+}
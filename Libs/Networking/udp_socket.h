@@ -0,0 +1,163 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <deque>
+#include <Logging/loggable_interface.h>
+#include "connection_metrics.h"
+#include "handler_allocator.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
+namespace Phyre
+{
+namespace Networking
+{
+    /**
+    * A datagram socket for traffic which would rather lose a message than wait for it, e.g. position updates,
+    * where a single lost TCP segment stalls every update queued behind it.
+    * Sends issued in the same turn of the io_service go out together, and every wake-up drains all datagrams
+    * which arrived meanwhile. On Linux a whole batch is a single sendmmsg/recvmmsg system call,
+    * elsewhere it falls back to one call per datagram.
+    * Like TCPSocket, it belongs to the thread running its io_service and must outlive its handlers.
+    */
+    class UDPSocket : public Logging::LoggableInterface
+    {
+    public:
+
+        // The view into the datagram is only valid during the callback
+        typedef std::function<void(const boost::system::error_code&,
+                                   boost::string_ref datagram,
+                                   const boost::asio::ip::udp::endpoint& sender)> OnReceiveCallback;
+        typedef std::function<void(const boost::system::error_code&, size_t)> OnSendCallback;
+
+        // Fits an Ethernet frame. Larger datagrams get truncated by the kernel and are dropped.
+        static const size_t kDefaultMaxDatagramSize = 1500;
+        static const size_t kDefaultBatchSize = 32;
+
+        UDPSocket(boost::asio::io_service& io_service,
+                  OnReceiveCallback on_receive_callback,
+                  size_t max_datagram_size = kDefaultMaxDatagramSize,
+                  size_t batch_size = kDefaultBatchSize);
+        ~UDPSocket();
+
+        // Opens the socket and binds it to the local endpoint, port 0 picks any free port.
+        // Throws boost::system::system_error on failure.
+        void Open(const boost::asio::ip::udp::endpoint& local_endpoint);
+        void Close();
+
+        // Keeps receiving until the socket is closed. Receive errors other than truncated
+        // datagrams are reported through the receive callback, which stops receiving.
+        void StartReceive();
+
+        /**
+        * Queues a datagram for the destination. The optional callback is invoked once it
+        * has been handed to the kernel or has failed; there is no delivery guarantee beyond that.
+        */
+        void SendTo(std::string datagram,
+                    const boost::asio::ip::udp::endpoint& destination,
+                    OnSendCallback on_send_callback = OnSendCallback());
+
+        // SO_RCVBUF and SO_SNDBUF, applied right away if open or else once opened. 0 keeps the system default.
+        // Bursts beyond the receive buffer are dropped by the kernel, so size it for the expected burst.
+        void set_receive_buffer_size(size_t bytes);
+        void set_send_buffer_size(size_t bytes);
+
+        // What the kernel actually granted, which may differ from what was asked for
+        size_t receive_buffer_size() const;
+        size_t send_buffer_size() const;
+
+        bool is_open() const { return socket_.is_open(); }
+        boost::asio::ip::udp::endpoint local_endpoint() const;
+        boost::asio::ip::udp::socket& socket() { return socket_; }
+        size_t send_queue_size() const { return send_queue_.size(); }
+
+        // Traffic counters of this socket, a read or write is a single datagram. Safe to query from any thread.
+        const ConnectionMetrics& metrics() const { return *ptr_metrics_; }
+
+        std::string log() override {
+            return "[UDPSocket]";
+        }
+
+    private:
+        struct PendingDatagram {
+            std::string data;
+            boost::asio::ip::udp::endpoint destination;
+            OnSendCallback on_send_callback;
+            ConnectionMetrics::Clock::time_point queued_at;
+        };
+
+        void ApplyBufferSizes();
+        void StartWaitReadable();
+        void OnReadable(const boost::system::error_code& ec);
+
+        // Receives up to a batch of datagrams without blocking
+        // @return The number of datagrams received, 0 with would_block once drained
+        size_t ReceiveBatch(boost::system::error_code& ec);
+        void DeliverDatagram(const char* data, size_t size, bool is_truncated, const boost::asio::ip::udp::endpoint& sender);
+
+        void ScheduleFlush();
+        void Flush();
+
+        // Sends the front of the queue, up to a batch, without blocking
+        // @return The number of datagrams the kernel accepted
+        size_t SendBatch(boost::system::error_code& ec);
+        void CompleteFront(const boost::system::error_code& ec);
+        void StartWaitWritable();
+
+        boost::asio::io_service& io_service_;
+        boost::asio::ip::udp::socket socket_;
+        OnReceiveCallback on_receive_callback_;
+        size_t max_datagram_size_;
+        size_t batch_size_;
+        size_t receive_buffer_size_;
+        size_t send_buffer_size_;
+        ConnectionMetrics::pointer ptr_metrics_;
+
+        // Recycled by the completion handlers of readiness waits
+        HandlerMemory::pointer ptr_read_handler_memory_;
+        HandlerMemory::pointer ptr_write_handler_memory_;
+
+        // batch_size_ slots of max_datagram_size_ bytes each, one per datagram of a batch
+        std::vector<char> receive_storage_;
+        std::vector<boost::asio::ip::udp::endpoint> receive_senders_;
+#if defined(__linux__)
+        std::vector<mmsghdr> receive_headers_;
+        std::vector<iovec> receive_iovecs_;
+        std::vector<mmsghdr> send_headers_;
+        std::vector<iovec> send_iovecs_;
+#endif
+        std::deque<PendingDatagram> send_queue_;
+
+        // Posted flushes only hold a weak reference to this, so that they can tell the socket is gone
+        std::shared_ptr<char> ptr_lifetime_;
+
+        bool is_receiving_;
+        bool is_flush_scheduled_;
+        bool is_waiting_writable_;
+
+        static const std::string kWho;
+    };
+
+    // A peer reached through a UDPSocket, e.g. the sender of a received datagram to reply to
+    class UDPEndpoint
+    {
+    public:
+        UDPEndpoint(UDPSocket& socket, const boost::asio::ip::udp::endpoint& address) :
+            p_socket_(&socket),
+            address_(address) { }
+
+        void Send(std::string datagram, UDPSocket::OnSendCallback on_send_callback = UDPSocket::OnSendCallback()) {
+            p_socket_->SendTo(std::move(datagram), address_, std::move(on_send_callback));
+        }
+
+        const boost::asio::ip::udp::endpoint& address() const { return address_; }
+        UDPSocket& socket() { return *p_socket_; }
+
+    private:
+        UDPSocket* p_socket_;
+        boost::asio::ip::udp::endpoint address_;
+    };
+}
+}
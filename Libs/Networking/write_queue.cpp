@@ -0,0 +1,125 @@
+#include <iterator>
+#include "write_queue.h"
+
+namespace Phyre {
+namespace Networking {
+
+    WriteQueue::WriteQueue() : pending_bytes_(0), pending_exclusive_(0), write_in_flight_(false) { }
+
+    bool WriteQueue::Push(std::string data, OnWriteCallback callback, std::vector<int> file_descriptors) {
+        return Enqueue(Entry{ std::move(data), SharedBuffer(), std::move(callback), ConnectionMetrics::Clock::time_point(),
+                              std::move(file_descriptors), SendableFile::pointer(), FileRange() });
+    }
+
+    bool WriteQueue::Push(SharedBuffer ptr_data, OnWriteCallback callback) {
+        return Enqueue(Entry{ std::string(), std::move(ptr_data), std::move(callback), ConnectionMetrics::Clock::time_point(),
+                              std::vector<int>(), SendableFile::pointer(), FileRange() });
+    }
+
+    bool WriteQueue::Push(SendableFile::pointer ptr_file, FileRange range, OnWriteCallback callback) {
+        return Enqueue(Entry{ std::string(), SharedBuffer(), std::move(callback), ConnectionMetrics::Clock::time_point(),
+                              std::vector<int>(), std::move(ptr_file), range });
+    }
+
+    bool WriteQueue::Enqueue(Entry entry) {
+        pending_bytes_ += entry.size();
+        // Only pay for reading the clock when somebody is looking at the latencies
+        if (ptr_metrics_) {
+            entry.queued_at = ConnectionMetrics::Clock::now();
+        }
+        if (entry.is_exclusive()) {
+            ++pending_exclusive_;
+        }
+        pending_.push_back(std::move(entry));
+        ReportDepth();
+        return !write_in_flight_;
+    }
+
+    WriteQueue::BufferSequence WriteQueue::PrepareBatch() {
+        if (pending_exclusive_ == 0) {
+            // Swapping keeps the capacity of both vectors around, so a steady
+            // stream of writes stops allocating once the queue has warmed up
+            in_flight_.swap(pending_);
+            pending_.clear();
+        } else {
+            auto end = pending_.begin();
+            if (end->is_exclusive()) {
+                --pending_exclusive_;
+                ++end;
+            } else {
+                while (end != pending_.end() && !end->is_exclusive()) {
+                    ++end;
+                }
+            }
+            in_flight_.clear();
+            in_flight_.insert(in_flight_.end(), std::make_move_iterator(pending_.begin()), std::make_move_iterator(end));
+            pending_.erase(pending_.begin(), end);
+        }
+
+        buffers_.clear();
+        for (const Entry& entry : in_flight_) {
+            if (!entry.ptr_file) {
+                buffers_.push_back(boost::asio::buffer(entry.bytes()));
+            }
+        }
+        write_in_flight_ = true;
+        return BufferSequence(buffers_.data(), buffers_.data() + buffers_.size());
+    }
+
+    const std::vector<int>& WriteQueue::batch_file_descriptors() const {
+        static const std::vector<int> kNone;
+        return in_flight_.empty() ? kNone : in_flight_.front().file_descriptors;
+    }
+
+    const SendableFile::pointer& WriteQueue::batch_file() const {
+        static const SendableFile::pointer kNone;
+        return in_flight_.empty() ? kNone : in_flight_.front().ptr_file;
+    }
+
+    FileRange WriteQueue::batch_file_range() const {
+        return in_flight_.empty() ? FileRange() : in_flight_.front().file_range;
+    }
+
+    bool WriteQueue::Complete(const boost::system::error_code& ec, size_t /*bytes_transferred*/) {
+        ConnectionMetrics::Clock::time_point completed_at;
+        if (ptr_metrics_ && !ec) {
+            completed_at = ConnectionMetrics::Clock::now();
+        }
+        for (Entry& entry : in_flight_) {
+            if (ptr_metrics_ && !ec) {
+                ptr_metrics_->RecordWrite(entry.size(), completed_at - entry.queued_at);
+            }
+            size_t size = entry.size();
+            pending_bytes_ -= size;
+            if (entry.callback) {
+                entry.callback(ec, ec ? 0 : size);
+            }
+        }
+        in_flight_.clear();
+        buffers_.clear();
+        write_in_flight_ = false;
+        ReportDepth();
+        return !ec && !pending_.empty();
+    }
+
+    void WriteQueue::Clear(const boost::system::error_code& ec) {
+        std::vector<Entry> failed;
+        failed.swap(pending_);
+        pending_exclusive_ = 0;
+        for (Entry& entry : failed) {
+            pending_bytes_ -= entry.size();
+            if (entry.callback) {
+                entry.callback(ec, 0);
+            }
+        }
+        ReportDepth();
+    }
+
+    void WriteQueue::ReportDepth() {
+        if (ptr_metrics_) {
+            ptr_metrics_->RecordQueueDepth(depth());
+        }
+    }
+
+}
+}
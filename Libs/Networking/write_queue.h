@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "connection_metrics.h"
+#include "sendable_file.h"
+
+namespace Phyre {
+namespace Networking {
+
+// Bounds on the bytes a single connection may have waiting to be written.
+// Once the queued bytes reach the high water mark the peer is considered to have
+// fallen behind: reads from it pause and further writes are handled according to
+// the policy, until the queue drains down to the low water mark again.
+struct WriteLimits {
+    enum OverflowPolicy {
+        // Fails further writes with would_block; producers retry once the writable callback says so
+        kBlock,
+        // Fails further writes with no_buffer_space
+        kDrop,
+        // Closes the connection
+        kDisconnect
+    };
+
+    // A high water mark of 0 leaves the queue unbounded
+    WriteLimits(size_t high = 0, size_t low = 0, OverflowPolicy overflow_policy = kBlock) :
+        high_water_mark(high),
+        low_water_mark(std::min(low, high)),
+        policy(overflow_policy) { }
+
+    bool is_bounded() const { return high_water_mark > 0; }
+
+    size_t high_water_mark;
+    size_t low_water_mark;
+    OverflowPolicy policy;
+};
+
+// An outbound queue of buffers for a single stream.
+// Every buffer pushed while a write is in flight gets coalesced into the next
+// batch, which is then handed to one scatter-gather async_write.
+// The queue does not own the stream, nor is it thread safe: the owner
+// decides how writes are issued and serializes access (usually with a strand).
+class WriteQueue {
+
+public:
+    // Invoked once the bytes of a single Push have been written or have failed
+    typedef std::function<void(const boost::system::error_code&, size_t)> OnWriteCallback;
+
+    // An immutable payload which many queues may hold on to at once, e.g. a broadcast
+    typedef std::shared_ptr<const std::string> SharedBuffer;
+
+    // The buffers of the in flight batch. It only points into the queue, so unlike the
+    // vector it is cheap for async_write to copy into its operation.
+    class BufferSequence {
+    public:
+        typedef boost::asio::const_buffer value_type;
+        typedef const boost::asio::const_buffer* const_iterator;
+
+        BufferSequence(const_iterator begin, const_iterator end) : begin_(begin), end_(end) { }
+
+        const_iterator begin() const { return begin_; }
+        const_iterator end() const { return end_; }
+        size_t size() const { return static_cast<size_t>(end_ - begin_); }
+
+    private:
+        const_iterator begin_;
+        const_iterator end_;
+    };
+
+    WriteQueue();
+
+    // File descriptors are passed along with the first byte of data, see SendWithFileDescriptors
+    // @return true if no write is in flight, meaning the caller should issue one
+    bool Push(std::string data,
+              OnWriteCallback callback = OnWriteCallback(),
+              std::vector<int> file_descriptors = std::vector<int>());
+
+    // Queues a reference to the payload rather than a copy of it
+    bool Push(SharedBuffer ptr_data, OnWriteCallback callback = OnWriteCallback());
+
+    // Queues a range of a file, which is sent straight from the file, see batch_file
+    bool Push(SendableFile::pointer ptr_file, FileRange range, OnWriteCallback callback = OnWriteCallback());
+
+    // Moves every pending buffer into the in flight batch.
+    // A buffer carrying file descriptors makes up a batch on its own, so that the
+    // descriptors are attached to its first byte; the batch ends before the next such buffer.
+    // So does a file range, for which the batch holds no buffers at all.
+    // The returned buffers stay valid until Complete is called.
+    BufferSequence PrepareBatch();
+
+    // The descriptors to send along with the in flight batch, usually none
+    const std::vector<int>& batch_file_descriptors() const;
+
+    // The file to send as the in flight batch, or null if the batch is made of buffers
+    const SendableFile::pointer& batch_file() const;
+    FileRange batch_file_range() const;
+
+    // Reports the outcome of the in flight batch to each of its callbacks
+    // @return true if more buffers were queued in the meantime and another batch should be written
+    bool Complete(const boost::system::error_code& ec, size_t bytes_transferred);
+
+    // Fails every pending (but not in flight) buffer with ec
+    void Clear(const boost::system::error_code& ec);
+
+    // Reports queue depth, bytes sent and write latencies from now on
+    void set_metrics(ConnectionMetrics::pointer ptr_metrics) { ptr_metrics_ = ptr_metrics; }
+
+    bool write_in_flight() const { return write_in_flight_; }
+
+    // The number of buffers waiting to be written, including the in flight batch
+    size_t depth() const { return pending_.size() + in_flight_.size(); }
+    size_t pending_bytes() const { return pending_bytes_; }
+    bool empty() const { return depth() == 0; }
+
+private:
+    struct Entry {
+        // Either the entry owns its data, or it shares ptr_shared_data with others
+        const std::string& bytes() const { return ptr_shared_data ? *ptr_shared_data : data; }
+        size_t size() const { return ptr_file ? static_cast<size_t>(file_range.length) : bytes().size(); }
+
+        // Whether the entry has to be written as a batch of its own
+        bool is_exclusive() const { return ptr_file || !file_descriptors.empty(); }
+
+        std::string data;
+        SharedBuffer ptr_shared_data;
+        OnWriteCallback callback;
+        ConnectionMetrics::Clock::time_point queued_at;
+        std::vector<int> file_descriptors;
+        SendableFile::pointer ptr_file;
+        FileRange file_range;
+    };
+
+    bool Enqueue(Entry entry);
+    void ReportDepth();
+
+    std::vector<Entry> pending_;
+    std::vector<Entry> in_flight_;
+    std::vector<boost::asio::const_buffer> buffers_;
+    ConnectionMetrics::pointer ptr_metrics_;
+    size_t pending_bytes_;
+
+    // Pending entries carrying file descriptors or a file, which PrepareBatch has to split the queue at
+    size_t pending_exclusive_;
+    bool write_in_flight_;
+};
+
+}
+}
@@ -6,6 +6,7 @@
 #include <boost/property_tree/ptree.hpp>
 #include <Configuration/provider.h>
 #include <Networking/tcp_server.h>
+#include <Networking/Test/tls_test_certificates.h>
 #include <Utils/test_loader.h>
 #include <XMPP/sasl.h>
 #include <XMPP/xmpp_client.h>
@@ -261,4 +262,49 @@ TEST_F(SASLTest, InitiateAuthenticationStreamSHA1) {
     std::string initial_message = authentication_payload.substr(initial_message_start + 1, initial_message_end - initial_message_start - 1);
     EXPECT_EQ(initial_message.size(), expected_size);
     EXPECT_STREQ(initial_message.substr(0, 4).c_str(), expected_first_characters.c_str());
-}
\ No newline at end of file
+}
+
+TEST_F(SASLTest, NegotiatesStartTLSBeforeAuthenticating) {
+    boost::asio::ssl::context server_context(boost::asio::ssl::context::sslv23_server);
+    boost::asio::ssl::context client_context(boost::asio::ssl::context::sslv23_client);
+    Phyre::Networking::UseTestCertificate(server_context);
+    Phyre::Networking::TrustTestCertificate(client_context);
+    ptr_xmpp_client_->set_tls_context(&client_context);
+
+    std::string plaintext;
+    std::string secured;
+    bool is_secured = false;
+    tcp_server_.set_on_read_callback([&](const Phyre::Networking::TCPServerConnection::pointer& connection, boost::string_ref bytes) {
+        if (is_secured) {
+            // The stream starts over once it has been secured
+            secured.append(bytes.data(), bytes.size());
+            if (secured.find("<stream:stream") != std::string::npos) {
+                io_service_.stop();
+            }
+            return bytes.size();
+        }
+
+        plaintext.append(bytes.data(), bytes.size());
+        if (plaintext.find("<stream:stream") != std::string::npos) {
+            plaintext.clear();
+            connection->Write("<stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams' version='1.0'>"
+                              "<stream:features><starttls xmlns='urn:ietf:params:xml:ns:xmpp-tls'><required/></starttls>"
+                              "<mechanisms xmlns='urn:ietf:params:xml:ns:xmpp-sasl'><mechanism>SCRAM-SHA-1</mechanism></mechanisms>"
+                              "</stream:features>");
+        } else if (plaintext.find("<starttls") != std::string::npos) {
+            plaintext.clear();
+            // Switching once the next read is in flight, which the client's handshake may already complete
+            connection->Write("<proceed xmlns='urn:ietf:params:xml:ns:xmpp-tls'/>", [&, connection](const boost::system::error_code& ec, size_t) {
+                ASSERT_FALSE(ec);
+                connection->StartTLS(server_context, [&is_secured]() { is_secured = true; });
+            });
+        }
+        return bytes.size();
+    });
+
+    tcp_server_.StartAccept();
+    ptr_xmpp_client_->Connect(host_, port_or_service_);
+    io_service_.run();
+    EXPECT_TRUE(ptr_xmpp_client_->is_tls());
+    EXPECT_NE(secured.find("<stream:stream"), std::string::npos);
+}
@@ -25,6 +25,9 @@ void SASL::Update() {
         case TransactionState::kSelectAuthenticationMechanism:
             HandleSelectAuthenticationMechanism();
             break;
+        case TransactionState::kAwaitTLSProceed:
+            HandleAwaitTLSProceed();
+            break;
         case TransactionState::kDecodeBase64Challenge:
             HandleDecodeBase64Challenge();
             break;
@@ -45,6 +48,17 @@ void SASL::HandleSelectAuthenticationMechanism() {
     if (authentication_mechanism_response.str().empty())
         return;
 
+    // Secure the stream before any credentials go over it (RFC 6120 section 5)
+    bool is_starttls_offered = authentication_mechanism_response.str().find("<starttls") != std::string::npos;
+    if (is_starttls_offered && client_.tls_context() && !client_.is_tls()) {
+        PHYRE_LOG(debug, kWho) << "Negotiating STARTTLS...";
+        transaction_state_ = kAwaitTLSProceed;
+        std::ostringstream starttls;
+        starttls << "<starttls xmlns='urn:ietf:params:xml:ns:xmpp-tls'/>";
+        client_.Write(starttls);
+        return;
+    }
+
     std::unordered_set<std::string> authentication_mechanism_set = ParseAuthenticationMechanisms(authentication_mechanism_response);
     Mechanism mechanism = SetAuthenticationMechanism(authentication_mechanism_set);
     if (mechanism == kNone) {
@@ -57,6 +71,24 @@ void SASL::HandleSelectAuthenticationMechanism() {
     client_.Write(InitiateAuthenticationStream(mechanism));
 }
 
+void SASL::HandleAwaitTLSProceed() {
+    if (client_.buffer().find("<failure") != std::string::npos) {
+        PHYRE_LOG(error, kWho) << "The server refused to start TLS";
+        client_.Disconnect();
+        return;
+    }
+    if (client_.buffer().find("<proceed") == std::string::npos) {
+        return;
+    }
+
+    // The stream starts over from scratch once it has been secured
+    client_.buffer().clear();
+    client_.StartTLS(*client_.tls_context(), client_.host(), [this]() {
+        transaction_state_ = kInitializeStream;
+        Update();
+    });
+}
+
 SASL::Mechanism SASL::SetAuthenticationMechanism(const std::unordered_set<std::string>& authentication_mechanism_set) {
     if (IsSHA1AuthenticationMechanismAvailable(authentication_mechanism_set)) {
         return kSHA1;
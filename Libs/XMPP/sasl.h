@@ -15,6 +15,7 @@ class SASL : public XMPPState, public Logging::LoggableInterface {
         enum TransactionState {
             kInitializeStream,
             kSelectAuthenticationMechanism,
+            kAwaitTLSProceed,
             kDecodeBase64Challenge
         };
 
@@ -41,6 +42,7 @@ class SASL : public XMPPState, public Logging::LoggableInterface {
 
         void HandleInitializeStream();
         void HandleSelectAuthenticationMechanism();
+        void HandleAwaitTLSProceed();
         void HandleDecodeBase64Challenge();
         std::unordered_set<std::string> ParseAuthenticationMechanisms(std::istream& xml_stream) const;
         std::string ParseBase64Challenge(std::istream& xml_stream) const;
@@ -15,17 +15,19 @@ XMPPClient::XMPPClient(boost::asio::io_service& io_service,
         host_(host),
         username_(username),
         password_(password),
+        p_tls_context_(nullptr),
         ptr_state_(std::make_unique<SASL>(*this)) { }
 
 void XMPPClient::OnConnect() {
     ptr_state_->Update();
 }
 
-void XMPPClient::OnRead(const std::string& bytes_read) {
-    std::string message = "From server: \n" + std::string(bytes_read);
-    PHYRE_LOG(debug, kWho) << message;
-    buffer_ += bytes_read;
+size_t XMPPClient::OnReadView(boost::string_ref bytes_read) {
+    // The log statement only formats the bytes when debug logging is enabled
+    PHYRE_LOG(debug, kWho) << "From server: \n" << bytes_read;
+    buffer_.append(bytes_read.data(), bytes_read.size());
     ptr_state_->Update();
+    return bytes_read.size();
 }
 
 void XMPPClient::OnError(const boost::system::error_code& ec) {
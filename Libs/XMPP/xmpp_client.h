@@ -15,7 +15,7 @@ class XMPPClient : public TCPClient {
         void OnConnect() final;
 
         // Called every time some bytes are read from the endpoint
-        void OnRead(const std::string& bytes_read) final;
+        size_t OnReadView(boost::string_ref bytes_read) final;
 
         // Called each time a boost::asio error occurs
         void OnError(const boost::system::error_code& ec) final;
@@ -30,6 +30,10 @@ class XMPPClient : public TCPClient {
 
         std::string password() const { return password_; }
 
+        // Negotiates STARTTLS with this context whenever the server offers it
+        void set_tls_context(boost::asio::ssl::context* p_tls_context) { p_tls_context_ = p_tls_context; }
+        boost::asio::ssl::context* tls_context() const { return p_tls_context_; }
+
     private:
         // All data read from endpoint ends up here
         std::string buffer_;
@@ -43,6 +47,9 @@ class XMPPClient : public TCPClient {
         // XMPP Password
         std::string password_;
 
+        // Used for STARTTLS, which is skipped without one
+        boost::asio::ssl::context* p_tls_context_;
+
         // The current state in the lifetime of the XMPP protocol
         std::unique_ptr<XMPPState> ptr_state_;
 
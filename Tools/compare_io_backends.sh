@@ -0,0 +1,29 @@
+#!/bin/sh
+
+# Builds NetworkBench once on epoll and once on io_uring, then runs both with the same arguments.
+# Usage: compare_io_backends.sh [NetworkBench arguments...]
+# Requires Linux, Boost 1.78+ and liburing; see the PHYRE_IO_URING option.
+
+# Bail on error
+set -e
+
+if [ -z "$PHYRE_ROOT" ]; then
+    echo "Please point the PHYRE_ROOT environment variable to the Phyre root directory"
+    exit 1
+fi
+
+for BACKEND in epoll io_uring; do
+    BUILD_DIR="$PHYRE_ROOT/Build-$BACKEND"
+    if [ "$BACKEND" = io_uring ]; then
+        IO_URING=ON
+    else
+        IO_URING=OFF
+    fi
+    mkdir -p "$BUILD_DIR"
+    (cd "$BUILD_DIR" && cmake .. -DPHYRE_IO_URING=$IO_URING > /dev/null && make -j NetworkBench > /dev/null)
+done
+
+for BACKEND in epoll io_uring; do
+    echo "### $BACKEND"
+    "$PHYRE_ROOT/Build-$BACKEND/Bin/NetworkBench" "$@"
+done
@@ -0,0 +1,17 @@
+#!/bin/sh
+
+# Builds the Networking tests on io_uring and runs them.
+# Requires Linux, Boost 1.78+ and liburing; see the PHYRE_IO_URING option.
+
+# Bail on error
+set -e
+
+if [ -z "$PHYRE_ROOT" ]; then
+    echo "Please point the PHYRE_ROOT environment variable to the Phyre root directory"
+    exit 1
+fi
+
+BUILD_DIR="$PHYRE_ROOT/Build-io_uring"
+mkdir -p "$BUILD_DIR"
+(cd "$BUILD_DIR" && cmake .. -DPHYRE_IO_URING=ON -DBOOST_LOG_DYN_LINK=ON && make -j NetworkingTests)
+"$BUILD_DIR/Bin/NetworkingTests" "$PHYRE_ROOT/phyre.json"
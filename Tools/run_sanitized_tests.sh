@@ -0,0 +1,20 @@
+#!/bin/sh
+
+# Builds the Networking tests with AddressSanitizer and runs them.
+# Defaults to the connection pool tests; pass a Google Test filter to run others.
+
+# Bail on error
+set -e
+
+if [ -z "$PHYRE_ROOT" ]; then
+    echo "Please point the PHYRE_ROOT environment variable to the Phyre root directory"
+    exit 1
+fi
+
+FILTER="${1:-TCPConnectionPool*}"
+BUILD_DIR="$PHYRE_ROOT/Build-asan"
+mkdir -p "$BUILD_DIR"
+(cd "$BUILD_DIR" && cmake .. -DBOOST_LOG_DYN_LINK=ON \
+                             -DCMAKE_CXX_FLAGS="-fsanitize=address -fno-omit-frame-pointer" \
+                             -DCMAKE_EXE_LINKER_FLAGS="-fsanitize=address" && make -j NetworkingTests)
+"$BUILD_DIR/Bin/NetworkingTests" "$PHYRE_ROOT/phyre.json" --gtest_filter="$FILTER"